@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Set up a jump buffer to start a function on a new stack
+ */
+
+#include <common.h>
+#include <asm/setjmp.h>
+
+int initjmp(jmp_buf jmp, void __noreturn (*func)(void), void *stack_base,
+	    size_t stack_sz)
+{
+	ulong sp = ALIGN_DOWN((ulong)stack_base + stack_sz, 16);
+
+	memset(jmp, '\0', sizeof(jmp_buf));
+#if defined(__aarch64__)
+	/* x30 (lr) and sp, see setjmp_aarch64.S */
+	jmp->regs[11] = (ulong)func;
+	jmp->regs[12] = sp;
+#else
+	/* sp and lr, see setjmp.S */
+	jmp->regs[8] = sp;
+	jmp->regs[9] = (ulong)func;
+#endif
+
+	return 0;
+}
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Set up a jump buffer to start a function on a new stack
+ */
+
+#include <common.h>
+#include <asm/setjmp.h>
+
+int initjmp(jmp_buf jmp, void __noreturn (*func)(void), void *stack_base,
+	    size_t stack_sz)
+{
+	memset(jmp, '\0', sizeof(jmp_buf));
+	jmp->regs[10] = (ulong)func;
+	jmp->regs[11] = ALIGN_DOWN((ulong)stack_base + stack_sz, 16);
+
+	return 0;
+}
@@ -49,6 +49,12 @@ void __udelay(unsigned long usec)
 		os_usleep(usec);
 }
 
+int initjmp(jmp_buf jmp, void __noreturn (*func)(void), void *stack_base,
+	    size_t stack_sz)
+{
+	return os_initjmp(jmp->data, func, stack_base, stack_sz);
+}
+
 int cleanup_before_linux(void)
 {
 	return 0;
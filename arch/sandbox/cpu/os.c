@@ -985,3 +985,45 @@ void os_relaunch(char *argv[])
 	execv(argv[0], argv);
 	os_exit(1);
 }
+
+/* Handed to os_initjmp_start() while os_initjmp() runs it on the new stack */
+static struct {
+	ucontext_t caller;
+	jmp_buf *jmp;
+	void (*func)(void);
+} initjmp_state;
+
+static void os_initjmp_start(void)
+{
+	void (*volatile func)(void) = initjmp_state.func;
+
+	/*
+	 * Record the jump buffer in this frame, on the new stack, then return
+	 * to os_initjmp(). A later longjmp() to the buffer continues here.
+	 */
+	if (!setjmp(*initjmp_state.jmp))
+		setcontext(&initjmp_state.caller);
+	func();
+
+	/* func() must not return */
+	os_exit(1);
+}
+
+int os_initjmp(ulong *jmp, void (*func)(void), void *stack, ulong size)
+{
+	ucontext_t ctx;
+
+	if (getcontext(&ctx))
+		return -errno;
+	ctx.uc_stack.ss_sp = stack;
+	ctx.uc_stack.ss_size = size;
+	ctx.uc_link = NULL;
+	makecontext(&ctx, os_initjmp_start, 0);
+
+	initjmp_state.jmp = (jmp_buf *)jmp;
+	initjmp_state.func = func;
+	if (swapcontext(&initjmp_state.caller, &ctx))
+		return -errno;
+
+	return 0;
+}
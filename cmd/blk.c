@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Block-device I/O statistics
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <part.h>
+#include <dm/device-internal.h>
+
+static const char *const op_name[BLK_STATS_OP_COUNT] = {
+	[BLK_STATS_READ]	= "read",
+	[BLK_STATS_WRITE]	= "write",
+	[BLK_STATS_ERASE]	= "erase",
+};
+
+static void show_hist(const char *name, const ulong *hist)
+{
+	int i;
+
+	printf("  %-10s", name);
+	for (i = 0; i < BLK_STATS_HIST_SIZE; i++) {
+		if (hist[i])
+			printf(" %lu%s:%lu", 1UL << i,
+			       i == BLK_STATS_HIST_SIZE - 1 ? "+" : "",
+			       hist[i]);
+	}
+	printf("\n");
+}
+
+static void show_stats(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_stats *stats = blk_get_stats(dev);
+	int op;
+
+	printf("%s %d (%s):\n", blk_get_if_type_name(desc->if_type),
+	       desc->devnum, dev->name);
+	for (op = 0; op < BLK_STATS_OP_COUNT; op++) {
+		struct blk_op_stats *st = &stats->op[op];
+
+		printf("%-6s %lu requests, %llu blocks, %llu us\n", op_name[op],
+		       st->count, st->blocks, st->time_us);
+		if (!st->count)
+			continue;
+		show_hist("blocks", st->size_hist);
+		show_hist("us", st->time_hist);
+	}
+}
+
+/*
+ * Run @func on the device given by the arguments, or on all probed block
+ * devices if there are none
+ */
+static int for_each_dev(int argc, char *const argv[],
+			void (*func)(struct udevice *dev))
+{
+	struct blk_desc *desc;
+	struct udevice *dev;
+	struct uclass *uc;
+
+	if (argc == 1) {
+		uclass_id_foreach_dev(UCLASS_BLK, dev, uc) {
+			if (device_active(dev))
+				func(dev);
+		}
+		return CMD_RET_SUCCESS;
+	}
+	if (argc != 3)
+		return CMD_RET_USAGE;
+
+	if (blk_get_device_by_str(argv[1], argv[2], &desc) < 0)
+		return CMD_RET_FAILURE;
+	func(desc->bdev);
+
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blk_stats(struct cmd_tbl *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	return for_each_dev(argc, argv, show_stats);
+}
+
+static int do_blk_reset(struct cmd_tbl *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	return for_each_dev(argc, argv, blk_reset_stats);
+}
+
+#ifdef CONFIG_SYS_LONGHELP
+static char blk_help_text[] =
+	"stats [<interface> <dev>] - show I/O statistics\n"
+	"blk reset [<interface> <dev>] - clear I/O statistics\n"
+	"\n"
+	"Without a device, all active block devices are used. Histograms\n"
+	"show the request size in blocks and the time taken in microseconds,\n"
+	"each bucket counting values from its label up to twice that.";
+#endif
+
+U_BOOT_CMD_WITH_SUBCMDS(blk, "Block-device statistics", blk_help_text,
+	U_BOOT_SUBCMD_MKENT(stats, 3, 1, do_blk_stats),
+	U_BOOT_SUBCMD_MKENT(reset, 3, 0, do_blk_reset));
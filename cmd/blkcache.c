@@ -18,26 +18,31 @@ static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
+	       "written back: %u\n"
 	       "entries: %u\n"
-	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "dirty: %u\n"
+	       "size: %lu KiB\n"
+	       "max size: %lu KiB\n"
+	       "max blocks/entry: %u\n",
+	       stats.hits, stats.misses, stats.evictions, stats.writebacks,
+	       stats.entries, stats.dirty, stats.size >> 10,
+	       stats.max_size >> 10, stats.max_blocks_per_entry);
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
-	unsigned blocks_per_entry, max_entries;
+	unsigned blocks_per_entry, size_mb;
 	if (argc != 3)
 		return CMD_RET_USAGE;
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
-	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
-	       max_entries, blocks_per_entry);
+	size_mb = simple_strtoul(argv[2], 0, 0);
+	blkcache_configure(blocks_per_entry, size_mb);
+	printf("changed to max of %u MiB, caching up to %u blocks at a time\n",
+	       size_mb, blocks_per_entry);
 	return 0;
 }
 
@@ -83,6 +88,6 @@ U_BOOT_CMD(
 	blkcache, 4, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <blocks> <size> "
+	"- set max blocks per read/write to cache and max cache size in MiB\n"
 );
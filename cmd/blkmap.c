@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Composable virtual block devices
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <blkmap.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <part.h>
+
+static int blkmap_curr_dev;
+
+/**
+ * struct map_ctx - What to map, as given to 'blkmap map'
+ *
+ * @dev: blkmap device
+ * @blknr: First block of the blkmap to map
+ * @blkcnt: Number of blocks to map
+ */
+struct map_ctx {
+	struct udevice *dev;
+	lbaint_t blknr;
+	lbaint_t blkcnt;
+};
+
+/* Map the blocks in @ctx with the type-specific arguments in @argv */
+typedef int (*map_parser_fn)(struct map_ctx *ctx, int argc,
+			     char *const argv[]);
+
+static int do_blkmap_map_linear(struct map_ctx *ctx, int argc,
+				char *const argv[])
+{
+	struct blk_desc *lbd;
+	lbaint_t lblknr;
+	int ret;
+
+	if (argc != 4)
+		return CMD_RET_USAGE;
+
+	if (blk_get_device_by_str(argv[1], argv[2], &lbd) < 0) {
+		printf("Found no device matching \"%s %s\"\n", argv[1],
+		       argv[2]);
+		return CMD_RET_FAILURE;
+	}
+	lblknr = hextoul(argv[3], NULL);
+
+	ret = blkmap_map_linear(ctx->dev, ctx->blknr, ctx->blkcnt, lbd->bdev,
+				lblknr);
+	if (ret) {
+		printf("Unable to map \"%s %s\" at block 0x" LBAF " (err=%d)\n",
+		       argv[1], argv[2], ctx->blknr, ret);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("Block 0x" LBAF "+0x" LBAF " mapped to block 0x" LBAF
+	       " of \"%s %s\"\n", ctx->blknr, ctx->blkcnt, lblknr, argv[1],
+	       argv[2]);
+
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blkmap_map_mem(struct map_ctx *ctx, int argc,
+			     char *const argv[])
+{
+	phys_addr_t addr;
+	int ret;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	addr = hextoul(argv[1], NULL);
+
+	ret = blkmap_map_pmem(ctx->dev, ctx->blknr, ctx->blkcnt, addr);
+	if (ret) {
+		printf("Unable to map %#llx at block 0x" LBAF " (err=%d)\n",
+		       (unsigned long long)addr, ctx->blknr, ret);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("Block 0x" LBAF "+0x" LBAF " mapped to %#llx\n",
+	       ctx->blknr, ctx->blkcnt, (unsigned long long)addr);
+
+	return CMD_RET_SUCCESS;
+}
+
+static const struct {
+	const char *name;
+	map_parser_fn fn;
+} map_parsers[] = {
+	{ "linear", do_blkmap_map_linear },
+	{ "mem", do_blkmap_map_mem },
+};
+
+static int do_blkmap_map(struct cmd_tbl *cmdtp, int flag, int argc,
+			 char *const argv[])
+{
+	struct map_ctx ctx;
+	int i;
+
+	if (argc < 5)
+		return CMD_RET_USAGE;
+
+	ctx.dev = blkmap_from_label(argv[1]);
+	if (!ctx.dev) {
+		printf("\"%s\" is not the name of any known blkmap\n",
+		       argv[1]);
+		return CMD_RET_FAILURE;
+	}
+
+	ctx.blknr = hextoul(argv[2], NULL);
+	ctx.blkcnt = hextoul(argv[3], NULL);
+	argc -= 4;
+	argv += 4;
+
+	for (i = 0; i < ARRAY_SIZE(map_parsers); i++) {
+		if (!strcmp(map_parsers[i].name, argv[0]))
+			return map_parsers[i].fn(&ctx, argc, argv);
+	}
+
+	printf("Unknown map type \"%s\"\n", argv[0]);
+	return CMD_RET_USAGE;
+}
+
+static int do_blkmap_create(struct cmd_tbl *cmdtp, int flag, int argc,
+			    char *const argv[])
+{
+	const char *label;
+	int ret;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	label = argv[1];
+
+	ret = blkmap_create(label, NULL);
+	if (ret) {
+		printf("Unable to create \"%s\" (err=%d)\n", label, ret);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("Created \"%s\"\n", label);
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blkmap_destroy(struct cmd_tbl *cmdtp, int flag, int argc,
+			     char *const argv[])
+{
+	struct udevice *dev;
+	const char *label;
+	int ret;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	label = argv[1];
+
+	dev = blkmap_from_label(label);
+	if (!dev) {
+		printf("\"%s\" is not the name of any known blkmap\n", label);
+		return CMD_RET_FAILURE;
+	}
+
+	ret = blkmap_destroy(dev);
+	if (ret) {
+		printf("Unable to destroy \"%s\" (err=%d)\n", label, ret);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("Destroyed \"%s\"\n", label);
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blkmap_get(struct cmd_tbl *cmdtp, int flag, int argc,
+			 char *const argv[])
+{
+	struct udevice *dev, *blk;
+	struct blk_desc *bd;
+
+	if (argc < 3 || argc > 4 || strcmp(argv[2], "dev"))
+		return CMD_RET_USAGE;
+
+	dev = blkmap_from_label(argv[1]);
+	if (!dev) {
+		printf("\"%s\" is not the name of any known blkmap\n",
+		       argv[1]);
+		return CMD_RET_FAILURE;
+	}
+
+	if (device_find_first_child_by_uclass(dev, UCLASS_BLK, &blk)) {
+		printf("\"%s\" has no block device\n", argv[1]);
+		return CMD_RET_FAILURE;
+	}
+	bd = dev_get_uclass_plat(blk);
+
+	if (argc == 4)
+		env_set_ulong(argv[3], bd->devnum);
+	else
+		printf("%d\n", bd->devnum);
+
+	return CMD_RET_SUCCESS;
+}
+
+static int do_blkmap_common(struct cmd_tbl *cmdtp, int flag, int argc,
+			    char *const argv[])
+{
+	/* The subcommand parsing drops 'blkmap', which blk_common_cmd() wants */
+	argc++;
+	argv--;
+
+	return blk_common_cmd(argc, argv, IF_TYPE_BLKMAP, &blkmap_curr_dev);
+}
+
+#ifdef CONFIG_SYS_LONGHELP
+static char blkmap_help_text[] =
+	"map <label> <blk#> <cnt> linear <interface> <dev> <lblk#>\n"
+	"    - map <cnt> blocks from <blk#> onto blocks of another device,\n"
+	"      starting at <lblk#>\n"
+	"blkmap map <label> <blk#> <cnt> mem <addr>\n"
+	"    - map <cnt> blocks from <blk#> onto memory at <addr>\n"
+	"blkmap create <label> - create a blkmap with nothing mapped\n"
+	"blkmap destroy <label> - remove a blkmap and all its mappings\n"
+	"blkmap get <label> dev [<var>] - show or set <var> to the device\n"
+	"    number of the blkmap, to use with other commands\n"
+	"blkmap info - list the blkmap devices\n"
+	"blkmap part [<dev>] - list the partitions of all devices, or <dev>\n"
+	"blkmap dev [<dev>] - show or set the current device\n"
+	"blkmap read <addr> <blk#> <cnt> - read from the current device\n"
+	"blkmap write <addr> <blk#> <cnt> - write to the current device\n"
+	"\n"
+	"All numbers other than device numbers are hexadecimal, and blocks\n"
+	"are 512 bytes.";
+#endif
+
+U_BOOT_CMD_WITH_SUBCMDS(blkmap, "Composable virtual block devices",
+	blkmap_help_text,
+	U_BOOT_SUBCMD_MKENT(info, 1, 1, do_blkmap_common),
+	U_BOOT_SUBCMD_MKENT(part, 2, 1, do_blkmap_common),
+	U_BOOT_SUBCMD_MKENT(dev, 2, 1, do_blkmap_common),
+	U_BOOT_SUBCMD_MKENT(read, 4, 1, do_blkmap_common),
+	U_BOOT_SUBCMD_MKENT(write, 4, 0, do_blkmap_common),
+	U_BOOT_SUBCMD_MKENT(get, 4, 1, do_blkmap_get),
+	U_BOOT_SUBCMD_MKENT(create, 2, 0, do_blkmap_create),
+	U_BOOT_SUBCMD_MKENT(destroy, 2, 0, do_blkmap_destroy),
+	U_BOOT_SUBCMD_MKENT(map, 8, 0, do_blkmap_map));
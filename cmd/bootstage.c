@@ -6,6 +6,10 @@
 #include <common.h>
 #include <bootstage.h>
 #include <command.h>
+#include <env.h>
+#include <fs.h>
+#include <malloc.h>
+#include <mapmem.h>
 
 static int do_bootstage_report(struct cmd_tbl *cmdtp, int flag, int argc,
 			       char *const argv[])
@@ -59,10 +63,61 @@ static int do_bootstage_stash(struct cmd_tbl *cmdtp, int flag, int argc,
 	return 0;
 }
 
+static int do_bootstage_export(struct cmd_tbl *cmdtp, int flag, int argc,
+			       char *const argv[])
+{
+	enum bootstage_export_fmt fmt;
+	loff_t actwrite;
+	ulong addr;
+	char *buf;
+	int len;
+
+	if (argc < 2 || argc == 4 || argc == 5)
+		return CMD_RET_USAGE;
+	if (!strcmp(argv[1], "csv"))
+		fmt = BOOTSTAGE_EXPORT_CSV;
+	else if (!strcmp(argv[1], "json"))
+		fmt = BOOTSTAGE_EXPORT_JSON;
+	else
+		return CMD_RET_USAGE;
+
+	len = bootstage_export(NULL, 0, fmt);
+	if (argc == 2) {
+		buf = malloc(len + 1);
+		if (!buf) {
+			printf("Out of memory\n");
+			return CMD_RET_FAILURE;
+		}
+		bootstage_export(buf, len + 1, fmt);
+		puts(buf);
+		free(buf);
+
+		return 0;
+	}
+
+	addr = hextoul(argv[2], NULL);
+	buf = map_sysmem(addr, len + 1);
+	bootstage_export(buf, len + 1, fmt);
+	unmap_sysmem(buf);
+	env_set_hex("filesize", len);
+	if (argc == 3)
+		return 0;
+
+	if (fs_set_blk_dev(argv[3], argv[4], FS_TYPE_ANY))
+		return CMD_RET_FAILURE;
+	if (fs_write(argv[5], addr, 0, len, &actwrite) || actwrite != len) {
+		printf("Failed to write '%s'\n", argv[5]);
+		return CMD_RET_FAILURE;
+	}
+
+	return 0;
+}
+
 static struct cmd_tbl cmd_bootstage_sub[] = {
 	U_BOOT_CMD_MKENT(report, 2, 1, do_bootstage_report, "", ""),
 	U_BOOT_CMD_MKENT(stash, 4, 0, do_bootstage_stash, "", ""),
 	U_BOOT_CMD_MKENT(unstash, 4, 0, do_bootstage_stash, "", ""),
+	U_BOOT_CMD_MKENT(export, 6, 0, do_bootstage_export, "", ""),
 };
 
 /*
@@ -87,10 +142,13 @@ static int do_boostage(struct cmd_tbl *cmdtp, int flag, int argc,
 }
 
 
-U_BOOT_CMD(bootstage, 4, 1, do_boostage,
+U_BOOT_CMD(bootstage, 7, 1, do_boostage,
 	"Boot stage command",
 	" - check boot progress and timing\n"
 	"report                      - Print a report\n"
 	"stash [<start> [<size>]]    - Stash data into memory\n"
-	"unstash [<start> [<size>]]  - Unstash data from memory"
+	"unstash [<start> [<size>]]  - Unstash data from memory\n"
+	"export csv|json [<addr> [<interface> <dev[:part]> <file>]]\n"
+	"                            - Export records to the console, to memory\n"
+	"                              or to a file (size in $filesize)"
 );
@@ -35,9 +35,9 @@ int do_fat_fsload(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 
 
 U_BOOT_CMD(
-	fatload,	7,	0,	do_fat_fsload,
+	fatload,	9,	0,	do_fat_fsload,
 	"load binary file from a dos filesystem",
-	"<interface> [<dev[:part]> [<addr> [<filename> [bytes [pos]]]]]\n"
+	"[-h <algo>|-z <comp>] <interface> [<dev[:part]> [<addr> [<filename> [bytes [pos]]]]]\n"
 	"    - Load binary file 'filename' from 'dev' on 'interface'\n"
 	"      to address 'addr' from dos filesystem.\n"
 	"      'pos' gives the file position to start loading from.\n"
@@ -46,7 +46,12 @@ U_BOOT_CMD(
 	"      the load stops on end of file.\n"
 	"      If either 'pos' or 'bytes' are not aligned to\n"
 	"      ARCH_DMA_MINALIGN then a misaligned buffer warning will\n"
-	"      be printed and performance will suffer for the load."
+	"      be printed and performance will suffer for the load.\n"
+	"      With -h, the file is hashed with 'algo' as it is loaded and\n"
+	"      the digest is saved in 'filehash'.\n"
+	"      With -z, the file is decompressed as it is loaded; 'comp' is\n"
+	"      gzip, lz4, lzma, zstd or auto. 'filesize' is then the\n"
+	"      uncompressed size."
 );
 
 static int do_fat_ls(struct cmd_tbl *cmdtp, int flag, int argc,
@@ -30,15 +30,20 @@ static int do_load_wrapper(struct cmd_tbl *cmdtp, int flag, int argc,
 }
 
 U_BOOT_CMD(
-	load,	7,	0,	do_load_wrapper,
+	load,	9,	0,	do_load_wrapper,
 	"load binary file from a filesystem",
-	"<interface> [<dev[:part]> [<addr> [<filename> [bytes [pos]]]]]\n"
+	"[-h <algo>|-z <comp>] <interface> [<dev[:part]> [<addr> [<filename> [bytes [pos]]]]]\n"
 	"    - Load binary file 'filename' from partition 'part' on device\n"
 	"       type 'interface' instance 'dev' to address 'addr' in memory.\n"
 	"      'bytes' gives the size to load in bytes.\n"
 	"      If 'bytes' is 0 or omitted, the file is read until the end.\n"
 	"      'pos' gives the file byte position to start reading from.\n"
-	"      If 'pos' is 0 or omitted, the file is read from the start."
+	"      If 'pos' is 0 or omitted, the file is read from the start.\n"
+	"      With -h, the file is hashed with 'algo' as it is loaded and\n"
+	"      the digest is saved in 'filehash'.\n"
+	"      With -z, the file is decompressed as it is loaded; 'comp' is\n"
+	"      gzip, lz4, lzma, zstd or auto. 'filesize' is then the\n"
+	"      uncompressed size."
 )
 
 static int do_save_wrapper(struct cmd_tbl *cmdtp, int flag, int argc,
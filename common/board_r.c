@@ -58,6 +58,7 @@
 #include <stdio_dev.h>
 #include <timer.h>
 #include <trace.h>
+#include <uthread.h>
 #include <watchdog.h>
 #ifdef CONFIG_XEN
 #include <xen.h>
@@ -417,6 +418,73 @@ static int initr_onenand(void)
 }
 #endif
 
+#if CONFIG_IS_ENABLED(UTHREAD_INIT_R)
+/**
+ * struct initr_thread - an init function running in its own thread
+ *
+ * @uthr: Thread
+ * @func: Init function run by the thread
+ * @ret: Return value of @func, once the thread has finished
+ */
+struct initr_thread {
+	struct uthread uthr;
+	init_fnc_t func;
+	int ret;
+};
+
+static struct initr_thread initr_threads[2];
+static int initr_thread_count;
+static unsigned int initr_grp_id;
+
+static void initr_thread_run(void *arg)
+{
+	struct initr_thread *thr = arg;
+
+	thr->ret = thr->func();
+}
+
+/*
+ * Start an init function in a thread, so that it can overlap with the
+ * following init functions. If no thread can be created, it is run directly.
+ */
+static int initr_spawn(init_fnc_t func)
+{
+	struct initr_thread *thr;
+
+	if (!initr_grp_id)
+		initr_grp_id = uthread_grp_new_id();
+	if (initr_thread_count == ARRAY_SIZE(initr_threads))
+		return func();
+
+	thr = &initr_threads[initr_thread_count];
+	thr->func = func;
+	if (uthread_create(&thr->uthr, initr_thread_run, thr, 0, initr_grp_id))
+		return func();
+	initr_thread_count++;
+
+	return 0;
+}
+
+/*
+ * Wait for all init functions started by initr_spawn(). This fails, as the
+ * init function would have done if run directly, if any of them failed.
+ */
+static int initr_join(void)
+{
+	int i;
+
+	if (initr_grp_id)
+		uthread_grp_join(initr_grp_id);
+
+	for (i = 0; i < initr_thread_count; i++) {
+		if (initr_threads[i].ret)
+			return initr_threads[i].ret;
+	}
+
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_MMC
 static int initr_mmc(void)
 {
@@ -424,6 +492,22 @@ static int initr_mmc(void)
 	mmc_initialize(gd->bd);
 	return 0;
 }
+
+#if CONFIG_IS_ENABLED(UTHREAD_INIT_R)
+static int initr_mmc_spawn(void)
+{
+	/*
+	 * The environment is loaded next, so it cannot wait for the MMC if
+	 * it may be stored there, directly or in a filesystem
+	 */
+	if (IS_ENABLED(CONFIG_ENV_IS_IN_MMC) ||
+	    IS_ENABLED(CONFIG_ENV_IS_IN_FAT) ||
+	    IS_ENABLED(CONFIG_ENV_IS_IN_EXT4))
+		return initr_mmc();
+
+	return initr_spawn(initr_mmc);
+}
+#endif
 #endif
 
 #ifdef CONFIG_PVBLOCK
@@ -544,6 +628,13 @@ static int initr_net(void)
 #endif
 	return 0;
 }
+
+#if CONFIG_IS_ENABLED(UTHREAD_INIT_R)
+static int initr_net_spawn(void)
+{
+	return initr_spawn(initr_net);
+}
+#endif
 #endif
 
 #ifdef CONFIG_POST
@@ -706,8 +797,12 @@ static init_fnc_t init_sequence_r[] = {
 	initr_onenand,
 #endif
 #ifdef CONFIG_MMC
+#if CONFIG_IS_ENABLED(UTHREAD_INIT_R)
+	initr_mmc_spawn,
+#else
 	initr_mmc,
 #endif
+#endif
 #ifdef CONFIG_XEN
 	xen_init,
 #endif
@@ -779,8 +874,15 @@ static init_fnc_t init_sequence_r[] = {
 #endif
 #ifdef CONFIG_CMD_NET
 	INIT_FUNC_WATCHDOG_RESET
+#if CONFIG_IS_ENABLED(UTHREAD_INIT_R)
+	initr_net_spawn,
+#else
 	initr_net,
 #endif
+#endif
+#if CONFIG_IS_ENABLED(UTHREAD_INIT_R)
+	initr_join,
+#endif
 #ifdef CONFIG_POST
 	initr_post,
 #endif
@@ -365,6 +365,109 @@ void bootstage_report(void)
 	}
 }
 
+/**
+ * Append formatted text to an export buffer
+ *
+ * Like snprintf(), this keeps counting once the buffer is full, so the caller
+ * can find out how much space is needed.
+ *
+ * @param buf	Buffer to write to, or NULL to just count
+ * @param size	Size of buffer
+ * @param pos	Current position, updated by this function
+ * @param fmt	printf()-style format string
+ */
+static void export_printf(char *buf, int size, int *pos, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf && *pos < size ? buf + *pos : NULL,
+			buf && *pos < size ? size - *pos : 0, fmt, args);
+	va_end(args);
+	*pos += len;
+}
+
+/**
+ * Append a record name to an export buffer
+ *
+ * A CSV name is put in double quotes, with any quotes doubled, if it holds a
+ * comma, quote or line break. A JSON name is always quoted, with quotes,
+ * backslashes and control characters escaped.
+ *
+ * @param buf	Buffer to write to, or NULL to just count
+ * @param size	Size of buffer
+ * @param pos	Current position, updated by this function
+ * @param name	Name to append
+ * @param json	true for JSON, false for CSV
+ */
+static void export_name(char *buf, int size, int *pos, const char *name,
+			bool json)
+{
+	const char *p;
+
+	if (!json && !strpbrk(name, ",\"\r\n")) {
+		export_printf(buf, size, pos, "%s", name);
+		return;
+	}
+	export_printf(buf, size, pos, "\"");
+	for (p = name; *p; p++) {
+		if (json && (*p == '"' || *p == '\\'))
+			export_printf(buf, size, pos, "\\%c", *p);
+		else if (json && (uchar)*p < 0x20)
+			export_printf(buf, size, pos, "\\u%04x", *p);
+		else if (*p == '"')
+			export_printf(buf, size, pos, "\"\"");
+		else
+			export_printf(buf, size, pos, "%c", *p);
+	}
+	export_printf(buf, size, pos, "\"");
+}
+
+int bootstage_export(char *buf, int size, enum bootstage_export_fmt fmt)
+{
+	struct bootstage_data *data = gd->bootstage;
+	struct bootstage_record *rec;
+	bool json = fmt == BOOTSTAGE_EXPORT_JSON;
+	const char *sep = "";
+	char namebuf[20];
+	int pos = 0;
+	int i;
+
+	if (json)
+		export_printf(buf, size, &pos, "{\"records\":[");
+	else
+		export_printf(buf, size, &pos, "id,name,start_us,accum_us\n");
+
+	for (i = 0, rec = data->record; i < data->rec_count; i++, rec++) {
+		const char *name = get_record_name(namebuf, sizeof(namebuf),
+						   rec);
+		ulong start_us = rec->start_us ? rec->start_us : rec->time_us;
+		ulong accum_us = rec->start_us ? rec->time_us : 0;
+
+		if (rec->id != BOOTSTAGE_ID_AWAKE && rec->time_us == 0)
+			continue;
+		if (json) {
+			export_printf(buf, size, &pos, "%s{\"id\":%d,\"name\":",
+				      sep, rec->id);
+			export_name(buf, size, &pos, name, true);
+			export_printf(buf, size, &pos,
+				      ",\"start_us\":%lu,\"accum_us\":%lu}",
+				      start_us, accum_us);
+			sep = ",";
+		} else {
+			export_printf(buf, size, &pos, "%d,", rec->id);
+			export_name(buf, size, &pos, name, false);
+			export_printf(buf, size, &pos, ",%lu,%lu\n", start_us,
+				      accum_us);
+		}
+	}
+	if (json)
+		export_printf(buf, size, &pos, "]}\n");
+
+	return pos;
+}
+
 /**
  * Append data to a memory buffer
  *
@@ -14,8 +14,10 @@
 #include <console.h>
 #include <env.h>
 #include <log.h>
+#include <malloc.h>
 #include <asm/global_data.h>
 #include <linux/ctype.h>
+#include <linux/kernel.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -123,10 +125,102 @@ struct cmd_tbl *find_cmd_tbl(const char *cmd, struct cmd_tbl *table,
 	return NULL;	/* not found or ambiguous command */
 }
 
+#ifdef CONFIG_CMDLINE_HASH
+/*
+ * Hash table of full command names in the linker-list command table. Each
+ * slot holds the table index plus one, so that zero means an empty slot.
+ */
+static u16 *cmd_hash;
+static uint cmd_hash_mask;
+
+static uint cmd_hash_name(const char *name, int len)
+{
+	uint hash = 5381;
+
+	while (len--)
+		hash = hash * 33 + *name++;
+
+	return hash;
+}
+
+static int cmd_hash_build(struct cmd_tbl *table, int table_len)
+{
+	uint size, slot;
+	int i;
+
+	for (size = 16; size < table_len * 2; size <<= 1)
+		;
+	cmd_hash = calloc(size, sizeof(*cmd_hash));
+	if (!cmd_hash)
+		return -ENOMEM;
+	cmd_hash_mask = size - 1;
+
+	for (i = 0; i < table_len; i++) {
+		const char *name = table[i].name;
+		int len = strlen(name);
+
+		slot = cmd_hash_name(name, len) & cmd_hash_mask;
+		while (cmd_hash[slot]) {
+			/* Keep the first entry, as the linear search does */
+			if (!strcmp(table[cmd_hash[slot] - 1].name, name))
+				break;
+			slot = (slot + 1) & cmd_hash_mask;
+		}
+		if (!cmd_hash[slot])
+			cmd_hash[slot] = i + 1;
+	}
+	log_debug("Hashed %d commands into %u slots\n", table_len, size);
+
+	return 0;
+}
+
+/* Look up a command by its full name, returning NULL if not found */
+static struct cmd_tbl *cmd_hash_find(const char *cmd, struct cmd_tbl *table,
+				     int table_len)
+{
+	const char *p;
+	uint slot;
+	int len;
+
+	/*
+	 * The hash table lives in the heap, so wait until it is fully
+	 * available, and give up if there are too many commands to index.
+	 */
+	if (!cmd_hash) {
+		if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT) ||
+		    table_len >= U16_MAX || cmd_hash_build(table, table_len))
+			return NULL;
+	}
+
+	len = ((p = strchr(cmd, '.')) == NULL) ? strlen(cmd) : (p - cmd);
+	slot = cmd_hash_name(cmd, len) & cmd_hash_mask;
+	while (cmd_hash[slot]) {
+		struct cmd_tbl *cmdtp = &table[cmd_hash[slot] - 1];
+
+		if (!strncmp(cmd, cmdtp->name, len) && !cmdtp->name[len])
+			return cmdtp;
+		slot = (slot + 1) & cmd_hash_mask;
+	}
+
+	return NULL;
+}
+#endif
+
 struct cmd_tbl *find_cmd(const char *cmd)
 {
 	struct cmd_tbl *start = ll_entry_start(struct cmd_tbl, cmd);
 	const int len = ll_entry_count(struct cmd_tbl, cmd);
+
+#ifdef CONFIG_CMDLINE_HASH
+	struct cmd_tbl *cmdtp;
+
+	if (cmd) {
+		cmdtp = cmd_hash_find(cmd, start, len);
+		if (cmdtp)
+			return cmdtp;
+	}
+#endif
+	/* Abbreviated or unknown commands need a full search */
 	return find_cmd_tbl(cmd, start, len);
 }
 
@@ -151,6 +151,7 @@ void dev_print (struct blk_desc *dev_desc)
 	case IF_TYPE_NVME:
 	case IF_TYPE_PVBLOCK:
 	case IF_TYPE_HOST:
+	case IF_TYPE_BLKMAP:
 		printf ("Vendor: %s Rev: %s Prod: %s\n",
 			dev_desc->vendor,
 			dev_desc->revision,
@@ -232,6 +233,13 @@ void dev_print (struct blk_desc *dev_desc)
 
 #ifdef CONFIG_HAVE_BLOCK_DEVICE
 
+void part_new_media_gen(struct blk_desc *dev_desc)
+{
+	static uint last_media_gen;
+
+	dev_desc->media_gen = ++last_media_gen;
+}
+
 void part_init(struct blk_desc *dev_desc)
 {
 	struct part_driver *drv =
@@ -240,6 +248,7 @@ void part_init(struct blk_desc *dev_desc)
 	struct part_driver *entry;
 
 	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
+	part_new_media_gen(dev_desc);
 
 	dev_desc->part_type = PART_TYPE_UNKNOWN;
 	for (entry = drv; entry != drv + n_ents; entry++) {
@@ -299,6 +308,9 @@ static void print_part_header(const char *type, struct blk_desc *dev_desc)
 	case IF_TYPE_EFI_MEDIA:
 		puts("EFI");
 		break;
+	case IF_TYPE_BLKMAP:
+		puts("BLKMAP");
+		break;
 	default:
 		puts("UNKNOWN");
 		break;
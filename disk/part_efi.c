@@ -60,6 +60,8 @@ static gpt_entry *alloc_read_gpt_entries(struct blk_desc *dev_desc,
 static int is_pte_valid(gpt_entry * pte);
 static int find_valid_gpt(struct blk_desc *dev_desc, gpt_header *gpt_head,
 			  gpt_entry **pgpt_pte);
+static int get_valid_gpt(struct blk_desc *dev_desc, gpt_header **pgpt_head,
+			 gpt_entry **pgpt_pte);
 
 static char *print_efiname(gpt_entry *pte)
 {
@@ -200,32 +202,30 @@ static void prepare_backup_gpt_header(gpt_header *gpt_h)
  */
 int get_disk_guid(struct blk_desc * dev_desc, char *guid)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
 	unsigned char *guid_bin;
 
 	/* This function validates AND fills in the GPT header and PTE */
-	if (find_valid_gpt(dev_desc, gpt_head, &gpt_pte) != 1)
+	if (get_valid_gpt(dev_desc, &gpt_head, &gpt_pte) != 1)
 		return -EINVAL;
 
 	guid_bin = gpt_head->disk_guid.b;
 	uuid_bin_to_str(guid_bin, guid, UUID_STR_FORMAT_GUID);
 
-	/* Remember to free pte */
-	free(gpt_pte);
 	return 0;
 }
 
 void part_print_efi(struct blk_desc *dev_desc)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
 	int i = 0;
 	char uuid[UUID_STR_LEN + 1];
 	unsigned char *uuid_bin;
 
 	/* This function validates AND fills in the GPT header and PTE */
-	if (find_valid_gpt(dev_desc, gpt_head, &gpt_pte) != 1)
+	if (get_valid_gpt(dev_desc, &gpt_head, &gpt_pte) != 1)
 		return;
 
 	debug("%s: gpt-entry at %p\n", __func__, gpt_pte);
@@ -257,17 +257,13 @@ void part_print_efi(struct blk_desc *dev_desc)
 		uuid_bin_to_str(uuid_bin, uuid, UUID_STR_FORMAT_GUID);
 		printf("\tguid:\t%s\n", uuid);
 	}
-
-	/* Remember to free pte */
-	free(gpt_pte);
-	return;
 }
 
 int part_get_info_efi(struct blk_desc *dev_desc, int part,
 		      struct disk_partition *info)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
 
 	/* "part" argument must be at least 1 */
 	if (part < 1) {
@@ -276,14 +272,13 @@ int part_get_info_efi(struct blk_desc *dev_desc, int part,
 	}
 
 	/* This function validates AND fills in the GPT header and PTE */
-	if (find_valid_gpt(dev_desc, gpt_head, &gpt_pte) != 1)
+	if (get_valid_gpt(dev_desc, &gpt_head, &gpt_pte) != 1)
 		return -1;
 
 	if (part > le32_to_cpu(gpt_head->num_partition_entries) ||
 	    !is_pte_valid(&gpt_pte[part - 1])) {
 		debug("%s: *** ERROR: Invalid partition number %d ***\n",
 			__func__, part);
-		free(gpt_pte);
 		return -1;
 	}
 
@@ -310,8 +305,6 @@ int part_get_info_efi(struct blk_desc *dev_desc, int part,
 	debug("%s: start 0x" LBAF ", size 0x" LBAF ", name %s\n", __func__,
 	      info->start, info->size, info->name);
 
-	/* Remember to free pte */
-	free(gpt_pte);
 	return 0;
 }
 
@@ -1028,6 +1021,79 @@ static int find_valid_gpt(struct blk_desc *dev_desc, gpt_header *gpt_head,
 	return 1;
 }
 
+/**
+ * struct gpt_cache - validated GPT of a device, kept until it may change
+ *
+ * @media_gen: Media generation of the device when the GPT was read
+ * @hwpart: Hardware partition selected when the GPT was read
+ * @gpt_head: GPT header
+ * @gpt_pte: Partition table entries
+ */
+struct gpt_cache {
+	uint media_gen;
+	int hwpart;
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
+};
+
+void part_drop_cache(struct blk_desc *dev_desc)
+{
+	struct gpt_cache *cache = dev_desc->gpt_cache;
+
+	if (!cache)
+		return;
+	free(cache->gpt_head);
+	free(cache->gpt_pte);
+	free(cache);
+	dev_desc->gpt_cache = NULL;
+}
+
+/**
+ * get_valid_gpt() - get the GPT header and PTEs of a device
+ *
+ * This is find_valid_gpt() with the result cached on @dev_desc, so that the
+ * GPT is only read and checked again once the device's media generation
+ * changes, e.g. when the partition table is written or the device rescanned,
+ * or another hardware partition is selected. It is read every time from
+ * devices marked uncached.
+ *
+ * @dev_desc: Block device
+ * @pgpt_head: Returns the GPT header, which must not be freed
+ * @pgpt_pte: Returns the PTEs, which must not be freed
+ * Return: 1 if a valid GPT was found, 0 on error
+ */
+static int get_valid_gpt(struct blk_desc *dev_desc, gpt_header **pgpt_head,
+			 gpt_entry **pgpt_pte)
+{
+	struct gpt_cache *cache = dev_desc->gpt_cache;
+
+	if (!cache || dev_desc->uncached ||
+	    cache->media_gen != dev_desc->media_gen ||
+	    cache->hwpart != dev_desc->hwpart) {
+		part_drop_cache(dev_desc);
+		cache = calloc(1, sizeof(*cache));
+		if (!cache)
+			return 0;
+		cache->media_gen = dev_desc->media_gen;
+		cache->hwpart = dev_desc->hwpart;
+		cache->gpt_head = memalign(ARCH_DMA_MINALIGN,
+					   PAD_TO_BLOCKSIZE(sizeof(gpt_header),
+							    dev_desc));
+		if (!cache->gpt_head ||
+		    find_valid_gpt(dev_desc, cache->gpt_head,
+				   &cache->gpt_pte) != 1) {
+			free(cache->gpt_head);
+			free(cache);
+			return 0;
+		}
+		dev_desc->gpt_cache = cache;
+	}
+	*pgpt_head = cache->gpt_head;
+	*pgpt_pte = cache->gpt_pte;
+
+	return 1;
+}
+
 /**
  * alloc_read_gpt_entries(): reads partition entries from disk
  * @dev_desc
@@ -11,11 +11,30 @@
 #include <dm.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
+#include <time.h>
+#include <uthread.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/uclass-internal.h>
 #include <linux/err.h>
+#include <linux/log2.h>
+
+/**
+ * struct blk_priv - uclass-private data for a block device
+ *
+ * @ra_next: Block just after the last read, used to spot sequential reads
+ * @ra_window: Number of blocks read ahead last time, 0 if none
+ * @stats: I/O statistics (only with CONFIG_BLK_STATS)
+ */
+struct blk_priv {
+	lbaint_t ra_next;
+	lbaint_t ra_window;
+#if CONFIG_IS_ENABLED(BLK_STATS)
+	struct blk_stats stats;
+#endif
+};
 
 static const char *if_typename_str[IF_TYPE_COUNT] = {
 	[IF_TYPE_IDE]		= "ide",
@@ -32,6 +51,7 @@ static const char *if_typename_str[IF_TYPE_COUNT] = {
 	[IF_TYPE_EFI_LOADER]	= "efiloader",
 	[IF_TYPE_VIRTIO]	= "virtio",
 	[IF_TYPE_PVBLOCK]	= "pvblock",
+	[IF_TYPE_BLKMAP]	= "blkmap",
 };
 
 static enum uclass_id if_type_uclass_id[IF_TYPE_COUNT] = {
@@ -49,6 +69,7 @@ static enum uclass_id if_type_uclass_id[IF_TYPE_COUNT] = {
 	[IF_TYPE_EFI_LOADER]	= UCLASS_EFI_LOADER,
 	[IF_TYPE_VIRTIO]	= UCLASS_VIRTIO,
 	[IF_TYPE_PVBLOCK]	= UCLASS_PVBLOCK,
+	[IF_TYPE_BLKMAP]	= UCLASS_BLKMAP,
 };
 
 static enum if_type if_typename_to_iftype(const char *if_typename)
@@ -436,38 +457,217 @@ int blk_get_device(int if_type, int devnum, struct udevice **devp)
 	return device_probe(*devp);
 }
 
+#if CONFIG_IS_ENABLED(BLK_STATS)
+static uint blk_stats_bucket(u64 val)
+{
+	return val ? min(ilog2(val), BLK_STATS_HIST_SIZE - 1) : 0;
+}
+
+static ulong blk_stats_start(void)
+{
+	return timer_get_us();
+}
+
+/*
+ * Record a request passed to the driver, which was started at @start_us.
+ * @result is the driver's return value: the number of blocks transferred, or
+ * a -ve error number, in which case no blocks are counted
+ */
+static void blk_stats_add(struct udevice *dev, enum blk_stats_op op,
+			  long result, ulong start_us)
+{
+	struct blk_priv *priv = dev_get_uclass_priv(dev);
+	struct blk_op_stats *st = &priv->stats.op[op];
+	ulong us = timer_get_us() - start_us;
+	lbaint_t blkcnt = result > 0 ? result : 0;
+
+	st->count++;
+	st->blocks += blkcnt;
+	st->time_us += us;
+	st->size_hist[blk_stats_bucket(blkcnt)]++;
+	st->time_hist[blk_stats_bucket(us)]++;
+}
+
+struct blk_stats *blk_get_stats(struct udevice *dev)
+{
+	struct blk_priv *priv = dev_get_uclass_priv(dev);
+
+	return &priv->stats;
+}
+
+void blk_reset_stats(struct udevice *dev)
+{
+	struct blk_priv *priv = dev_get_uclass_priv(dev);
+
+	memset(&priv->stats, '\0', sizeof(priv->stats));
+}
+#else
+static inline ulong blk_stats_start(void)
+{
+	return 0;
+}
+
+static inline void blk_stats_add(struct udevice *dev, enum blk_stats_op op,
+				 long result, ulong start_us) {}
+#endif
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/**
+ * blk_readahead() - Read blocks, and the blocks after them if reading in order
+ *
+ * When a read starts where the previous one ended, this reads the blocks
+ * after it as well and puts them in the block cache. The amount read ahead
+ * doubles with each sequential read, up to CONFIG_BLK_READAHEAD_SIZE and a
+ * quarter of the unused heap.
+ *
+ * @dev: Block device to read from
+ * @start: Start block number to read
+ * @blkcnt: Number of blocks to read
+ * @buffer: Destination buffer for data read
+ * @return number of blocks read, or 0 if nothing was read, in which case the
+ *	caller should read the blocks itself
+ */
+static ulong blk_readahead(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, void *buffer)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_priv *priv = dev_get_uclass_priv(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	lbaint_t max = (CONFIG_BLK_READAHEAD_SIZE << 10) / desc->blksz;
+	lbaint_t window, total, i;
+	ulong blks_read, start_us;
+	bool sequential;
+	char *buf;
+
+	sequential = priv->ra_next && start == priv->ra_next;
+	priv->ra_next = start + blkcnt;
+	if (!sequential || blkcnt >= max) {
+		priv->ra_window = 0;
+		return 0;
+	}
+
+	window = priv->ra_window ? priv->ra_window * 2 : blkcnt;
+	window = min(window, max);
+	if (start + blkcnt + window > desc->lba)
+		window = desc->lba > start + blkcnt ?
+			desc->lba - start - blkcnt : 0;
+	window = min(window, (lbaint_t)((mem_malloc_end - mem_malloc_brk) / 4 /
+					desc->blksz));
+	if (!window)
+		return 0;
+
+	total = blkcnt + window;
+	buf = malloc_cache_aligned(total * desc->blksz);
+	if (!buf)
+		return 0;
+	start_us = blk_stats_start();
+	blks_read = ops->read(dev, start, total, buf);
+	blk_stats_add(dev, BLK_STATS_READ, blks_read, start_us);
+	if (blks_read != total) {
+		free(buf);
+		priv->ra_window = 0;
+		return 0;
+	}
+	log_debug("%s: read " LBAF " + " LBAFU " blocks ahead\n", dev->name,
+		  start, window);
+
+	memcpy(buffer, buf, blkcnt * desc->blksz);
+	blkcache_fill(desc->if_type, desc->devnum, start, blkcnt, desc->blksz,
+		      buf);
+	for (i = blkcnt; i < total; i++)
+		blkcache_fill(desc->if_type, desc->devnum, start + i, 1,
+			      desc->blksz, buf + i * desc->blksz);
+	free(buf);
+	priv->ra_window = window;
+
+	return blkcnt;
+}
+#else
+static ulong blk_readahead(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, void *buffer)
+{
+	return 0;
+}
+#endif
+
 unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			lbaint_t blkcnt, void *buffer)
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
-	ulong blks_read;
+	ulong blks_read, start_us;
+	int cached = 0;
 
 	if (!ops->read)
 		return -ENOSYS;
 
-	if (blkcache_read(block_dev->if_type, block_dev->devnum,
-			  start, blkcnt, block_dev->blksz, buffer))
+	if (!block_dev->uncached)
+		cached = blkcache_read(block_dev->if_type, block_dev->devnum,
+				       start, blkcnt, block_dev->blksz, buffer);
+	if (cached < 0)
+		return cached;
+	if (cached) {
+		if (CONFIG_IS_ENABLED(BLK_READAHEAD)) {
+			struct blk_priv *priv = dev_get_uclass_priv(dev);
+
+			priv->ra_next = start + blkcnt;
+		}
 		return blkcnt;
+	}
+	if (CONFIG_IS_ENABLED(BLK_READAHEAD) && !block_dev->uncached) {
+		blks_read = blk_readahead(dev, start, blkcnt, buffer);
+		if (blks_read)
+			return blks_read;
+	}
+	start_us = blk_stats_start();
 	blks_read = ops->read(dev, start, blkcnt, buffer);
-	if (blks_read == blkcnt)
+	blk_stats_add(dev, BLK_STATS_READ, blks_read, start_us);
+	if (blks_read == blkcnt && !block_dev->uncached)
 		blkcache_fill(block_dev->if_type, block_dev->devnum,
 			      start, blkcnt, block_dev->blksz, buffer);
 
 	return blks_read;
 }
 
+/* Blocks at each end of a device which may hold a partition table (GPT) */
+#define BLK_PART_TABLE_BLKS	34
+
+/*
+ * Note a write to the device. Writing to either end of the device may also
+ * change its partition table, so start a new media generation to have the
+ * table read again
+ */
+static void blk_note_write(struct blk_desc *desc, lbaint_t start,
+			   lbaint_t blkcnt)
+{
+	desc->write_gen++;
+	if (start < BLK_PART_TABLE_BLKS ||
+	    start + blkcnt + BLK_PART_TABLE_BLKS > desc->lba)
+		part_new_media_gen(desc);
+}
+
 unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt, const void *buffer)
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
+	ulong blks_written, start_us;
 
 	if (!ops->write)
 		return -ENOSYS;
 
-	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
-	return ops->write(dev, start, blkcnt, buffer);
+	blk_note_write(block_dev, start, blkcnt);
+	if (!block_dev->uncached &&
+	    blkcache_write(block_dev, start, blkcnt, buffer))
+		return blkcnt;
+	start_us = blk_stats_start();
+	blks_written = ops->write(dev, start, blkcnt, buffer);
+	blk_stats_add(dev, BLK_STATS_WRITE, blks_written, start_us);
+	if (blks_written == blkcnt && !block_dev->uncached)
+		blkcache_fill(block_dev->if_type, block_dev->devnum,
+			      start, blkcnt, block_dev->blksz, buffer);
+
+	return blks_written;
 }
 
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
@@ -475,12 +675,121 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
+	ulong blks_erased, start_us;
 
 	if (!ops->erase)
 		return -ENOSYS;
 
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
-	return ops->erase(dev, start, blkcnt);
+	blk_note_write(block_dev, start, blkcnt);
+	start_us = blk_stats_start();
+	blks_erased = ops->erase(dev, start, blkcnt);
+	blk_stats_add(dev, BLK_STATS_ERASE, blks_erased, start_us);
+
+	return blks_erased;
+}
+
+ulong blk_write_back(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		     const void *buffer)
+{
+	struct udevice *dev = desc->bdev;
+	ulong blks_written, start_us;
+
+	start_us = blk_stats_start();
+	blks_written = blk_get_ops(dev)->write(dev, start, blkcnt, buffer);
+	blk_stats_add(dev, BLK_STATS_WRITE, blks_written, start_us);
+
+	return blks_written;
+}
+
+/* Carry out a request synchronously, for drivers without submit() */
+static void blk_do_req(struct blk_desc *desc, struct blk_req *req)
+{
+	if (req->write)
+		req->result = blk_dwrite(desc, req->start, req->blkcnt,
+					 req->buffer);
+	else
+		req->result = blk_dread(desc, req->start, req->blkcnt,
+					req->buffer);
+	req->done = true;
+}
+
+int blk_submit(struct blk_desc *desc, struct blk_req *req)
+{
+	struct udevice *dev = desc->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret = 0;
+
+	req->done = false;
+	req->result = 0;
+	if (!ops->submit || !ops->poll) {
+		blk_do_req(desc, req);
+		return 0;
+	}
+
+	if (req->write) {
+		blk_note_write(desc, req->start, req->blkcnt);
+		if (!desc->uncached &&
+		    blkcache_write(desc, req->start, req->blkcnt,
+				   req->buffer)) {
+			req->result = req->blkcnt;
+			req->done = true;
+			return 0;
+		}
+	} else {
+		if (!desc->uncached)
+			ret = blkcache_read(desc->if_type, desc->devnum,
+					    req->start, req->blkcnt,
+					    desc->blksz, req->buffer);
+		if (ret < 0)
+			return log_ret(ret);
+		if (ret) {
+			req->result = req->blkcnt;
+			req->done = true;
+			return 0;
+		}
+	}
+
+	req->submit_us = blk_stats_start();
+	ret = ops->submit(dev, req);
+	if (ret)
+		return log_ret(ret);
+
+	return 0;
+}
+
+int blk_poll(struct blk_desc *desc, struct blk_req *req)
+{
+	struct udevice *dev = desc->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
+
+	if (req->done)
+		return 0;
+
+	ret = ops->poll(dev, req);
+	if (ret)
+		return ret;
+	req->done = true;
+	blk_stats_add(dev, req->write ? BLK_STATS_WRITE : BLK_STATS_READ,
+		      req->result, req->submit_us);
+	if (req->result == req->blkcnt && !desc->uncached)
+		blkcache_fill(desc->if_type, desc->devnum, req->start,
+			      req->blkcnt, desc->blksz, req->buffer);
+
+	return 0;
+}
+
+long blk_wait(struct blk_desc *desc, struct blk_req *req)
+{
+	int ret;
+
+	while ((ret = blk_poll(desc, req)) == -EINPROGRESS)
+		uthread_schedule();
+	if (ret)
+		return ret;
+
+	return req->result;
 }
 
 int blk_get_from_parent(struct udevice *parent, struct udevice **devp)
@@ -722,9 +1031,23 @@ static int blk_post_probe(struct udevice *dev)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+
+	/* Write back anything still cached and forget about this device */
+	blkcache_invalidate(desc->if_type, desc->devnum);
+	if (IS_ENABLED(CONFIG_HAVE_BLOCK_DEVICE))
+		part_drop_cache(desc);
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
+	.per_device_auto	= sizeof(struct blk_priv),
 	.per_device_plat_auto	= sizeof(struct blk_desc),
 };
@@ -6,65 +6,304 @@
  */
 #include <common.h>
 #include <blk.h>
+#include <dm.h>
+#include <env.h>
 #include <log.h>
 #include <malloc.h>
 #include <part.h>
+#include <sort.h>
 #include <asm/global_data.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 DECLARE_GLOBAL_DATA_PTR;
 #endif
 
+/*
+ * The cache holds individual blocks, each found through a hash table keyed by
+ * device and block number. All blocks are on an LRU list, most recently used
+ * first. While write-back is enabled by blkcache_set_writeback(), blocks
+ * written through blkcache_write() are also on a dirty list until they are
+ * written to the device.
+ */
 struct block_cache_node {
-	struct list_head lh;
+	struct hlist_node hash;
+	struct list_head lru;
+	struct list_head dirty;
+	struct blk_desc *desc;	/* device to write to, if dirty */
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
+	lbaint_t blknr;
 	unsigned long blksz;
-	char *cache;
+	char data[];
+};
+
+enum {
+	BLKCACHE_MIN_BUCKETS	= 64,
+	BLKCACHE_MAX_BUCKETS	= 1 << 16,
+	BLKCACHE_DEF_BLOCKS	= 64,
 };
 
 static LIST_HEAD(block_cache);
+static LIST_HEAD(block_cache_dirty);
+static struct hlist_head *cache_hash;
+static uint cache_hash_mask;
+static bool cache_writeback;
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_blocks_per_entry = BLKCACHE_DEF_BLOCKS,
+	.max_size = (ulong)CONFIG_BLOCK_CACHE_SIZE << 20,
 };
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
-int blkcache_init(void)
+static void reloc_list_head(struct list_head *head)
 {
-	struct list_head *head = &block_cache;
-
 	head->next = (uintptr_t)head->next + gd->reloc_off;
 	head->prev = (uintptr_t)head->prev + gd->reloc_off;
+}
+
+int blkcache_init(void)
+{
+	reloc_list_head(&block_cache);
+	reloc_list_head(&block_cache_dirty);
 
 	return 0;
 }
 #endif
 
+static uint cache_hash_key(int iftype, int devnum, lbaint_t blknr)
+{
+	u64 key = ((u64)blknr << 8) ^ ((u64)devnum << 4) ^ iftype;
+
+	/* Fibonacci hashing spreads runs of block numbers over the table */
+	return (uint)((key * 0x9e3779b97f4a7c15ULL) >> 32) & cache_hash_mask;
+}
+
+static unsigned long node_size(unsigned long blksz)
+{
+	return sizeof(struct block_cache_node) + blksz;
+}
+
+/* Allocate the hash table, sized for the number of blocks that can fit */
+static int cache_hash_alloc(void)
+{
+	ulong buckets = _stats.max_size / node_size(512);
+
+	buckets = clamp_t(ulong, buckets, BLKCACHE_MIN_BUCKETS,
+			  BLKCACHE_MAX_BUCKETS);
+	buckets = __roundup_pow_of_two(buckets);
+	cache_hash = calloc(buckets, sizeof(*cache_hash));
+	if (!cache_hash)
+		return -ENOMEM;
+	cache_hash_mask = buckets - 1;
+
+	return 0;
+}
+
 static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+					   lbaint_t blknr, unsigned long blksz)
 {
 	struct block_cache_node *node;
+	struct hlist_node *pos;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
+	if (!cache_hash)
+		return NULL;
+	hlist_for_each_entry(node, pos,
+			     &cache_hash[cache_hash_key(iftype, devnum, blknr)],
+			     hash)
+		if ((node->blknr == blknr) &&
 		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+		    (node->iftype == iftype) &&
+		    (node->blksz == blksz))
 			return node;
+
+	return NULL;
+}
+
+static void cache_touch(struct block_cache_node *node)
+{
+	/* maintain MRU ordering */
+	if (block_cache.next != &node->lru) {
+		list_del(&node->lru);
+		list_add(&node->lru, &block_cache);
+	}
+}
+
+static void cache_drop(struct block_cache_node *node)
+{
+	hlist_del(&node->hash);
+	list_del(&node->lru);
+	if (node->desc) {
+		list_del(&node->dirty);
+		_stats.dirty--;
+	}
+	_stats.entries--;
+	_stats.size -= node_size(node->blksz);
+	free(node);
+}
+
+static int cmp_dirty(const void *v1, const void *v2)
+{
+	const struct block_cache_node *n1 = *(struct block_cache_node **)v1;
+	const struct block_cache_node *n2 = *(struct block_cache_node **)v2;
+
+	if (n1->blknr == n2->blknr)
+		return 0;
+
+	return n1->blknr < n2->blknr ? -1 : 1;
+}
+
+/*
+ * Write out a run of dirty blocks which are contiguous on the device, using
+ * @buf to gather the data. If @buf is NULL, @count must be 1.
+ */
+static int cache_write_run(struct block_cache_node **run, int count,
+			   char *buf)
+{
+	struct blk_desc *desc = run[0]->desc;
+	ulong blksz = run[0]->blksz;
+	int i;
+
+	if (buf) {
+		for (i = 0; i < count; i++)
+			memcpy(buf + i * blksz, run[i]->data, blksz);
+	} else {
+		buf = run[0]->data;
+	}
+	debug("write back: start " LBAF ", count %d\n", run[0]->blknr, count);
+	if (blk_write_back(desc, run[0]->blknr, count, buf) != count)
+		return -EIO;
+	_stats.writebacks += count;
+
+	for (i = 0; i < count; i++) {
+		list_del(&run[i]->dirty);
+		run[i]->desc = NULL;
+		_stats.dirty--;
+	}
+
+	return 0;
+}
+
+/*
+ * Write back the dirty blocks of a device, coalescing blocks which are next to
+ * each other into a single write
+ */
+static int cache_flush(int iftype, int devnum)
+{
+	struct block_cache_node **nodes, *node, *n;
+	uint max_run = max(_stats.max_blocks_per_entry, 1U);
+	int count = 0, start, i, ret = 0;
+	ulong blksz = 0;
+	char *buf = NULL;
+
+	if (!CONFIG_IS_ENABLED(BLOCK_CACHE_WRITEBACK) || !_stats.dirty)
+		return 0;
+
+	nodes = malloc(_stats.dirty * sizeof(*nodes));
+	if (nodes) {
+		list_for_each_entry(node, &block_cache_dirty, dirty) {
+			if (node->iftype != iftype || node->devnum != devnum)
+				continue;
+			nodes[count++] = node;
+			blksz = max(blksz, node->blksz);
 		}
+		buf = malloc(max_run * blksz);
+	}
+	if (!buf) {
+		/* Fall back to writing one block at a time */
+		list_for_each_entry_safe(node, n, &block_cache_dirty, dirty) {
+			if (node->iftype != iftype || node->devnum != devnum)
+				continue;
+			ret = cache_write_run(&node, 1, NULL);
+			if (ret)
+				break;
+		}
+		goto out;
+	}
+
+	qsort(nodes, count, sizeof(*nodes), cmp_dirty);
+	for (start = 0, i = 1; i <= count; i++) {
+		if (i < count && i - start < max_run &&
+		    nodes[i]->blknr == nodes[i - 1]->blknr + 1 &&
+		    nodes[i]->blksz == nodes[start]->blksz)
+			continue;
+		ret = cache_write_run(&nodes[start], i - start, buf);
+		if (ret)
+			break;
+		start = i;
+	}
+out:
+	free(buf);
+	free(nodes);
+	if (ret)
+		log_err("Failed to write back cached blocks (err=%d)\n", ret);
+
+	return ret;
+}
+
+/* Evict least-recently used blocks until @bytes more will fit in the cache */
+static int cache_make_room(unsigned long bytes)
+{
+	struct block_cache_node *node;
+
+	while (_stats.size + bytes > _stats.max_size) {
+		if (list_empty(&block_cache))
+			return -ENOSPC;
+		node = list_last_entry(&block_cache, struct block_cache_node,
+				       lru);
+		if (node->desc && cache_flush(node->iftype, node->devnum))
+			return -EIO;
+		debug("drop: start " LBAF "\n", node->blknr);
+		cache_drop(node);
+		_stats.evictions++;
+	}
+
+	return 0;
+}
+
+static struct block_cache_node *cache_add(int iftype, int devnum,
+					  lbaint_t blknr, unsigned long blksz,
+					  const void *data)
+{
+	struct block_cache_node *node;
+
+	if (!cache_hash && cache_hash_alloc())
+		return NULL;
+	if (cache_make_room(node_size(blksz)))
+		return NULL;
+	node = malloc(node_size(blksz));
+	if (!node)
+		return NULL;
+
+	node->desc = NULL;
+	node->iftype = iftype;
+	node->devnum = devnum;
+	node->blknr = blknr;
+	node->blksz = blksz;
+	memcpy(node->data, data, blksz);
+	hlist_add_head(&node->hash,
+		       &cache_hash[cache_hash_key(iftype, devnum, blknr)]);
+	list_add(&node->lru, &block_cache);
+	_stats.entries++;
+	_stats.size += node_size(blksz);
+
+	return node;
+}
+
+/* Write back any dirty blocks in the given range */
+static int cache_flush_range(int iftype, int devnum, lbaint_t start,
+			     lbaint_t blkcnt)
+{
+	struct block_cache_node *node;
+
+	list_for_each_entry(node, &block_cache_dirty, dirty) {
+		if (node->iftype == iftype && node->devnum == devnum &&
+		    node->blknr >= start && node->blknr < start + blkcnt)
+			return cache_flush(iftype, devnum);
+	}
+
 	return 0;
 }
 
@@ -72,11 +311,19 @@ int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
+	struct block_cache_node *node;
+	lbaint_t i;
+
+	for (i = 0; i < blkcnt; i++) {
+		if (!cache_find(iftype, devnum, start + i, blksz))
+			break;
+	}
+	if (blkcnt && i == blkcnt) {
+		for (i = 0; i < blkcnt; i++) {
+			node = cache_find(iftype, devnum, start + i, blksz);
+			memcpy(buffer + i * blksz, node->data, blksz);
+			cache_touch(node);
+		}
 		debug("hit: start " LBAF ", count " LBAFU "\n",
 		      start, blkcnt);
 		++_stats.hits;
@@ -86,6 +333,11 @@ int blkcache_read(int iftype, int devnum,
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 	++_stats.misses;
+
+	/* The device must be up to date before the caller reads from it */
+	if (_stats.dirty && cache_flush_range(iftype, devnum, start, blkcnt))
+		return -EIO;
+
 	return 0;
 }
 
@@ -93,93 +345,154 @@ void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
+	lbaint_t i;
 
 	/* don't cache big stuff */
 	if (blkcnt > _stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
+	if (!_stats.max_size)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
+	debug("fill: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+
+	for (i = 0; i < blkcnt; i++) {
+		/* A cached block is never older than the data just read */
+		if (cache_find(iftype, devnum, start + i, blksz))
+			continue;
+		if (!cache_add(iftype, devnum, start + i, blksz,
+			       buffer + i * blksz))
+			break;
 	}
+}
+
+int blkcache_write(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		   const void *buffer)
+{
+	struct block_cache_node *node;
+	unsigned long blksz = desc->blksz;
+	lbaint_t i;
+
+	if (CONFIG_IS_ENABLED(BLOCK_CACHE_WRITEBACK) && cache_writeback &&
+	    _stats.max_size && blkcnt <= _stats.max_blocks_per_entry) {
+		for (i = 0; i < blkcnt; i++) {
+			const void *data = buffer + i * blksz;
 
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
+			node = cache_find(desc->if_type, desc->devnum,
+					  start + i, blksz);
+			if (node) {
+				memcpy(node->data, data, blksz);
+				cache_touch(node);
+			} else {
+				node = cache_add(desc->if_type, desc->devnum,
+						 start + i, blksz, data);
+				if (!node)
+					break;
+			}
+			if (!node->desc) {
+				node->desc = desc;
+				list_add_tail(&node->dirty, &block_cache_dirty);
+				_stats.dirty++;
+			}
 		}
+		if (i == blkcnt)
+			return 1;
+		/* The rest is written to the device, so drop it */
+		start += i;
+		blkcnt -= i;
+		buffer += i * blksz;
 	}
 
-	debug("fill: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
+	/* The caller writes to the device, so any copies here are stale */
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(desc->if_type, desc->devnum, start + i,
+				  blksz);
+		if (node)
+			cache_drop(node);
+	}
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	return 0;
+}
+
+int blkcache_flush(int iftype, int devnum)
+{
+	return cache_flush(iftype, devnum);
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_node *node, *n;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
+	cache_flush(iftype, devnum);
+	list_for_each_entry_safe(node, n, &block_cache, lru) {
 		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
+		    (node->devnum == devnum))
+			cache_drop(node);
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+/* Write back the dirty blocks of all devices */
+static int cache_flush_all(void)
 {
 	struct block_cache_node *node;
+	int ret;
+
+	while (!list_empty(&block_cache_dirty)) {
+		node = list_first_entry(&block_cache_dirty,
+					struct block_cache_node, dirty);
+		ret = cache_flush(node->iftype, node->devnum);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int blkcache_set_writeback(bool enable)
+{
+	int ret = 0;
+
+	/* Nothing is left waiting once the caller is done */
+	if (!enable)
+		ret = cache_flush_all();
+	cache_writeback = enable;
+
+	return ret;
+}
+
+/* Drop everything, writing back dirty blocks first */
+static void cache_drop_all(void)
+{
+	struct block_cache_node *node;
+
+	cache_flush_all();
+	while (!list_empty(&block_cache)) {
+		node = list_first_entry(&block_cache, struct block_cache_node,
+					lru);
+		cache_drop(node);
+	}
+	free(cache_hash);
+	cache_hash = NULL;
+}
+
+void blkcache_configure(unsigned blocks, unsigned size_mb)
+{
+	unsigned long max_size = (unsigned long)size_mb << 20;
+
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries)) {
+	    (max_size != _stats.max_size)) {
 		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
-		}
-		_stats.entries = 0;
+		cache_drop_all();
 	}
 
 	_stats.max_blocks_per_entry = blocks;
-	_stats.max_entries = entries;
+	_stats.max_size = max_size;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.writebacks = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -187,4 +500,19 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+	_stats.writebacks = 0;
+}
+
+static int on_blkcachesize(const char *name, const char *value,
+			   enum env_op op, int flags)
+{
+	ulong size_mb = CONFIG_BLOCK_CACHE_SIZE;
+
+	if (op != env_op_delete && value)
+		size_mb = simple_strtoul(value, NULL, 10);
+	blkcache_configure(_stats.max_blocks_per_entry, size_mb);
+
+	return 0;
 }
+U_BOOT_ENV_CALLBACK(blkcachesize, on_blkcachesize);
@@ -0,0 +1,456 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Block devices made up of slices of memory or of other block devices
+ *
+ * Each blkmap is a UCLASS_BLKMAP device with a child UCLASS_BLK. Ranges of
+ * its blocks are mapped, a slice at a time, onto a region of memory or onto
+ * blocks of another block device. This allows a filesystem image which is
+ * in memory, e.g. one fetched over the network, to be used with the normal
+ * filesystem commands without writing it to storage first.
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <blkmap.h>
+#include <dm.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <part.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <linux/list.h>
+
+struct blkmap;
+
+/**
+ * struct blkmap_slice - Region mapped to a blkmap
+ *
+ * @node: Entry in the blkmap's list of slices, which is kept in block order
+ * @blknr: First block of the blkmap covered by the slice
+ * @blkcnt: Number of blocks covered by the slice
+ * @read: Read @blkcnt blocks starting @blknr blocks into the slice
+ * @write: Write @blkcnt blocks starting @blknr blocks into the slice
+ * @destroy: Release anything held by the slice, or NULL if nothing is
+ */
+struct blkmap_slice {
+	struct list_head node;
+	lbaint_t blknr;
+	lbaint_t blkcnt;
+
+	ulong (*read)(struct blkmap *bm, struct blkmap_slice *bms,
+		      lbaint_t blknr, lbaint_t blkcnt, void *buffer);
+	ulong (*write)(struct blkmap *bm, struct blkmap_slice *bms,
+		       lbaint_t blknr, lbaint_t blkcnt, const void *buffer);
+	void (*destroy)(struct blkmap *bm, struct blkmap_slice *bms);
+};
+
+/**
+ * struct blkmap - Block map, the private data of a blkmap device
+ *
+ * @blk: Child block device
+ * @slices: Slices mapped so far, in block order
+ */
+struct blkmap {
+	struct udevice *blk;
+	struct list_head slices;
+};
+
+static bool blkmap_slice_contains(struct blkmap_slice *bms, lbaint_t blknr)
+{
+	return blknr >= bms->blknr && blknr < bms->blknr + bms->blkcnt;
+}
+
+static bool blkmap_slice_available(struct blkmap *bm, struct blkmap_slice *new)
+{
+	struct blkmap_slice *bms;
+	lbaint_t first, last;
+
+	first = new->blknr;
+	last = new->blknr + new->blkcnt - 1;
+
+	list_for_each_entry(bms, &bm->slices, node) {
+		if (blkmap_slice_contains(bms, first) ||
+		    blkmap_slice_contains(bms, last) ||
+		    blkmap_slice_contains(new, bms->blknr))
+			return false;
+	}
+
+	return true;
+}
+
+static int blkmap_slice_add(struct blkmap *bm, struct blkmap_slice *new)
+{
+	struct blk_desc *bd = dev_get_uclass_plat(bm->blk);
+	struct list_head *insert = &bm->slices;
+	struct blkmap_slice *bms;
+
+	if (!blkmap_slice_available(bm, new))
+		return -EBUSY;
+
+	list_for_each_entry(bms, &bm->slices, node) {
+		if (bms->blknr < new->blknr)
+			continue;
+		insert = &bms->node;
+		break;
+	}
+	list_add_tail(&new->node, insert);
+
+	/*
+	 * The device may have grown, and what it holds has changed, so look
+	 * for a partition table again
+	 */
+	bms = list_last_entry(&bm->slices, struct blkmap_slice, node);
+	bd->lba = bms->blknr + bms->blkcnt;
+	part_init(bd);
+
+	return 0;
+}
+
+/**
+ * struct blkmap_linear - Slice mapped onto blocks of another device
+ *
+ * @slice: Common slice data
+ * @blk: Block device mapped onto
+ * @blknr: First block mapped onto
+ */
+struct blkmap_linear {
+	struct blkmap_slice slice;
+	struct udevice *blk;
+	lbaint_t blknr;
+};
+
+static ulong blkmap_linear_read(struct blkmap *bm, struct blkmap_slice *bms,
+				lbaint_t blknr, lbaint_t blkcnt, void *buffer)
+{
+	struct blkmap_linear *bml = container_of(bms, struct blkmap_linear,
+						 slice);
+
+	return blk_dread(dev_get_uclass_plat(bml->blk), bml->blknr + blknr,
+			 blkcnt, buffer);
+}
+
+static ulong blkmap_linear_write(struct blkmap *bm, struct blkmap_slice *bms,
+				 lbaint_t blknr, lbaint_t blkcnt,
+				 const void *buffer)
+{
+	struct blkmap_linear *bml = container_of(bms, struct blkmap_linear,
+						 slice);
+
+	return blk_dwrite(dev_get_uclass_plat(bml->blk), bml->blknr + blknr,
+			  blkcnt, buffer);
+}
+
+int blkmap_map_linear(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
+		      struct udevice *lblk, lbaint_t lblknr)
+{
+	struct blkmap *bm = dev_get_plat(dev);
+	struct blk_desc *bd = dev_get_uclass_plat(bm->blk);
+	struct blk_desc *lbd = dev_get_uclass_plat(lblk);
+	struct blkmap_linear *bml;
+	int ret;
+
+	if (!blkcnt || lbd->blksz != bd->blksz)
+		return -EINVAL;
+
+	bml = malloc(sizeof(*bml));
+	if (!bml)
+		return -ENOMEM;
+
+	*bml = (struct blkmap_linear) {
+		.slice = {
+			.blknr = blknr,
+			.blkcnt = blkcnt,
+			.read = blkmap_linear_read,
+			.write = blkmap_linear_write,
+		},
+		.blk = lblk,
+		.blknr = lblknr,
+	};
+
+	ret = blkmap_slice_add(bm, &bml->slice);
+	if (ret)
+		free(bml);
+
+	return ret;
+}
+
+/**
+ * struct blkmap_mem - Slice mapped onto memory
+ *
+ * @slice: Common slice data
+ * @addr: Start of the memory
+ * @remapped: true if @addr came from map_sysmem() and must be unmapped
+ */
+struct blkmap_mem {
+	struct blkmap_slice slice;
+	void *addr;
+	bool remapped;
+};
+
+static ulong blkmap_mem_read(struct blkmap *bm, struct blkmap_slice *bms,
+			     lbaint_t blknr, lbaint_t blkcnt, void *buffer)
+{
+	struct blkmap_mem *bmm = container_of(bms, struct blkmap_mem, slice);
+	struct blk_desc *bd = dev_get_uclass_plat(bm->blk);
+
+	memcpy(buffer, bmm->addr + (blknr << bd->log2blksz),
+	       blkcnt << bd->log2blksz);
+
+	return blkcnt;
+}
+
+static ulong blkmap_mem_write(struct blkmap *bm, struct blkmap_slice *bms,
+			      lbaint_t blknr, lbaint_t blkcnt,
+			      const void *buffer)
+{
+	struct blkmap_mem *bmm = container_of(bms, struct blkmap_mem, slice);
+	struct blk_desc *bd = dev_get_uclass_plat(bm->blk);
+
+	memcpy(bmm->addr + (blknr << bd->log2blksz), buffer,
+	       blkcnt << bd->log2blksz);
+
+	return blkcnt;
+}
+
+static void blkmap_mem_destroy(struct blkmap *bm, struct blkmap_slice *bms)
+{
+	struct blkmap_mem *bmm = container_of(bms, struct blkmap_mem, slice);
+
+	if (bmm->remapped)
+		unmap_sysmem(bmm->addr);
+}
+
+static int __blkmap_map_mem(struct udevice *dev, lbaint_t blknr,
+			    lbaint_t blkcnt, void *addr, bool remapped)
+{
+	struct blkmap *bm = dev_get_plat(dev);
+	struct blkmap_mem *bmm;
+	int ret;
+
+	if (!blkcnt)
+		return -EINVAL;
+
+	bmm = malloc(sizeof(*bmm));
+	if (!bmm)
+		return -ENOMEM;
+
+	*bmm = (struct blkmap_mem) {
+		.slice = {
+			.blknr = blknr,
+			.blkcnt = blkcnt,
+			.read = blkmap_mem_read,
+			.write = blkmap_mem_write,
+			.destroy = blkmap_mem_destroy,
+		},
+		.addr = addr,
+		.remapped = remapped,
+	};
+
+	ret = blkmap_slice_add(bm, &bmm->slice);
+	if (ret)
+		free(bmm);
+
+	return ret;
+}
+
+int blkmap_map_mem(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
+		   void *addr)
+{
+	return __blkmap_map_mem(dev, blknr, blkcnt, addr, false);
+}
+
+int blkmap_map_pmem(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
+		    phys_addr_t paddr)
+{
+	struct blkmap *bm = dev_get_plat(dev);
+	struct blk_desc *bd = dev_get_uclass_plat(bm->blk);
+	void *addr;
+	int ret;
+
+	addr = map_sysmem(paddr, blkcnt << bd->log2blksz);
+	if (!addr)
+		return -ENOMEM;
+
+	ret = __blkmap_map_mem(dev, blknr, blkcnt, addr, true);
+	if (ret)
+		unmap_sysmem(addr);
+
+	return ret;
+}
+
+/*
+ * Read or write as many of the blocks as are mapped, slice by slice,
+ * stopping at the first block which is not mapped
+ */
+static ulong blkmap_blk_xfer(struct udevice *dev, lbaint_t blknr,
+			     lbaint_t blkcnt, void *buffer, bool write)
+{
+	struct blk_desc *bd = dev_get_uclass_plat(dev);
+	struct blkmap *bm = dev_get_plat(dev->parent);
+	struct blkmap_slice *bms;
+	lbaint_t nr, cnt, done;
+	ulong total = 0;
+
+	list_for_each_entry(bms, &bm->slices, node) {
+		if (!blkcnt)
+			break;
+		if (!blkmap_slice_contains(bms, blknr))
+			continue;
+
+		nr = blknr - bms->blknr;
+		cnt = min(blkcnt, bms->blkcnt - nr);
+		if (write)
+			done = bms->write(bm, bms, nr, cnt, buffer);
+		else
+			done = bms->read(bm, bms, nr, cnt, buffer);
+		total += done;
+		if (done != cnt)
+			break;
+
+		blknr += cnt;
+		blkcnt -= cnt;
+		buffer += cnt << bd->log2blksz;
+	}
+
+	return total;
+}
+
+static ulong blkmap_blk_read(struct udevice *dev, lbaint_t blknr,
+			     lbaint_t blkcnt, void *buffer)
+{
+	return blkmap_blk_xfer(dev, blknr, blkcnt, buffer, false);
+}
+
+static ulong blkmap_blk_write(struct udevice *dev, lbaint_t blknr,
+			      lbaint_t blkcnt, const void *buffer)
+{
+	return blkmap_blk_xfer(dev, blknr, blkcnt, (void *)buffer, true);
+}
+
+static const struct blk_ops blkmap_blk_ops = {
+	.read	= blkmap_blk_read,
+	.write	= blkmap_blk_write,
+};
+
+U_BOOT_DRIVER(blkmap_blk) = {
+	.name		= "blkmap_blk",
+	.id		= UCLASS_BLK,
+	.ops		= &blkmap_blk_ops,
+};
+
+static int blkmap_dev_bind(struct udevice *dev)
+{
+	struct blkmap *bm = dev_get_plat(dev);
+	struct blk_desc *bd;
+	int ret;
+
+	INIT_LIST_HEAD(&bm->slices);
+
+	ret = blk_create_devicef(dev, "blkmap_blk", "blk", IF_TYPE_BLKMAP, -1,
+				 512, 0, &bm->blk);
+	if (ret) {
+		log_debug("Cannot create block device (err=%d)\n", ret);
+		return ret;
+	}
+
+	bd = dev_get_uclass_plat(bm->blk);
+	/*
+	 * Mapped memory can be loaded over, and mapped devices written
+	 * directly, without the blkmap knowing. Both are quick to read
+	 * anyway, so keep nothing read from the blkmap in any cache.
+	 */
+	bd->uncached = true;
+	snprintf(bd->vendor, BLK_VEN_SIZE, "U-Boot");
+	snprintf(bd->product, BLK_PRD_SIZE, "blkmap");
+	snprintf(bd->revision, BLK_REV_SIZE, "1.0");
+
+	return 0;
+}
+
+static int blkmap_dev_unbind(struct udevice *dev)
+{
+	struct blkmap *bm = dev_get_plat(dev);
+	struct blkmap_slice *bms, *tmp;
+
+	list_for_each_entry_safe(bms, tmp, &bm->slices, node) {
+		list_del(&bms->node);
+		if (bms->destroy)
+			bms->destroy(bm, bms);
+		free(bms);
+	}
+
+	return 0;
+}
+
+U_BOOT_DRIVER(blkmap) = {
+	.name		= "blkmap",
+	.id		= UCLASS_BLKMAP,
+	.bind		= blkmap_dev_bind,
+	.unbind		= blkmap_dev_unbind,
+	.plat_auto	= sizeof(struct blkmap),
+};
+
+struct udevice *blkmap_from_label(const char *label)
+{
+	struct udevice *dev;
+	struct uclass *uc;
+
+	uclass_id_foreach_dev(UCLASS_BLKMAP, dev, uc) {
+		if (!strcmp(dev->name, label))
+			return dev;
+	}
+
+	return NULL;
+}
+
+int blkmap_create(const char *label, struct udevice **devp)
+{
+	struct blkmap *bm;
+	struct udevice *dev;
+	char *name;
+	int ret;
+
+	if (blkmap_from_label(label))
+		return -EBUSY;
+
+	name = strdup(label);
+	if (!name)
+		return -ENOMEM;
+
+	ret = device_bind_driver(dm_root(), "blkmap", name, &dev);
+	if (ret) {
+		free(name);
+		return ret;
+	}
+	device_set_name_alloced(dev);
+
+	bm = dev_get_plat(dev);
+	ret = device_probe(bm->blk);
+	if (ret) {
+		device_unbind(dev);
+		return ret;
+	}
+
+	if (devp)
+		*devp = dev;
+
+	return 0;
+}
+
+int blkmap_destroy(struct udevice *dev)
+{
+	int ret;
+
+	ret = device_remove(dev, DM_REMOVE_NORMAL);
+	if (ret)
+		return ret;
+
+	return device_unbind(dev);
+}
+
+UCLASS_DRIVER(blkmap) = {
+	.id		= UCLASS_BLKMAP,
+	.name		= "blkmap",
+};
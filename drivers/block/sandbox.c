@@ -31,6 +31,33 @@ static struct host_block_dev *find_host_device(int dev)
 #endif
 
 #ifdef CONFIG_BLK
+static unsigned long host_block_read(struct udevice *dev,
+				     unsigned long start, lbaint_t blkcnt,
+				     void *buffer);
+static unsigned long host_block_write(struct udevice *dev,
+				      unsigned long start, lbaint_t blkcnt,
+				      const void *buffer);
+
+/*
+ * Carry out the pending asynchronous request, if not done already. It stays
+ * pending until it is polled, but a later read or write must see its effect.
+ */
+static void host_block_finish(struct udevice *dev)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+	struct blk_req *req = host_dev->pending;
+
+	if (!req || host_dev->pending_done)
+		return;
+	host_dev->pending_done = true;
+	if (req->write)
+		req->result = host_block_write(dev, req->start, req->blkcnt,
+					       req->buffer);
+	else
+		req->result = host_block_read(dev, req->start, req->blkcnt,
+					      req->buffer);
+}
+
 static unsigned long host_block_read(struct udevice *dev,
 				     unsigned long start, lbaint_t blkcnt,
 				     void *buffer)
@@ -38,6 +65,7 @@ static unsigned long host_block_read(struct udevice *dev,
 	struct host_block_dev *host_dev = dev_get_plat(dev);
 	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
 
+	host_block_finish(dev);
 #else
 static unsigned long host_block_read(struct blk_desc *block_dev,
 				     unsigned long start, lbaint_t blkcnt,
@@ -68,6 +96,8 @@ static unsigned long host_block_write(struct udevice *dev,
 {
 	struct host_block_dev *host_dev = dev_get_plat(dev);
 	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+
+	host_block_finish(dev);
 #else
 static unsigned long host_block_write(struct blk_desc *block_dev,
 				      unsigned long start, lbaint_t blkcnt,
@@ -243,9 +273,39 @@ int sandbox_host_unbind(struct udevice *dev)
 	return 0;
 }
 
+/*
+ * Asynchronous requests are held until they are polled, so that callers see
+ * them in progress, as they would with real hardware
+ */
+static int host_block_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+
+	if (host_dev->pending)
+		return -EBUSY;
+	host_dev->pending = req;
+	host_dev->pending_done = false;
+
+	return 0;
+}
+
+static int host_block_poll(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+
+	if (host_dev->pending != req)
+		return -EINPROGRESS;
+	host_block_finish(dev);
+	host_dev->pending = NULL;
+
+	return 0;
+}
+
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
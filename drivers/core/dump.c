@@ -10,17 +10,9 @@
 #include <dm/util.h>
 #include <dm/uclass-internal.h>
 
-static void show_devices(struct udevice *dev, int depth, int last_flag)
+static void show_tree_prefix(int depth, int last_flag)
 {
 	int i, is_last;
-	struct udevice *child;
-	u32 flags = dev_get_flags(dev);
-
-	/* print the first 20 characters to not break the tree-format. */
-	printf(IS_ENABLED(CONFIG_SPL_BUILD) ? " %s  %d  [ %c ]   %s  " :
-	       " %-10.10s  %3d  [ %c ]   %-20.20s  ", dev->uclass->uc_drv->name,
-	       dev_get_uclass_index(dev, NULL),
-	       flags & DM_FLAG_ACTIVATED ? '+' : ' ', dev->driver->name);
 
 	for (i = depth; i >= 0; i--) {
 		is_last = (last_flag >> i) & 1;
@@ -36,6 +28,52 @@ static void show_devices(struct udevice *dev, int depth, int last_flag)
 				printf("|-- ");
 		}
 	}
+}
+
+static ofnode next_enabled_subnode(ofnode node)
+{
+	while (ofnode_valid(node) && !ofnode_is_enabled(node))
+		node = ofnode_next_subnode(node);
+
+	return node;
+}
+
+/**
+ * show_pending() - Show the subnodes of a device which are not bound yet
+ *
+ * @dev:	Device whose children are pending (DM_FLAG_BIND_PENDING)
+ * @depth:	Depth of the subnodes in the tree
+ * @last_flag:	Tree-format flags of @dev
+ */
+static void show_pending(struct udevice *dev, int depth, int last_flag)
+{
+	ofnode node, next;
+	int is_last;
+
+	node = next_enabled_subnode(ofnode_first_subnode(dev_ofnode(dev)));
+	for (; ofnode_valid(node); node = next) {
+		next = next_enabled_subnode(ofnode_next_subnode(node));
+		is_last = !ofnode_valid(next);
+		printf(" %-10.10s  %3s  [   ]   %-20.20s  ", "(pending)", "-",
+		       "");
+		show_tree_prefix(depth, (last_flag << 1) | is_last);
+		printf("%s\n", ofnode_get_name(node));
+	}
+}
+
+static void show_devices(struct udevice *dev, int depth, int last_flag)
+{
+	int is_last;
+	struct udevice *child;
+	u32 flags = dev_get_flags(dev);
+
+	/* print the first 20 characters to not break the tree-format. */
+	printf(IS_ENABLED(CONFIG_SPL_BUILD) ? " %s  %d  [ %c ]   %s  " :
+	       " %-10.10s  %3d  [ %c ]   %-20.20s  ", dev->uclass->uc_drv->name,
+	       dev_get_uclass_index(dev, NULL),
+	       flags & DM_FLAG_ACTIVATED ? '+' : ' ', dev->driver->name);
+
+	show_tree_prefix(depth, last_flag);
 
 	printf("%s\n", dev->name);
 
@@ -43,6 +81,10 @@ static void show_devices(struct udevice *dev, int depth, int last_flag)
 		is_last = list_is_last(&child->sibling_node, &dev->child_head);
 		show_devices(child, depth + 1, (last_flag << 1) | is_last);
 	}
+
+	if (CONFIG_IS_ENABLED(SIMPLE_BUS_LAZY_BIND) &&
+	    (flags & DM_FLAG_BIND_PENDING))
+		show_pending(dev, depth + 1, last_flag);
 }
 
 void dm_dump_all(void)
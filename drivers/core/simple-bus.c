@@ -8,8 +8,11 @@
 #include <common.h>
 #include <asm/global_data.h>
 #include <dm.h>
+#include <log.h>
 #include <dm/simple_bus.h>
+#include <dm/uclass-internal.h>
 #include <fdt_support.h>
+#include <linux/bitops.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -54,10 +57,154 @@ static int simple_bus_post_bind(struct udevice *dev)
 		}
 	}
 
+	/*
+	 * After relocation the children of a plain simple-bus are bound on
+	 * first use, see simple_bus_bind_pending()
+	 */
+	if (CONFIG_IS_ENABLED(SIMPLE_BUS_LAZY_BIND) &&
+	    (gd->flags & GD_FLG_RELOC) &&
+	    dev->driver == DM_DRIVER_GET(simple_bus)) {
+		dev_or_flags(dev, DM_FLAG_BIND_PENDING);
+		return 0;
+	}
+
 	return dm_scan_fdt_dev(dev);
 #endif
 }
 
+#if CONFIG_IS_ENABLED(SIMPLE_BUS_LAZY_BIND)
+/**
+ * simple_bus_node_ids() - Note the uclasses which may have devices in a subtree
+ *
+ * @node: Node to check, along with all its enabled subnodes
+ * @ids: Bitmap of uclass IDs, updated with the uclass of each driver that is
+ *	compatible with one of the nodes
+ */
+static void simple_bus_node_ids(ofnode node, ulong *ids)
+{
+	struct driver *drv = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match;
+	struct driver *entry;
+	ofnode subnode;
+
+	if (!ofnode_is_enabled(node))
+		return;
+
+	for (entry = drv; entry != drv + n_ents; entry++) {
+		if (!entry->of_match)
+			continue;
+		for (of_match = entry->of_match; of_match->compatible;
+		     of_match++) {
+			if (ofnode_device_is_compatible(node,
+							of_match->compatible)) {
+				generic_set_bit(entry->id, ids);
+				break;
+			}
+		}
+	}
+
+	ofnode_for_each_subnode(subnode, node)
+		simple_bus_node_ids(subnode, ids);
+}
+
+/**
+ * simple_bus_may_have() - Check if a pending bus may hold a device of a uclass
+ *
+ * The drivers and the devicetree do not change, so the uclasses of the
+ * subnodes are only worked out on the first lookup after the bus is bound.
+ *
+ * @dev: Bus whose children are pending
+ * @id: Uclass to look for
+ * @return true if a driver in uclass @id is compatible with a node on the bus
+ */
+static bool simple_bus_may_have(struct udevice *dev, enum uclass_id id)
+{
+	struct simple_bus_plat *plat = dev_get_uclass_plat(dev);
+	ofnode node;
+
+	if (!plat->pending_ids_valid) {
+		ofnode_for_each_subnode(node, dev_ofnode(dev))
+			simple_bus_node_ids(node, plat->pending_ids);
+		plat->pending_ids_valid = true;
+	}
+
+	return plat->pending_ids[BIT_WORD(id)] & BIT_MASK(id);
+}
+
+/**
+ * simple_bus_node_within() - Check if a node lies below a bus node
+ *
+ * @node: Node to check
+ * @bus: Bus node
+ * @return true if @bus is an ancestor of @node
+ */
+static bool simple_bus_node_within(ofnode node, ofnode bus)
+{
+	for (node = ofnode_get_parent(node); ofnode_valid(node);
+	     node = ofnode_get_parent(node)) {
+		if (ofnode_equal(node, bus))
+			return true;
+	}
+
+	return false;
+}
+
+static int simple_bus_bind_children(struct udevice *dev)
+{
+	log_debug("binding children of %s\n", dev->name);
+	dev_bic_flags(dev, DM_FLAG_BIND_PENDING);
+
+	return dm_scan_fdt_dev(dev);
+}
+
+int simple_bus_bind_pending(enum uclass_id id)
+{
+	struct uclass *uc;
+	struct udevice *dev;
+	int ret;
+
+	/* Avoid uclass_get() here since it is our caller */
+	uc = uclass_find(UCLASS_SIMPLE_BUS);
+	if (!uc)
+		return 0;
+
+	/* Buses bound here are added at the end, so are checked too */
+	uclass_foreach_dev(dev, uc) {
+		if (!(dev_get_flags(dev) & DM_FLAG_BIND_PENDING) ||
+		    !simple_bus_may_have(dev, id))
+			continue;
+		ret = simple_bus_bind_children(dev);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int simple_bus_bind_pending_node(ofnode node)
+{
+	struct uclass *uc;
+	struct udevice *dev;
+	int ret;
+
+	uc = uclass_find(UCLASS_SIMPLE_BUS);
+	if (!uc)
+		return 0;
+
+	uclass_foreach_dev(dev, uc) {
+		if (!(dev_get_flags(dev) & DM_FLAG_BIND_PENDING) ||
+		    !simple_bus_node_within(node, dev_ofnode(dev)))
+			continue;
+		ret = simple_bus_bind_children(dev);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+#endif
+
 UCLASS_DRIVER(simple_bus) = {
 	.id		= UCLASS_SIMPLE_BUS,
 	.name		= "simple_bus",
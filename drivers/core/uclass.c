@@ -17,6 +17,7 @@
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
+#include <dm/simple_bus.h>
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
@@ -161,6 +162,27 @@ int uclass_get(enum uclass_id id, struct uclass **ucp)
 	return 0;
 }
 
+/**
+ * uclass_get_for_lookup() - Get a uclass which is about to be searched
+ *
+ * This first binds any devices for the uclass that are still pending on a
+ * simple-bus, so that the search can find them.
+ *
+ * @id: ID of uclass to get
+ * @ucp: Returns pointer to uclass
+ * @return 0 if OK, -ve on error
+ */
+static int uclass_get_for_lookup(enum uclass_id id, struct uclass **ucp)
+{
+	int ret;
+
+	ret = simple_bus_bind_pending(id);
+	if (ret)
+		return ret;
+
+	return uclass_get(id, ucp);
+}
+
 const char *uclass_get_name(enum uclass_id id)
 {
 	struct uclass *uc;
@@ -222,7 +244,7 @@ int uclass_find_device(enum uclass_id id, int index, struct udevice **devp)
 	int ret;
 
 	*devp = NULL;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 	if (list_empty(&uc->dev_head))
@@ -244,7 +266,7 @@ int uclass_find_first_device(enum uclass_id id, struct udevice **devp)
 	int ret;
 
 	*devp = NULL;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 	if (list_empty(&uc->dev_head))
@@ -278,7 +300,7 @@ int uclass_find_device_by_name(enum uclass_id id, const char *name,
 	*devp = NULL;
 	if (!name)
 		return -EINVAL;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 
@@ -325,7 +347,7 @@ int uclass_find_device_by_seq(enum uclass_id id, int seq, struct udevice **devp)
 	log_debug("%d\n", seq);
 	if (seq == -1)
 		return -ENODEV;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 
@@ -352,7 +374,7 @@ int uclass_find_device_by_of_offset(enum uclass_id id, int node,
 	*devp = NULL;
 	if (node < 0)
 		return -ENODEV;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 
@@ -377,7 +399,7 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 	*devp = NULL;
 	if (!ofnode_valid(node))
 		return -ENODEV;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 
@@ -410,7 +432,7 @@ int uclass_find_device_by_phandle(enum uclass_id id, struct udevice *parent,
 	find_phandle = dev_read_u32_default(parent, name, -1);
 	if (find_phandle <= 0)
 		return -ENOENT;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 
@@ -437,7 +459,7 @@ int uclass_get_device_by_driver(enum uclass_id id,
 	struct uclass *uc;
 	int ret;
 
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 
@@ -531,7 +553,7 @@ int uclass_get_device_by_phandle_id(enum uclass_id id, uint phandle_id,
 	int ret;
 
 	*devp = NULL;
-	ret = uclass_get(id, &uc);
+	ret = uclass_get_for_lookup(id, &uc);
 	if (ret)
 		return ret;
 
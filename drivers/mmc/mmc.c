@@ -1031,8 +1031,13 @@ int mmc_switch_part(struct mmc *mmc, unsigned int part_num)
 	 * to return to representing the raw device.
 	 */
 	if ((ret == 0) || ((ret == -ENODEV) && (part_num == 0))) {
+		struct blk_desc *desc = mmc_get_blk_desc(mmc);
+
 		ret = mmc_set_capacity(mmc, part_num);
-		mmc_get_blk_desc(mmc)->hwpart = part_num;
+		/* Each hardware partition has its own data and partitions */
+		if (desc->hwpart != part_num)
+			part_new_media_gen(desc);
+		desc->hwpart = part_num;
 	}
 
 	return ret;
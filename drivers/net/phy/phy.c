@@ -166,6 +166,10 @@ int genphy_restart_aneg(struct phy_device *phydev)
 	ctl &= ~(BMCR_ISOLATE);
 
 	ctl = phy_write(phydev, MDIO_DEVAD_NONE, MII_BMCR, ctl);
+	if (!ctl) {
+		phydev->aneg_start = get_timer(0);
+		phydev->aneg_pending = true;
+	}
 
 	return ctl;
 }
@@ -241,16 +245,26 @@ int genphy_update_link(struct phy_device *phydev)
 
 	if ((phydev->autoneg == AUTONEG_ENABLE) &&
 	    !(mii_reg & BMSR_ANEGCOMPLETE)) {
+		ulong start = get_timer(0);
 		int i = 0;
 
+		/*
+		 * If autonegotiation was started earlier (e.g. when the
+		 * Ethernet device was probed), only wait for what is left
+		 */
+		if (phydev->aneg_pending &&
+		    get_timer(phydev->aneg_start) < PHY_ANEG_TIMEOUT)
+			start = phydev->aneg_start;
+
 		printf("%s Waiting for PHY auto negotiation to complete",
 		       phydev->dev->name);
 		while (!(mii_reg & BMSR_ANEGCOMPLETE)) {
 			/*
 			 * Timeout reached ?
 			 */
-			if (i > (PHY_ANEG_TIMEOUT / 50)) {
+			if (get_timer(start) > PHY_ANEG_TIMEOUT) {
 				printf(" TIMEOUT !\n");
+				phydev->aneg_pending = false;
 				phydev->link = 0;
 				return -ETIMEDOUT;
 			}
@@ -268,8 +282,10 @@ int genphy_update_link(struct phy_device *phydev)
 			mdelay(50);	/* 50 ms */
 		}
 		printf(" done\n");
+		phydev->aneg_pending = false;
 		phydev->link = 1;
 	} else {
+		phydev->aneg_pending = false;
 		/* Read the link a second time to clear the latched state */
 		mii_reg = phy_read(phydev, MDIO_DEVAD_NONE, MII_BMSR);
 
@@ -867,6 +883,7 @@ int phy_reset(struct phy_device *phydev)
 	}
 #endif
 
+	phydev->aneg_pending = false;
 	if (phy_write(phydev, devad, MII_BMCR, BMCR_RESET) < 0) {
 		debug("PHY reset failed\n");
 		return -1;
@@ -942,6 +959,10 @@ void phy_connect_dev(struct phy_device *phydev, struct eth_device *dev)
 		       phydev->dev->name, dev->name);
 	}
 	phydev->dev = dev;
+#ifdef CONFIG_DM_ETH
+	if (device_get_uclass_id(dev) == UCLASS_ETH)
+		eth_set_phydev(dev, phydev);
+#endif
 	debug("%s connected to %s\n", dev->name, phydev->drv->name);
 }
 
@@ -180,48 +180,31 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 	nvmeq->sq_tail = tail;
 }
 
-static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
-				struct nvme_command *cmd,
-				u32 *result, unsigned timeout)
+/**
+ * nvme_check_completion() - check whether the next command has completed
+ *
+ * @nvmeq:	The queue to check
+ * @result:	Returns the command-specific result, if not NULL
+ * @return 0 if the command completed successfully, -EINPROGRESS if it has not
+ *	completed yet, -EIO if it failed
+ */
+static int nvme_check_completion(struct nvme_queue *nvmeq, u32 *result)
 {
 	u16 head = nvmeq->cq_head;
 	u16 phase = nvmeq->cq_phase;
 	u16 status;
-	ulong start_time;
-	ulong timeout_us = timeout * 100000;
-
-	cmd->common.command_id = nvme_get_cmd_id();
-	nvme_submit_cmd(nvmeq, cmd);
 
-	start_time = timer_get_us();
-
-	for (;;) {
-		status = nvme_read_completion_status(nvmeq, head);
-		if ((status & 0x01) == phase)
-			break;
-		if (timeout_us > 0 && (timer_get_us() - start_time)
-		    >= timeout_us)
-			return -ETIMEDOUT;
-	}
+	status = nvme_read_completion_status(nvmeq, head);
+	if ((status & 0x01) != phase)
+		return -EINPROGRESS;
 
 	status >>= 1;
 	if (status) {
 		printf("ERROR: status = %x, phase = %d, head = %d\n",
 		       status, phase, head);
-		status = 0;
-		if (++head == nvmeq->q_depth) {
-			head = 0;
-			phase = !phase;
-		}
-		writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
-		nvmeq->cq_head = head;
-		nvmeq->cq_phase = phase;
-
-		return -EIO;
-	}
-
-	if (result)
+	} else if (result) {
 		*result = readl(&(nvmeq->cqes[head].result));
+	}
 
 	if (++head == nvmeq->q_depth) {
 		head = 0;
@@ -231,7 +214,30 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 	nvmeq->cq_head = head;
 	nvmeq->cq_phase = phase;
 
-	return status;
+	return status ? -EIO : 0;
+}
+
+static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
+				struct nvme_command *cmd,
+				u32 *result, unsigned timeout)
+{
+	ulong start_time;
+	ulong timeout_us = timeout * 100000;
+	int ret;
+
+	cmd->common.command_id = nvme_get_cmd_id();
+	nvme_submit_cmd(nvmeq, cmd);
+
+	start_time = timer_get_us();
+
+	for (;;) {
+		ret = nvme_check_completion(nvmeq, result);
+		if (ret != -EINPROGRESS)
+			return ret;
+		if (timeout_us > 0 && (timer_get_us() - start_time)
+		    >= timeout_us)
+			return -ETIMEDOUT;
+	}
 }
 
 static int nvme_submit_admin_cmd(struct nvme_dev *dev, struct nvme_command *cmd,
@@ -732,6 +738,104 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
+/* Set up a read or write command for the given namespace */
+static void nvme_rw_init(struct nvme_ns *ns, struct nvme_command *c, bool read)
+{
+	memset(c, '\0', sizeof(*c));
+	c->rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
+	c->rw.nsid = cpu_to_le32(ns->ns_id);
+}
+
+/* Fill in the transfer part of a read/write command, ready to submit it */
+static int nvme_rw_setup(struct nvme_ns *ns, struct nvme_command *c, u64 slba,
+			 u16 lbas, uintptr_t buffer)
+{
+	u64 prp2;
+
+	if (nvme_setup_prps(ns->dev, &prp2, lbas << ns->lba_shift, buffer))
+		return -EIO;
+	c->rw.slba = cpu_to_le64(slba);
+	c->rw.length = cpu_to_le16(lbas - 1);
+	c->rw.prp1 = cpu_to_le64(buffer);
+	c->rw.prp2 = cpu_to_le64(prp2);
+
+	return 0;
+}
+
+/* Number of blocks to transfer with the next command of a request */
+static u16 nvme_rw_chunk(struct nvme_ns *ns, u64 left)
+{
+	u16 lbas = 1 << (ns->dev->max_transfer_shift - ns->lba_shift);
+
+	return left < lbas ? left : lbas;
+}
+
+/* Start the next command of the asynchronous request */
+static int nvme_async_next(struct nvme_dev *dev)
+{
+	struct nvme_async *async = &dev->async;
+	u16 lbas = nvme_rw_chunk(async->ns, async->left);
+	int ret;
+
+	ret = nvme_rw_setup(async->ns, &async->cmd, async->slba, lbas,
+			    async->buffer);
+	if (ret)
+		return ret;
+	async->lbas = lbas;
+	async->start_time = timer_get_us();
+	async->cmd.common.command_id = nvme_get_cmd_id();
+	nvme_submit_cmd(dev->queues[NVME_IO_Q], &async->cmd);
+
+	return 0;
+}
+
+/* Finish the asynchronous request, recording its result */
+static void nvme_async_finish(struct nvme_dev *dev, int ret)
+{
+	struct nvme_async *async = &dev->async;
+	struct blk_req *req = async->req;
+	u64 total_len = req->blkcnt << async->ns->lba_shift;
+
+	if (!req->write)
+		invalidate_dcache_range((ulong)req->buffer,
+					(ulong)req->buffer + total_len);
+	req->result = ret && !async->done ? ret : async->done;
+	async->req = NULL;
+}
+
+/*
+ * Check on the asynchronous request, starting its next command if the current
+ * one has completed
+ *
+ * @return 0 if the request is complete, -EINPROGRESS if not
+ */
+static int nvme_async_poll(struct nvme_dev *dev)
+{
+	struct nvme_async *async = &dev->async;
+	int ret;
+
+	ret = nvme_check_completion(dev->queues[NVME_IO_Q], NULL);
+	if (ret == -EINPROGRESS) {
+		if (timer_get_us() - async->start_time < IO_TIMEOUT * 100000)
+			return -EINPROGRESS;
+		ret = -ETIMEDOUT;
+	}
+	if (!ret) {
+		async->done += async->lbas;
+		async->left -= async->lbas;
+		async->slba += async->lbas;
+		async->buffer += async->lbas << async->ns->lba_shift;
+		if (async->left) {
+			ret = nvme_async_next(dev);
+			if (!ret)
+				return -EINPROGRESS;
+		}
+	}
+	nvme_async_finish(dev, ret);
+
+	return 0;
+}
+
 static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 			 lbaint_t blkcnt, void *buffer, bool read)
 {
@@ -740,44 +844,30 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 	struct nvme_command c;
 	struct blk_desc *desc = dev_get_uclass_plat(udev);
 	int status;
-	u64 prp2;
 	u64 total_len = blkcnt << desc->log2blksz;
 	u64 temp_len = total_len;
 	uintptr_t temp_buffer = (uintptr_t)buffer;
 
 	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	u16 lbas;
 	u64 total_lbas = blkcnt;
 
+	/* Commands complete in order, so finish any asynchronous one first */
+	while (dev->async.req)
+		nvme_async_poll(dev);
+
 	flush_dcache_range((unsigned long)buffer,
 			   (unsigned long)buffer + total_len);
 
-	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
-	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
+	nvme_rw_init(ns, &c, read);
 
 	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
-		}
+		lbas = nvme_rw_chunk(ns, total_lbas);
+		total_lbas -= lbas;
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
+		if (nvme_rw_setup(ns, &c, slba, lbas, temp_buffer))
 			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
 		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64(temp_buffer);
-		c.rw.prp2 = cpu_to_le64(prp2);
 		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
 				&c, NULL, IO_TIMEOUT);
 		if (status)
@@ -805,9 +895,50 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 	return nvme_blk_rw(udev, blknr, blkcnt, (void *)buffer, false);
 }
 
+static int nvme_blk_submit(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_async *async = &dev->async;
+	int ret;
+
+	/* The I/O queue is shared by all namespaces of the controller */
+	if (async->req)
+		return -EBUSY;
+
+	flush_dcache_range((ulong)req->buffer, (ulong)req->buffer +
+			   (req->blkcnt << ns->lba_shift));
+	nvme_rw_init(ns, &async->cmd, !req->write);
+	async->ns = ns;
+	async->slba = req->start;
+	async->left = req->blkcnt;
+	async->done = 0;
+	async->buffer = (uintptr_t)req->buffer;
+	ret = nvme_async_next(dev);
+	if (ret)
+		return ret;
+	async->req = req;
+
+	return 0;
+}
+
+static int nvme_blk_poll(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+
+	/* A synchronous request may have finished it already */
+	if (dev->async.req != req)
+		return 0;
+
+	return nvme_async_poll(dev);
+}
+
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
 };
 
 U_BOOT_DRIVER(nvme_blk) = {
@@ -594,6 +594,33 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+/**
+ * struct nvme_async - state of an asynchronous read or write
+ *
+ * A request may need several commands, which are sent one at a time.
+ *
+ * @req:	Request in progress, or NULL if none
+ * @ns:		Namespace being accessed
+ * @cmd:	Current command
+ * @slba:	Start block of the current command
+ * @lbas:	Number of blocks in the current command
+ * @left:	Number of blocks not completed yet
+ * @done:	Number of blocks completed
+ * @buffer:	Buffer address for the current command
+ * @start_time:	Time when the current command was sent, in microseconds
+ */
+struct nvme_async {
+	struct blk_req *req;
+	struct nvme_ns *ns;
+	struct nvme_command cmd;
+	u64 slba;
+	u16 lbas;
+	u64 left;
+	u64 done;
+	uintptr_t buffer;
+	ulong start_time;
+};
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct list_head node;
@@ -619,6 +646,7 @@ struct nvme_dev {
 	u64 *prp_pool;
 	u32 prp_entry_num;
 	u32 nn;
+	struct nvme_async async;
 };
 
 /*
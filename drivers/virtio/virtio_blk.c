@@ -13,26 +13,38 @@
 #include <virtio_ring.h>
 #include "virtio_blk.h"
 
+/**
+ * struct virtio_blk_priv - private data for a virtio block device
+ *
+ * @vq: Request queue
+ * @req: Asynchronous request in progress, if any
+ * @out_hdr: Header for @req
+ * @status: Status of @req, written by the device
+ */
 struct virtio_blk_priv {
 	struct virtqueue *vq;
+	struct blk_req *req;
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
 };
 
-static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+/* Add a request to the queue and tell the device about it */
+static int virtio_blk_start(struct udevice *dev, u64 sector, lbaint_t blkcnt,
+			    void *buffer, u32 type,
+			    struct virtio_blk_outhdr *out_hdr, u8 *status)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	unsigned int num_out = 0, num_in = 0;
 	struct virtio_sg *sgs[3];
-	u8 status;
 	int ret;
 
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(dev, type),
-		.sector = cpu_to_virtio64(dev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
+	struct virtio_sg hdr_sg = { out_hdr, sizeof(*out_hdr) };
 	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	struct virtio_sg status_sg = { status, sizeof(*status) };
+
+	out_hdr->type = cpu_to_virtio32(dev, type);
+	out_hdr->ioprio = 0;
+	out_hdr->sector = cpu_to_virtio64(dev, sector);
 
 	sgs[num_out++] = &hdr_sg;
 
@@ -49,6 +61,39 @@ static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
 
 	virtqueue_kick(priv->vq);
 
+	return 0;
+}
+
+/* Record the result of the asynchronous request, now that it is complete */
+static void virtio_blk_finish(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct blk_req *req = priv->req;
+
+	req->result = priv->status == VIRTIO_BLK_S_OK ? req->blkcnt : -EIO;
+	priv->req = NULL;
+}
+
+static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
+			       lbaint_t blkcnt, void *buffer, u32 type)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
+	int ret;
+
+	/* Requests complete in order, so finish any asynchronous one first */
+	if (priv->req) {
+		while (!virtqueue_get_buf(priv->vq, NULL))
+			;
+		virtio_blk_finish(dev);
+	}
+
+	ret = virtio_blk_start(dev, sector, blkcnt, buffer, type, &out_hdr,
+			       &status);
+	if (ret)
+		return ret;
+
 	while (!virtqueue_get_buf(priv->vq, NULL))
 		;
 
@@ -122,9 +167,42 @@ static int virtio_blk_probe(struct udevice *dev)
 	return 0;
 }
 
+static int virtio_blk_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	if (priv->req)
+		return -EBUSY;
+	ret = virtio_blk_start(dev, req->start, req->blkcnt, req->buffer,
+			       req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN,
+			       &priv->out_hdr, &priv->status);
+	if (ret)
+		return ret;
+	priv->req = req;
+
+	return 0;
+}
+
+static int virtio_blk_poll(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+
+	/* A synchronous request may have finished it already */
+	if (priv->req != req)
+		return 0;
+	if (!virtqueue_get_buf(priv->vq, NULL))
+		return -EINPROGRESS;
+	virtio_blk_finish(dev);
+
+	return 0;
+}
+
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
+	.submit	= virtio_blk_submit,
+	.poll	= virtio_blk_poll,
 };
 
 U_BOOT_DRIVER(virtio_blk) = {
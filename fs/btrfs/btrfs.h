@@ -16,6 +16,7 @@ extern struct btrfs_fs_info *current_fs_info;
 
 /* compression.c */
 u32 btrfs_decompress(u8 type, const char *, u32, char *, u32);
+void btrfs_decompress_cleanup(struct btrfs_fs_info *fs_info);
 
 /* inode.c */
 int btrfs_readlink(struct btrfs_root *root, u64 ino, char *target);
@@ -6,7 +6,6 @@
  */
 
 #include "btrfs.h"
-#include <abuf.h>
 #include <log.h>
 #include <malloc.h>
 #include <linux/lzo.h>
@@ -84,47 +83,74 @@ static u32 decompress_lzo(const u8 *cbuf, u32 clen, u8 *dbuf, u32 dlen)
 /* from zutil.h */
 #define PRESET_DICT 0x20
 
+/*
+ * Get the stream used for raw deflate data, setting it up on first use.
+ * Resetting it for each extent saves allocating its state and window again.
+ */
+static z_stream *get_zlib_stream(void)
+{
+	struct btrfs_fs_info *fs_info = current_fs_info;
+	z_stream *stream = fs_info->zlib_stream;
+
+	if (stream) {
+		if (inflateReset(stream) != Z_OK)
+			return NULL;
+		return stream;
+	}
+
+	stream = calloc(1, sizeof(*stream));
+	if (!stream)
+		return NULL;
+	if (inflateInit2(stream, -MAX_WBITS) != Z_OK) {
+		free(stream);
+		return NULL;
+	}
+	fs_info->zlib_stream = stream;
+
+	return stream;
+}
+
 static u32 decompress_zlib(const u8 *_cbuf, u32 clen, u8 *dbuf, u32 dlen)
 {
-	int wbits = MAX_WBITS, ret = -1;
-	z_stream stream;
+	int ret = -1;
+	z_stream local, *stream;
 	u8 *cbuf;
 	u32 res;
 
-	memset(&stream, 0, sizeof(stream));
-
 	cbuf = (u8 *) _cbuf;
 
-	stream.total_in = 0;
-
-	stream.next_out = dbuf;
-	stream.avail_out = dlen;
-	stream.total_out = 0;
-
 	/* skip adler32 check if deflate and no dictionary */
 	if (clen > 2 && !(cbuf[1] & PRESET_DICT) &&
 	    ((cbuf[0] & 0x0f) == Z_DEFLATED) &&
 	    !(((cbuf[0] << 8) + cbuf[1]) % 31)) {
-		wbits = -((cbuf[0] >> 4) + 8);
 		cbuf += 2;
 		clen -= 2;
+		stream = get_zlib_stream();
+		if (!stream)
+			return -1;
+	} else {
+		memset(&local, 0, sizeof(local));
+		stream = &local;
+		if (Z_OK != inflateInit2(stream, MAX_WBITS))
+			return -1;
 	}
 
-	if (Z_OK != inflateInit2(&stream, wbits))
-		return -1;
+	stream->next_out = dbuf;
+	stream->avail_out = dlen;
 
-	while (stream.total_in < clen) {
-		stream.next_in = cbuf + stream.total_in;
-		stream.avail_in = min((u32) (clen - stream.total_in),
+	while (stream->total_in < clen) {
+		stream->next_in = cbuf + stream->total_in;
+		stream->avail_in = min((u32) (clen - stream->total_in),
 					current_fs_info->sectorsize);
 
-		ret = inflate(&stream, Z_NO_FLUSH);
+		ret = inflate(stream, Z_NO_FLUSH);
 		if (ret != Z_OK)
 			break;
 	}
 
-	res = stream.total_out;
-	inflateEnd(&stream);
+	res = stream->total_out;
+	if (stream == &local)
+		inflateEnd(stream);
 
 	if (ret != Z_STREAM_END)
 		return -1;
@@ -137,12 +163,58 @@ static u32 decompress_zlib(const u8 *_cbuf, u32 clen, u8 *dbuf, u32 dlen)
 
 static u32 decompress_zstd(const u8 *cbuf, u32 clen, u8 *dbuf, u32 dlen)
 {
-	struct abuf in, out;
+	struct btrfs_fs_info *fs_info = current_fs_info;
+	size_t wsize = ZSTD_DStreamWorkspaceBound(ZSTD_BTRFS_MAX_INPUT);
+	ZSTD_DStream *dstream;
+	ZSTD_inBuffer in_buf;
+	ZSTD_outBuffer out_buf;
+	size_t res;
+
+	/* The workspace is big, so it is allocated once and kept */
+	if (!fs_info->zstd_workspace) {
+		fs_info->zstd_workspace = malloc(wsize);
+		if (!fs_info->zstd_workspace)
+			return -1;
+	}
+
+	dstream = ZSTD_initDStream(ZSTD_BTRFS_MAX_INPUT,
+				   fs_info->zstd_workspace, wsize);
+	if (!dstream)
+		return -1;
 
-	abuf_init_set(&in, (u8 *)cbuf, clen);
-	abuf_init_set(&out, dbuf, dlen);
+	in_buf.src = cbuf;
+	in_buf.pos = 0;
+	in_buf.size = clen;
+
+	out_buf.dst = dbuf;
+	out_buf.pos = 0;
+	out_buf.size = dlen;
+
+	while (1) {
+		res = ZSTD_decompressStream(dstream, &out_buf, &in_buf);
+		if (ZSTD_isError(res)) {
+			log_debug("ZSTD_decompressStream error %d\n",
+				  ZSTD_getErrorCode(res));
+			return -1;
+		}
 
-	return zstd_decompress(&in, &out);
+		if (!res || in_buf.pos >= in_buf.size ||
+		    out_buf.pos >= out_buf.size)
+			break;
+	}
+
+	return out_buf.pos;
+}
+
+void btrfs_decompress_cleanup(struct btrfs_fs_info *fs_info)
+{
+	if (fs_info->zlib_stream) {
+		inflateEnd(fs_info->zlib_stream);
+		free(fs_info->zlib_stream);
+		fs_info->zlib_stream = NULL;
+	}
+	free(fs_info->zstd_workspace);
+	fs_info->zstd_workspace = NULL;
 }
 
 u32 btrfs_decompress(u8 type, const char *c, u32 clen, char *d, u32 dlen)
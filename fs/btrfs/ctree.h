@@ -98,6 +98,13 @@ struct btrfs_root {
 struct btrfs_trans_handle;
 struct btrfs_device;
 struct btrfs_fs_devices;
+struct z_stream_s;
+
+/* Buffer kept between reads of compressed extents, which only grows */
+struct btrfs_extent_buf {
+	char *data;
+	u32 size;
+};
 struct btrfs_fs_info {
 	u8 chunk_tree_uuid[BTRFS_UUID_SIZE];
 	u8 *new_chunk_tree_uuid;
@@ -123,6 +130,15 @@ struct btrfs_fs_info {
 	u32 nodesize;
 	u32 sectorsize;
 	u32 stripesize;
+
+	/*
+	 * Buffers and decompression state for compressed extents, set up on
+	 * first use and kept until the filesystem is closed
+	 */
+	struct btrfs_extent_buf comp_buf;
+	struct btrfs_extent_buf decomp_buf;
+	struct z_stream_s *zlib_stream;
+	void *zstd_workspace;
 };
 
 static inline u32 BTRFS_MAX_ITEM_SIZE(const struct btrfs_fs_info *info)
@@ -468,8 +468,15 @@ struct extent_buffer* read_tree_block(struct btrfs_fs_info *fs_info, u64 bytenr,
 	if (!eb)
 		return ERR_PTR(-ENOMEM);
 
-	if (btrfs_buffer_uptodate(eb, parent_transid))
+	/*
+	 * A cached tree block is only used again if it is from the generation
+	 * its parent expects, else it is read again
+	 */
+	if (extent_buffer_uptodate(eb) &&
+	    (!parent_transid ||
+	     btrfs_header_generation(eb) == parent_transid))
 		return eb;
+	clear_extent_buffer_uptodate(eb);
 
 	num_copies = btrfs_num_copies(fs_info, eb->start, eb->len);
 	while (1) {
@@ -531,7 +538,7 @@ struct extent_buffer* read_tree_block(struct btrfs_fs_info *fs_info, u64 bytenr,
 	 * We failed to read this tree block, it be should deleted right now
 	 * to avoid stale cache populate the cache.
 	 */
-	free_extent_buffer(eb);
+	free_extent_buffer_nocache(eb);
 	return ERR_PTR(ret);
 }
 
@@ -751,6 +758,9 @@ struct btrfs_root *btrfs_read_fs_root(struct btrfs_fs_info *fs_info,
 
 void btrfs_free_fs_info(struct btrfs_fs_info *fs_info)
 {
+	btrfs_decompress_cleanup(fs_info);
+	free(fs_info->comp_buf.data);
+	free(fs_info->decomp_buf.data);
 	free(fs_info->tree_root);
 	free(fs_info->chunk_root);
 	free(fs_info->csum_root);
@@ -7,6 +7,7 @@
 
 #include <linux/kernel.h>
 #include <linux/bug.h>
+#include <log.h>
 #include <malloc.h>
 #include <memalign.h>
 #include "btrfs.h"
@@ -14,10 +15,14 @@
 #include "extent-io.h"
 #include "disk-io.h"
 
+/* Most memory kept in tree nodes which are no longer in use */
+#define BTRFS_NODE_CACHE_SIZE	(CONFIG_FS_BTRFS_NODE_CACHE_SIZE * 1024)
+
 void extent_io_tree_init(struct extent_io_tree *tree)
 {
 	cache_tree_init(&tree->state);
 	cache_tree_init(&tree->cache);
+	INIT_LIST_HEAD(&tree->lru);
 	tree->cache_size = 0;
 }
 
@@ -54,6 +59,17 @@ static void free_extent_state_func(struct cache_extent *cache)
 static void free_extent_buffer_final(struct extent_buffer *eb);
 void extent_io_tree_cleanup(struct extent_io_tree *tree)
 {
+	struct extent_buffer *eb;
+
+	while (!list_empty(&tree->lru)) {
+		eb = list_entry(tree->lru.next, struct extent_buffer, lru);
+		if (eb->refs) {
+			log_debug("extent buffer leak: start %llu len %u\n",
+				  eb->start, eb->len);
+			eb->refs = 0;
+		}
+		free_extent_buffer_final(eb);
+	}
 	cache_tree_free_extents(&tree->state, free_extent_state_func);
 }
 
@@ -577,6 +593,7 @@ static struct extent_buffer *__alloc_extent_buffer(struct btrfs_fs_info *info,
 
 	eb->start = bytenr;
 	eb->len = blocksize;
+	INIT_LIST_HEAD(&eb->lru);
 	eb->refs = 1;
 	eb->flags = 0;
 	eb->cache_node.start = bytenr;
@@ -608,6 +625,7 @@ static void free_extent_buffer_final(struct extent_buffer *eb)
 		struct extent_io_tree *tree = &eb->fs_info->extent_cache;
 
 		remove_cache_extent(&tree->cache, &eb->cache_node);
+		list_del_init(&eb->lru);
 		BUG_ON(tree->cache_size < eb->len);
 		tree->cache_size -= eb->len;
 	}
@@ -633,11 +651,34 @@ static void free_extent_buffer_internal(struct extent_buffer *eb, bool free_now)
 	}
 }
 
+/*
+ * Drop a reference to @eb. Once it is no longer used it stays in the cache,
+ * so that reading the same tree block again needs no I/O.
+ */
 void free_extent_buffer(struct extent_buffer *eb)
+{
+	free_extent_buffer_internal(eb, 0);
+}
+
+/* Drop a reference to @eb, freeing it straight away if it is unused */
+void free_extent_buffer_nocache(struct extent_buffer *eb)
 {
 	free_extent_buffer_internal(eb, 1);
 }
 
+/* Free the least recently used buffers until the cache is within its limit */
+static void trim_extent_buffer_cache(struct extent_io_tree *tree)
+{
+	struct extent_buffer *eb, *tmp;
+
+	list_for_each_entry_safe(eb, tmp, &tree->lru, lru) {
+		if (tree->cache_size <= BTRFS_NODE_CACHE_SIZE)
+			break;
+		if (!eb->refs)
+			free_extent_buffer_final(eb);
+	}
+}
+
 struct extent_buffer *find_extent_buffer(struct extent_io_tree *tree,
 					 u64 bytenr, u32 blocksize)
 {
@@ -648,6 +689,7 @@ struct extent_buffer *find_extent_buffer(struct extent_io_tree *tree,
 	if (cache && cache->start == bytenr &&
 	    cache->size == blocksize) {
 		eb = container_of(cache, struct extent_buffer, cache_node);
+		list_move_tail(&eb->lru, &tree->lru);
 		eb->refs++;
 	}
 	return eb;
@@ -662,6 +704,7 @@ struct extent_buffer *find_first_extent_buffer(struct extent_io_tree *tree,
 	cache = search_cache_extent(&tree->cache, start);
 	if (cache) {
 		eb = container_of(cache, struct extent_buffer, cache_node);
+		list_move_tail(&eb->lru, &tree->lru);
 		eb->refs++;
 	}
 	return eb;
@@ -678,24 +721,36 @@ struct extent_buffer *alloc_extent_buffer(struct btrfs_fs_info *fs_info,
 	if (cache && cache->start == bytenr &&
 	    cache->size == blocksize) {
 		eb = container_of(cache, struct extent_buffer, cache_node);
+		list_move_tail(&eb->lru, &tree->lru);
 		eb->refs++;
 	} else {
 		int ret;
 
-		if (cache) {
+		/*
+		 * Unused buffers overlapping this one can only have come from
+		 * a corrupted tree, so drop them. One still in use must stay.
+		 */
+		while (cache) {
 			eb = container_of(cache, struct extent_buffer,
 					  cache_node);
-			free_extent_buffer(eb);
+			if (eb->refs)
+				return NULL;
+			free_extent_buffer_final(eb);
+			cache = lookup_cache_extent(&tree->cache, bytenr,
+						    blocksize);
 		}
 		eb = __alloc_extent_buffer(fs_info, bytenr, blocksize);
 		if (!eb)
 			return NULL;
 		ret = insert_cache_extent(&tree->cache, &eb->cache_node);
 		if (ret) {
+			free(eb->data);
 			free(eb);
 			return NULL;
 		}
+		list_add_tail(&eb->lru, &tree->lru);
 		tree->cache_size += blocksize;
+		trim_extent_buffer_cache(tree);
 	}
 	return eb;
 }
@@ -408,6 +408,58 @@ out:
 	return ret;
 }
 
+/*
+ * Read @len bytes of uncompressed data at logical address @logical into @dest.
+ *
+ * The range may cross chunk and stripe boundaries, each part of it is read
+ * from the first copy which can be read.
+ *
+ * Return 0 for success.
+ * Return <0 for error.
+ */
+static int read_data_range(struct btrfs_fs_info *fs_info, u64 logical,
+			   u64 len, char *dest)
+{
+	u64 read;
+	int num_copies;
+	int ret;
+	int i;
+
+	while (len) {
+		num_copies = btrfs_num_copies(fs_info, logical, len);
+		ret = -EIO;
+		for (i = 1; i <= num_copies; i++) {
+			read = len;
+			ret = read_extent_data(fs_info, dest, logical, &read, i);
+			if (!ret && read)
+				break;
+			ret = -EIO;
+		}
+		if (ret < 0)
+			return ret;
+		logical += read;
+		dest += read;
+		len -= read;
+	}
+	return 0;
+}
+
+/*
+ * Get a buffer of at least @size bytes from @buf.
+ *
+ * The buffer is kept until the filesystem is closed, so reading many
+ * compressed extents does not allocate memory for each one.
+ */
+static char *get_extent_buf(struct btrfs_extent_buf *buf, u32 size)
+{
+	if (buf->size < size) {
+		free(buf->data);
+		buf->data = malloc_cache_aligned(size);
+		buf->size = buf->data ? size : 0;
+	}
+	return buf->data;
+}
+
 /*
  * Read out regular extent.
  *
@@ -425,15 +477,12 @@ int btrfs_read_extent_reg(struct btrfs_path *path,
 	struct btrfs_fs_info *fs_info = leaf->fs_info;
 	struct btrfs_key key;
 	u64 extent_num_bytes;
+	u64 extent_offset;
 	u64 disk_bytenr;
-	u64 read;
-	char *cbuf = NULL;
-	char *dbuf = NULL;
+	char *cbuf;
+	char *dbuf;
 	u32 csize;
 	u32 dsize;
-	bool finished = false;
-	int num_copies;
-	int i;
 	int slot = path->slots[0];
 	int ret;
 
@@ -457,53 +506,39 @@ int btrfs_read_extent_reg(struct btrfs_path *path,
 		logical = btrfs_file_extent_disk_bytenr(leaf, fi) +
 			  btrfs_file_extent_offset(leaf, fi) +
 			  offset - key.offset;
-		read = len;
-
-		num_copies = btrfs_num_copies(fs_info, logical, len);
-		for (i = 1; i <= num_copies; i++) {
-			ret = read_extent_data(fs_info, dest, logical, &read, i);
-			if (ret < 0 || read != len)
-				continue;
-			finished = true;
-			break;
-		}
-		if (!finished)
-			return -EIO;
+		ret = read_data_range(fs_info, logical, len, dest);
+		if (ret < 0)
+			return ret;
 		return len;
 	}
 
 	csize = btrfs_file_extent_disk_num_bytes(leaf, fi);
 	dsize = btrfs_file_extent_ram_bytes(leaf, fi);
 	disk_bytenr = btrfs_file_extent_disk_bytenr(leaf, fi);
-	num_copies = btrfs_num_copies(fs_info, disk_bytenr, csize);
+	extent_offset = btrfs_file_extent_offset(leaf, fi) + offset - key.offset;
+	if (extent_offset + len > dsize)
+		return -EUCLEAN;
 
-	cbuf = malloc_cache_aligned(csize);
-	dbuf = malloc_cache_aligned(dsize);
-	if (!cbuf || !dbuf) {
-		ret = -ENOMEM;
-		goto out;
+	cbuf = get_extent_buf(&fs_info->comp_buf, csize);
+	if (!cbuf)
+		return -ENOMEM;
+	/* If the whole extent is wanted, decompress it straight into @dest */
+	if (!extent_offset && len == dsize) {
+		dbuf = dest;
+	} else {
+		dbuf = get_extent_buf(&fs_info->decomp_buf, dsize);
+		if (!dbuf)
+			return -ENOMEM;
 	}
 	/* For compressed extent, we must read the whole on-disk extent */
-	for (i = 1; i <= num_copies; i++) {
-		read = csize;
-		ret = read_extent_data(fs_info, cbuf, disk_bytenr,
-				       &read, i);
-		if (ret < 0 || read != csize)
-			continue;
-		finished = true;
-		break;
-	}
-	if (!finished) {
-		ret = -EIO;
-		goto out;
-	}
+	ret = read_data_range(fs_info, disk_bytenr, csize, cbuf);
+	if (ret < 0)
+		return ret;
 
 	ret = btrfs_decompress(btrfs_file_extent_compression(leaf, fi), cbuf,
 			       csize, dbuf, dsize);
-	if (ret == (u32)-1) {
-		ret = -EIO;
-		goto out;
-	}
+	if (ret == (u32)-1)
+		return -EIO;
 	/*
 	 * The compressed part ends before sector boundary, the remaining needs
 	 * to be zeroed out.
@@ -511,12 +546,9 @@ int btrfs_read_extent_reg(struct btrfs_path *path,
 	if (ret < dsize)
 		memset(dbuf + ret, 0, dsize - ret);
 	/* Then copy the needed part */
-	memcpy(dest, dbuf + btrfs_file_extent_offset(leaf, fi), len);
-	ret = len;
-out:
-	free(cbuf);
-	free(dbuf);
-	return ret;
+	if (dbuf != dest)
+		memcpy(dest, dbuf + extent_offset, len);
+	return len;
 }
 
 /*
@@ -669,6 +701,9 @@ int btrfs_file_read(struct btrfs_root *root, u64 ino, u64 file_offset, u64 len,
 	u64 aligned_end = round_down(file_offset + len, fs_info->sectorsize);
 	u64 next_offset;
 	u64 cur = aligned_start;
+	u64 run_start = 0;
+	u64 run_logical = 0;
+	u64 run_len = 0;
 	int ret = 0;
 
 	btrfs_init_path(&path);
@@ -702,9 +737,16 @@ int btrfs_file_read(struct btrfs_root *root, u64 ino, u64 file_offset, u64 len,
 		}
 	}
 
-	/* Read the aligned part */
+	/*
+	 * Read the aligned part.
+	 *
+	 * Uncompressed extents which follow each other both in the file and on
+	 * disk are gathered into a run, which is read with one request.
+	 */
 	while (cur < aligned_end) {
-		u64 extent_num_bytes;
+		struct extent_buffer *leaf;
+		u64 extent_end;
+		u64 logical;
 		u8 type;
 
 		btrfs_release_path(&path);
@@ -713,36 +755,67 @@ int btrfs_file_read(struct btrfs_root *root, u64 ino, u64 file_offset, u64 len,
 			goto out;
 		if (ret > 0) {
 			/* No next, direct exit */
-			if (!next_offset) {
-				ret = 0;
-				goto out;
-			}
+			if (!next_offset)
+				break;
+			/* Skip the hole, as we have zeroed the dest */
+			cur = next_offset;
+			continue;
 		}
-		fi = btrfs_item_ptr(path.nodes[0], path.slots[0],
+		leaf = path.nodes[0];
+		fi = btrfs_item_ptr(leaf, path.slots[0],
 				    struct btrfs_file_extent_item);
-		btrfs_item_key_to_cpu(path.nodes[0], &key, path.slots[0]);
-		type = btrfs_file_extent_type(path.nodes[0], fi);
+		btrfs_item_key_to_cpu(leaf, &key, path.slots[0]);
+		type = btrfs_file_extent_type(leaf, fi);
 		if (type == BTRFS_FILE_EXTENT_INLINE) {
 			ret = btrfs_read_extent_inline(&path, fi, dest);
 			goto out;
 		}
+		extent_end = min(key.offset +
+				 btrfs_file_extent_num_bytes(leaf, fi),
+				 aligned_end);
 		/* Skip holes, as we have zeroed the dest */
 		if (type == BTRFS_FILE_EXTENT_PREALLOC ||
-		    btrfs_file_extent_disk_bytenr(path.nodes[0], fi) == 0) {
-			cur = key.offset + btrfs_file_extent_num_bytes(
-					path.nodes[0], fi);
+		    btrfs_file_extent_disk_bytenr(leaf, fi) == 0) {
+			cur = extent_end;
 			continue;
 		}
 
 		/* Read the remaining part of the extent */
-		extent_num_bytes = btrfs_file_extent_num_bytes(path.nodes[0],
-							       fi);
-		ret = btrfs_read_extent_reg(&path, fi, cur,
-				min(extent_num_bytes, aligned_end - cur),
-				dest + cur - file_offset);
+		if (btrfs_file_extent_compression(leaf, fi) !=
+		    BTRFS_COMPRESS_NONE) {
+			ret = btrfs_read_extent_reg(&path, fi, cur,
+						    extent_end - cur,
+						    dest + cur - file_offset);
+			if (ret < 0)
+				goto out;
+			cur = extent_end;
+			continue;
+		}
+
+		logical = btrfs_file_extent_disk_bytenr(leaf, fi) +
+			  btrfs_file_extent_offset(leaf, fi) + cur - key.offset;
+		if (run_len && run_start + run_len == cur &&
+		    run_logical + run_len == logical) {
+			run_len += extent_end - cur;
+		} else {
+			if (run_len) {
+				ret = read_data_range(fs_info, run_logical,
+						run_len,
+						dest + run_start - file_offset);
+				if (ret < 0)
+					goto out;
+			}
+			run_start = cur;
+			run_logical = logical;
+			run_len = extent_end - cur;
+		}
+		cur = extent_end;
+	}
+	if (run_len) {
+		ret = read_data_range(fs_info, run_logical, run_len,
+				      dest + run_start - file_offset);
 		if (ret < 0)
 			goto out;
-		cur += min(extent_num_bytes, aligned_end - cur);
 	}
 
 	/* Read the tailing unaligned part*/
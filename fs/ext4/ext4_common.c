@@ -193,7 +193,7 @@ uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n)
 	return res;
 }
 
-void put_ext4(uint64_t off, const void *buf, uint32_t size)
+int put_ext4(uint64_t off, const void *buf, uint32_t size)
 {
 	uint64_t startblock;
 	uint64_t remainder;
@@ -207,33 +207,42 @@ void put_ext4(uint64_t off, const void *buf, uint32_t size)
 	remainder = off & (uint64_t)(fs->dev_desc->blksz - 1);
 
 	if (fs->dev_desc == NULL)
-		return;
+		return -1;
 
 	if ((startblock + (size >> log2blksz)) >
 	    (part_offset + fs->total_sect)) {
 		printf("part_offset is " LBAFU "\n", part_offset);
 		printf("total_sector is %llu\n", fs->total_sect);
 		printf("error: overflow occurs\n");
-		return;
+		return -1;
 	}
 
 	if (remainder) {
-		blk_dread(fs->dev_desc, startblock, 1, sec_buf);
+		if (blk_dread(fs->dev_desc, startblock, 1, sec_buf) != 1)
+			return -1;
 		temp_ptr = sec_buf;
 		memcpy((temp_ptr + remainder), (unsigned char *)buf, size);
-		blk_dwrite(fs->dev_desc, startblock, 1, sec_buf);
+		if (blk_dwrite(fs->dev_desc, startblock, 1, sec_buf) != 1)
+			return -1;
 	} else {
 		if (size >> log2blksz != 0) {
-			blk_dwrite(fs->dev_desc, startblock, size >> log2blksz,
-				   (unsigned long *)buf);
+			if (blk_dwrite(fs->dev_desc, startblock,
+				       size >> log2blksz,
+				       (unsigned long *)buf) != size >> log2blksz)
+				return -1;
 		} else {
-			blk_dread(fs->dev_desc, startblock, 1, sec_buf);
+			if (blk_dread(fs->dev_desc, startblock, 1,
+				      sec_buf) != 1)
+				return -1;
 			temp_ptr = sec_buf;
 			memcpy(temp_ptr, buf, size);
-			blk_dwrite(fs->dev_desc, startblock, 1,
-				   (unsigned long *)sec_buf);
+			if (blk_dwrite(fs->dev_desc, startblock, 1,
+				       (unsigned long *)sec_buf) != 1)
+				return -1;
 		}
 	}
+
+	return 0;
 }
 
 static int _get_new_inode_no(unsigned char *buffer)
@@ -1493,6 +1502,233 @@ fail:
 	free(ti_gp_buff_start_addr);
 }
 
+static int ext4fs_bmap_test(const unsigned char *bmap, uint32_t bit)
+{
+	return bmap[bit >> 3] & (1 << (bit & 7));
+}
+
+/*
+ * Find the longest run of free blocks in a block group, stopping early at
+ * @want blocks. The first bit of the run is returned in @bitp.
+ */
+static uint32_t ext4fs_find_free_run(uint32_t bg_idx, uint32_t want,
+				     uint32_t *bitp)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_sblock *sblock = &ext4fs_root->sblock;
+	unsigned char *bmap = fs->blk_bmaps[bg_idx];
+	uint32_t blk_per_grp = le32_to_cpu(sblock->blocks_per_group);
+	uint64_t first = le32_to_cpu(sblock->first_data_block) +
+		(uint64_t)bg_idx * blk_per_grp;
+	uint64_t total = le32_to_cpu(sblock->total_blocks);
+	uint32_t nbits = min(blk_per_grp, (uint32_t)fs->blksz * 8);
+	uint32_t bit, len, best = 0;
+
+	if (first + nbits > total)
+		nbits = total - first;
+	for (bit = 0; bit < nbits; bit += len) {
+		len = 1;
+		if (!(bit & 7) && bmap[bit >> 3] == 0xff) {
+			len = 8;
+			continue;
+		}
+		if (ext4fs_bmap_test(bmap, bit))
+			continue;
+		while (bit + len < nbits && len < want &&
+		       !ext4fs_bmap_test(bmap, bit + len))
+			len++;
+		if (len > best) {
+			best = len;
+			*bitp = bit;
+			if (best == want)
+				break;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Allocate up to @want contiguous blocks. The first block is returned in
+ * @blkp. This prefers the first run that is long enough, otherwise takes
+ * the longest one found. Returns the number of blocks allocated, 0 if the
+ * filesystem is full.
+ */
+static uint32_t ext4fs_alloc_run(uint32_t want, uint64_t *blkp)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_sblock *sblock = &ext4fs_root->sblock;
+	uint32_t blk_per_grp = le32_to_cpu(sblock->blocks_per_group);
+	struct ext2_block_group *bgd;
+	uint32_t i, len, bit, best = 0, best_bit = 0, best_grp = 0;
+	uint64_t b_bitmap_blk;
+	char *journal_buffer;
+	uint32_t blknr;
+
+	for (i = 0; i < fs->no_blkgrp && best < want; i++) {
+		bgd = ext4fs_get_group_descriptor(fs, i);
+		/* Leave uninitialised groups to ext4fs_get_new_blk_no() */
+		if (!ext4fs_bg_get_free_blocks(bgd, fs) ||
+		    (ext4fs_bg_get_flags(bgd) & EXT4_BG_BLOCK_UNINIT))
+			continue;
+		len = ext4fs_find_free_run(i, want, &bit);
+		if (len > best) {
+			best = len;
+			best_bit = bit;
+			best_grp = i;
+		}
+	}
+
+	if (!best) {
+		blknr = ext4fs_get_new_blk_no();
+		if (blknr == -1)
+			return 0;
+		*blkp = blknr;
+		return 1;
+	}
+
+	bgd = ext4fs_get_group_descriptor(fs, best_grp);
+	b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
+	journal_buffer = zalloc(fs->blksz);
+	if (!journal_buffer)
+		return 0;
+	if (!ext4fs_devread(b_bitmap_blk * fs->sect_perblk, 0, fs->blksz,
+			    journal_buffer) ||
+	    ext4fs_log_journal(journal_buffer, b_bitmap_blk)) {
+		free(journal_buffer);
+		return 0;
+	}
+	free(journal_buffer);
+
+	for (bit = best_bit; bit < best_bit + best; bit++) {
+		fs->blk_bmaps[best_grp][bit >> 3] |= 1 << (bit & 7);
+		ext4fs_bg_free_blocks_dec(bgd, fs);
+		ext4fs_sb_free_blocks_dec(fs->sb);
+	}
+	*blkp = le32_to_cpu(sblock->first_data_block) +
+		(uint64_t)best_grp * blk_per_grp + best_bit;
+	debug("EXT4 allocated %u blocks at %llu\n", best,
+	      (unsigned long long)*blkp);
+
+	return best;
+}
+
+static void ext4fs_set_extent(struct ext4_extent *ext, uint32_t fileblock,
+			      uint32_t len, uint64_t blknr)
+{
+	ext->ee_block = cpu_to_le32(fileblock);
+	ext->ee_len = cpu_to_le16(len);
+	ext->ee_start_hi = cpu_to_le16(blknr >> 32);
+	ext->ee_start_lo = cpu_to_le32(blknr & 0xffffffff);
+}
+
+static void ext4fs_set_extent_header(struct ext4_extent_header *eh,
+				     int entries, int max, int depth)
+{
+	eh->eh_magic = cpu_to_le16(EXT4_EXT_MAGIC);
+	eh->eh_entries = cpu_to_le16(entries);
+	eh->eh_max = cpu_to_le16(max);
+	eh->eh_depth = cpu_to_le16(depth);
+	eh->eh_generation = 0;
+}
+
+/*
+ * Allocate the blocks for a new file as a few contiguous runs and map them
+ * with an extent tree. Up to four extents fit in the inode. Beyond that the
+ * inode holds an index of up to four leaf blocks.
+ */
+static void ext4fs_allocate_extents(struct ext2_inode *file_inode,
+				    unsigned int total_remaining_blocks,
+				    unsigned int *total_no_of_block)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext4_extent_header *root =
+		(struct ext4_extent_header *)file_inode->b.blocks.dir_blocks;
+	int root_max = (sizeof(file_inode->b) - sizeof(*root)) /
+		sizeof(struct ext4_extent);
+	int leaf_max = (fs->blksz - sizeof(*root)) / sizeof(struct ext4_extent);
+	int max = root_max * leaf_max;
+	struct ext4_extent *ext, *prev;
+	struct ext4_extent_idx *idx;
+	uint32_t fileblock = 0;
+	int count = 0, leaves, i;
+	char *leaf = NULL;
+
+	ext = calloc(max, sizeof(*ext));
+	if (!ext) {
+		printf("no memory for extents\n");
+		return;
+	}
+
+	while (total_remaining_blocks) {
+		uint64_t blknr;
+		uint32_t len;
+
+		len = ext4fs_alloc_run(min(total_remaining_blocks,
+					   (unsigned int)EXT_INIT_MAX_LEN),
+				       &blknr);
+		if (!len) {
+			printf("no block left to assign\n");
+			goto out;
+		}
+		prev = count ? &ext[count - 1] : NULL;
+		if (prev && le16_to_cpu(prev->ee_len) + len <= EXT_INIT_MAX_LEN &&
+		    ((uint64_t)le16_to_cpu(prev->ee_start_hi) << 32) +
+		    le32_to_cpu(prev->ee_start_lo) + le16_to_cpu(prev->ee_len) ==
+		    blknr) {
+			prev->ee_len = cpu_to_le16(le16_to_cpu(prev->ee_len) +
+						   len);
+		} else if (count == max) {
+			printf("file too fragmented\n");
+			goto out;
+		} else {
+			ext4fs_set_extent(&ext[count++], fileblock, len, blknr);
+		}
+		fileblock += len;
+		total_remaining_blocks -= len;
+	}
+
+	file_inode->flags = cpu_to_le32(le32_to_cpu(file_inode->flags) |
+					EXT4_EXTENTS_FL);
+	if (count <= root_max) {
+		ext4fs_set_extent_header(root, count, root_max, 0);
+		memcpy(root + 1, ext, count * sizeof(*ext));
+		goto out;
+	}
+
+	leaf = zalloc(fs->blksz);
+	if (!leaf)
+		goto out;
+	leaves = DIV_ROUND_UP(count, leaf_max);
+	ext4fs_set_extent_header(root, leaves, root_max, 1);
+	idx = (struct ext4_extent_idx *)(root + 1);
+	for (i = 0; i < leaves; i++) {
+		int n = min(count - i * leaf_max, leaf_max);
+		uint32_t blknr;
+
+		blknr = ext4fs_get_new_blk_no();
+		if (blknr == -1) {
+			printf("no block left to assign\n");
+			goto out;
+		}
+		memset(leaf, '\0', fs->blksz);
+		ext4fs_set_extent_header((struct ext4_extent_header *)leaf, n,
+					 leaf_max, 0);
+		memcpy(leaf + sizeof(*root), &ext[i * leaf_max],
+		       n * sizeof(*ext));
+		put_ext4((uint64_t)blknr * fs->blksz, leaf, fs->blksz);
+
+		idx[i].ei_block = ext[i * leaf_max].ee_block;
+		idx[i].ei_leaf_lo = cpu_to_le32(blknr);
+		idx[i].ei_leaf_hi = 0;
+		idx[i].ei_unused = 0;
+		(*total_no_of_block)++;
+	}
+out:
+	free(leaf);
+	free(ext);
+}
+
 void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 				unsigned int total_remaining_blocks,
 				unsigned int *total_no_of_block)
@@ -1501,6 +1737,13 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 	long int direct_blockno;
 	unsigned int no_blks_reqd = 0;
 
+	if (le32_to_cpu(get_fs()->sb->feature_incompat) &
+	    EXT4_FEATURE_INCOMPAT_EXTENTS) {
+		ext4fs_allocate_extents(file_inode, total_remaining_blocks,
+					total_no_of_block);
+		return;
+	}
+
 	/* allocation of direct blocks */
 	for (i = 0; total_remaining_blocks && i < INDIRECT_BLOCKS; i++) {
 		direct_blockno = ext4fs_get_new_blk_no();
@@ -1995,6 +2238,91 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	return blknr;
 }
 
+/* Map a run of blocks in a file that uses extents */
+static int ext4fs_map_extent(struct ext2_inode *inode, uint32_t fileblock,
+			     uint32_t maxblocks, struct ext_block_cache *cache,
+			     uint64_t *physp)
+{
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	uint32_t startblock, len;
+	uint64_t start;
+	int i;
+
+	ext_block = ext4fs_get_extent_block(ext4fs_root, cache,
+					    (struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock, log2_blksz);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	*physp = 0;
+	extent = (struct ext4_extent *)(ext_block + 1);
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		len = le16_to_cpu(extent[i].ee_len);
+
+		/* A hole up to the next extent */
+		if (startblock > fileblock)
+			return min(startblock - fileblock, maxblocks);
+
+		if (len > EXT_INIT_MAX_LEN)
+			len -= EXT_INIT_MAX_LEN;
+		if (fileblock - startblock >= len)
+			continue;
+
+		/* Uninitialised extents read as zeroes, like holes */
+		if (le16_to_cpu(extent[i].ee_len) <= EXT_INIT_MAX_LEN) {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			*physp = start + fileblock - startblock;
+		}
+
+		return min(startblock + len - fileblock, maxblocks);
+	}
+
+	/*
+	 * The block is past the last extent in this leaf. If this is the only
+	 * leaf the rest of the file is a hole, otherwise the next leaf may
+	 * start at the next block.
+	 */
+	if (ext_block == (struct ext4_extent_header *)inode->b.blocks.dir_blocks)
+		return maxblocks;
+
+	return 1;
+}
+
+int ext4fs_map_blocks(struct ext2_inode *inode, uint32_t fileblock,
+		      uint32_t maxblocks, struct ext_block_cache *cache,
+		      uint64_t *physp)
+{
+	long int blknr, next;
+	uint32_t count;
+
+	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+		return ext4fs_map_extent(inode, fileblock, maxblocks, cache,
+					 physp);
+
+	blknr = read_allocated_block(inode, fileblock, cache);
+	if (blknr < 0)
+		return -EIO;
+	for (count = 1; count < maxblocks; count++) {
+		next = read_allocated_block(inode, fileblock + count, cache);
+		if (next < 0)
+			return -EIO;
+		if (blknr ? next != blknr + count : next != 0)
+			break;
+	}
+	*physp = blknr;
+
+	return count;
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -2042,25 +2370,20 @@ void ext4fs_close(void)
 	ext4fs_reinit_global();
 }
 
-int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
-				struct ext2fs_node **fnode, int *ftype)
+/*
+ * Iterate over the directory entries between byte offsets @fpos and @end,
+ * listing them or looking up @name. Returns 1 if @name was found, else 0.
+ */
+static int ext4fs_iterate_dir_range(struct ext2fs_node *diro,
+				    unsigned int fpos, unsigned int end,
+				    char *name, struct ext2fs_node **fnode,
+				    int *ftype)
 {
-	unsigned int fpos = 0;
 	int status;
 	loff_t actread;
-	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
 
-#ifdef DEBUG
-	if (name != NULL)
-		printf("Iterate dir %s\n", name);
-#endif /* of DEBUG */
-	if (!diro->inode_read) {
-		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
-		if (status == 0)
-			return 0;
-	}
 	/* Search the file.  */
-	while (fpos < le32_to_cpu(diro->inode.size)) {
+	while (fpos < end) {
 		struct ext2_dirent dirent;
 
 		status = ext4fs_read_file(diro, fpos,
@@ -2177,6 +2500,58 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 	return 0;
 }
 
+/* Most leaf blocks followed for names sharing one hash value */
+#define DX_MAX_LEAVES	4
+
+int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
+				struct ext2fs_node **fnode, int *ftype)
+{
+	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
+	uint32_t leaves[DX_MAX_LEAVES];
+	unsigned int blksz;
+	bool more;
+	int status, count, i;
+
+#ifdef DEBUG
+	if (name != NULL)
+		printf("Iterate dir %s\n", name);
+#endif /* of DEBUG */
+	if (!diro->inode_read) {
+		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
+		if (status == 0)
+			return 0;
+	}
+
+	/*
+	 * In an indexed directory only the leaf blocks matching the hash of
+	 * the name need to be searched. If the index cannot be used, or the
+	 * name may lie beyond the leaves found, fall back to a full scan.
+	 * "." and ".." are not in any leaf, but at the start of the first
+	 * block, so the scan finds them straight away.
+	 */
+	if (name && fnode && ftype && strcmp(name, ".") &&
+	    strcmp(name, "..") &&
+	    (le32_to_cpu(diro->inode.flags) & EXT4_INDEX_FL)) {
+		blksz = EXT2_BLOCK_SIZE(diro->data);
+		count = ext4fs_dx_find_leaves(diro, name, leaves,
+					      DX_MAX_LEAVES, &more);
+		for (i = 0; i < count; i++) {
+			status = ext4fs_iterate_dir_range(diro,
+							  leaves[i] * blksz,
+							  (leaves[i] + 1) * blksz,
+							  name, fnode, ftype);
+			if (status)
+				return status;
+		}
+		if (count > 0 && !more)
+			return 0;
+		debug("%s: using linear scan for %s\n", __func__, name);
+	}
+
+	return ext4fs_iterate_dir_range(diro, 0, le32_to_cpu(diro->inode.size),
+					name, fnode, ftype);
+}
+
 static char *ext4fs_read_symlink(struct ext2fs_node *node)
 {
 	char *symlink;
@@ -52,11 +52,46 @@ int ext4fs_read_inode(struct ext2_data *data, int ino,
 		      struct ext2_inode *inode);
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos, loff_t len,
 		     char *buf, loff_t *actread);
+
+/**
+ * ext4fs_map_blocks() - Map a run of file blocks to filesystem blocks
+ *
+ * This finds how many blocks starting at @fileblock are stored contiguously
+ * on disk, or are all holes, so that they can be read in one go.
+ *
+ * @inode: Inode of the file
+ * @fileblock: First block in the file to map
+ * @maxblocks: Maximum number of blocks to map (must be at least 1)
+ * @cache: Cache for extent-tree blocks
+ * @physp: Returns the filesystem block holding @fileblock, or 0 if the run
+ *	is a hole or an uninitialised extent, which read as zeroes
+ * @return number of blocks in the run (1 to @maxblocks), or -ve on error
+ */
+int ext4fs_map_blocks(struct ext2_inode *inode, uint32_t fileblock,
+		      uint32_t maxblocks, struct ext_block_cache *cache,
+		      uint64_t *physp);
 int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int expecttype);
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
 
+/**
+ * ext4fs_dx_find_leaves() - Use a directory's hash index to find a name
+ *
+ * Hashes @name and walks the dir_index tree of @dir down to the leaf block
+ * which would hold it, plus any following leaves holding names with the
+ * same hash.
+ *
+ * @dir: Directory, which must have EXT4_INDEX_FL set
+ * @name: Name to look up
+ * @blocks: Returns the blocks within the directory to search
+ * @max: Size of @blocks
+ * @morep: Returns true if further leaves, not listed, may hold the name
+ * @return number of blocks in @blocks, or -ve if the index is unusable
+ */
+int ext4fs_dx_find_leaves(struct ext2fs_node *dir, const char *name,
+			  uint32_t *blocks, int max, bool *morep);
+
 #if defined(CONFIG_EXT4_WRITE)
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
 uint16_t ext4fs_checksum_update(unsigned int i);
@@ -73,7 +108,7 @@ int ext4fs_iget(int inode_no, struct ext2_inode *inode);
 void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 				unsigned int total_remaining_blocks,
 				unsigned int *total_no_of_block);
-void put_ext4(uint64_t off, const void *buf, uint32_t size);
+int put_ext4(uint64_t off, const void *buf, uint32_t size);
 struct ext2_block_group *ext4fs_get_group_descriptor
 	(const struct ext_filesystem *fs, uint32_t bg_idx);
 uint64_t ext4fs_bg_get_block_id(const struct ext2_block_group *bg,
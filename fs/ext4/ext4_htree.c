@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Hashed directory (dir_index) lookup for ext4
+ *
+ * Large directories have a tree of index blocks, sorted by a hash of the
+ * file name, which point to the leaf blocks holding the directory entries.
+ * A lookup only needs to read the blocks on the path to one leaf. The hash
+ * functions must match those used by Linux (fs/ext4/hash.c) bit for bit.
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <ext_common.h>
+#include <ext4fs.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/byteorder.h>
+#include "ext4_common.h"
+
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+
+/* Superblock flag: the hash treats names as unsigned chars */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+/* The largest hash value; used to mark the end of a directory */
+#define DX_HASH_EOF			0x7fffffff
+
+/* Most index levels below the root (two needs the largedir feature) */
+#define DX_MAX_LEVELS			2
+
+struct dx_root_info {
+	__le32 reserved_zero;
+	u8 hash_version;
+	u8 info_length;
+	u8 indirect_levels;
+	u8 unused_flags;
+};
+
+/*
+ * Index entries. The first entry of each index block holds the limit and
+ * count in place of its hash.
+ */
+struct dx_entry {
+	__le32 hash;
+	__le32 block;
+};
+
+struct dx_countlimit {
+	__le16 limit;
+	__le16 count;
+};
+
+/* The root block starts with the "." and ".." entries, 12 bytes each */
+#define DX_ROOT_INFO_OFFSET	24
+
+/* Other index blocks start with an empty entry covering the whole block */
+#define DX_NODE_OFFSET		8
+
+#define DELTA		0x9e3779b9
+
+static void tea_transform(u32 buf[4], const u32 in[4])
+{
+	u32 sum = 0;
+	u32 b0 = buf[0], b1 = buf[1];
+	u32 a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* Selection, majority and parity functions from MD4 */
+#define F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z)	(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z)	((x) ^ (y) ^ (z))
+
+#define MD4_ROUND(f, a, b, c, d, x, s)	\
+	(a += f(b, c, d) + (x), a = ((a) << (s)) | ((a) >> (32 - (s))))
+#define K1	0
+#define K2	013240474631UL
+#define K3	015666365641UL
+
+/* MD4 cut down to three rounds of eight steps */
+static void half_md4_transform(u32 buf[4], const u32 in[8])
+{
+	u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	MD4_ROUND(F, a, b, c, d, in[0] + K1, 3);
+	MD4_ROUND(F, d, a, b, c, in[1] + K1, 7);
+	MD4_ROUND(F, c, d, a, b, in[2] + K1, 11);
+	MD4_ROUND(F, b, c, d, a, in[3] + K1, 19);
+	MD4_ROUND(F, a, b, c, d, in[4] + K1, 3);
+	MD4_ROUND(F, d, a, b, c, in[5] + K1, 7);
+	MD4_ROUND(F, c, d, a, b, in[6] + K1, 11);
+	MD4_ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+	MD4_ROUND(G, a, b, c, d, in[1] + K2, 3);
+	MD4_ROUND(G, d, a, b, c, in[3] + K2, 5);
+	MD4_ROUND(G, c, d, a, b, in[5] + K2, 9);
+	MD4_ROUND(G, b, c, d, a, in[7] + K2, 13);
+	MD4_ROUND(G, a, b, c, d, in[0] + K2, 3);
+	MD4_ROUND(G, d, a, b, c, in[2] + K2, 5);
+	MD4_ROUND(G, c, d, a, b, in[4] + K2, 9);
+	MD4_ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+	MD4_ROUND(H, a, b, c, d, in[3] + K3, 3);
+	MD4_ROUND(H, d, a, b, c, in[7] + K3, 9);
+	MD4_ROUND(H, c, d, a, b, in[2] + K3, 11);
+	MD4_ROUND(H, b, c, d, a, in[6] + K3, 15);
+	MD4_ROUND(H, a, b, c, d, in[1] + K3, 3);
+	MD4_ROUND(H, d, a, b, c, in[5] + K3, 9);
+	MD4_ROUND(H, c, d, a, b, in[0] + K3, 11);
+	MD4_ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+static u32 dx_hack_hash(const char *name, int len, bool unsigned_chars)
+{
+	u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	int i, c;
+
+	for (i = 0; i < len; i++) {
+		c = unsigned_chars ? (int)(unsigned char)name[i] :
+			(int)(signed char)name[i];
+		hash = hash1 + (hash0 ^ (c * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+/* Pack up to @num words of the name into @buf, padded with its length */
+static void str2hashbuf(const char *msg, int len, u32 *buf, int num,
+			bool unsigned_chars)
+{
+	u32 pad, val;
+	int i, c;
+
+	pad = (u32)len | ((u32)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4)
+		len = num * 4;
+	for (i = 0; i < len; i++) {
+		c = unsigned_chars ? (int)(unsigned char)msg[i] :
+			(int)(signed char)msg[i];
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+/**
+ * ext4fs_dirhash() - Calculate the hash of a file name
+ *
+ * @name: File name
+ * @len: Length of @name
+ * @version: Hash algorithm (DX_HASH_...)
+ * @seed: Hash seed from the superblock
+ * @hashp: Returns the hash
+ * @return 0 if OK, -ENOSYS if the hash algorithm is not supported
+ */
+static int ext4fs_dirhash(const char *name, int len, int version,
+			  const __le32 seed[4], u32 *hashp)
+{
+	u32 buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+	bool unsigned_chars = false;
+	u32 in[8], hash;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (seed[i])
+			break;
+	}
+	if (i < 4) {
+		for (i = 0; i < 4; i++)
+			buf[i] = le32_to_cpu(seed[i]);
+	}
+
+	switch (version) {
+	case DX_HASH_LEGACY_UNSIGNED:
+		unsigned_chars = true;
+		fallthrough;
+	case DX_HASH_LEGACY:
+		hash = dx_hack_hash(name, len, unsigned_chars);
+		break;
+	case DX_HASH_HALF_MD4_UNSIGNED:
+		unsigned_chars = true;
+		fallthrough;
+	case DX_HASH_HALF_MD4:
+		for (; len > 0; len -= 32, name += 32) {
+			str2hashbuf(name, len, in, 8, unsigned_chars);
+			half_md4_transform(buf, in);
+		}
+		hash = buf[1];
+		break;
+	case DX_HASH_TEA_UNSIGNED:
+		unsigned_chars = true;
+		fallthrough;
+	case DX_HASH_TEA:
+		for (; len > 0; len -= 16, name += 16) {
+			str2hashbuf(name, len, in, 4, unsigned_chars);
+			tea_transform(buf, in);
+		}
+		hash = buf[0];
+		break;
+	default:
+		return -ENOSYS;
+	}
+
+	hash &= ~1;
+	if (hash == DX_HASH_EOF << 1)
+		hash = (DX_HASH_EOF - 1) << 1;
+	*hashp = hash;
+
+	return 0;
+}
+
+/* Find the last entry with a hash not above @hash */
+static struct dx_entry *dx_search(struct dx_entry *entries, int count,
+				  u32 hash)
+{
+	struct dx_entry *p = entries + 1, *q = entries + count - 1, *m;
+
+	while (p <= q) {
+		m = p + (q - p) / 2;
+		if (le32_to_cpu(m->hash) > hash)
+			q = m - 1;
+		else
+			p = m + 1;
+	}
+
+	return p - 1;
+}
+
+int ext4fs_dx_find_leaves(struct ext2fs_node *dir, const char *name,
+			  uint32_t *blocks, int max, bool *morep)
+{
+	struct ext2_sblock *sblock = &dir->data->sblock;
+	int blksz = EXT2_BLOCK_SIZE(dir->data);
+	struct dx_countlimit *cl;
+	struct dx_root_info *info;
+	struct dx_entry *entries, *at, *end;
+	int version, depth, levels, count, ret, n;
+	loff_t actread;
+	u32 hash;
+	char *buf;
+
+	buf = malloc(blksz);
+	if (!buf)
+		return -ENOMEM;
+	ret = -EINVAL;
+	if (ext4fs_read_file(dir, 0, blksz, buf, &actread) || actread != blksz)
+		goto out;
+
+	info = (struct dx_root_info *)(buf + DX_ROOT_INFO_OFFSET);
+	/* buf is reused for the lower index blocks, so keep what is needed */
+	depth = info->indirect_levels;
+	levels = depth;
+	if (info->reserved_zero || info->unused_flags ||
+	    info->info_length < sizeof(*info) || levels > DX_MAX_LEVELS)
+		goto out;
+	version = info->hash_version;
+	if (version <= DX_HASH_TEA &&
+	    (le32_to_cpu(sblock->flags) & EXT2_FLAGS_UNSIGNED_HASH))
+		version += DX_HASH_LEGACY_UNSIGNED;
+	ret = ext4fs_dirhash(name, strlen(name), version, sblock->hash_seed,
+			     &hash);
+	if (ret)
+		goto out;
+	entries = (struct dx_entry *)((char *)info + info->info_length);
+
+	/* Walk down the index to the node which points to the leaf */
+	while (1) {
+		cl = (struct dx_countlimit *)entries;
+		count = le16_to_cpu(cl->count);
+		ret = -EINVAL;
+		if (!count || count > le16_to_cpu(cl->limit) ||
+		    (char *)(entries + count) > buf + blksz)
+			goto out;
+		at = dx_search(entries, count, hash);
+		if (!levels--)
+			break;
+		if (ext4fs_read_file(dir, (loff_t)(le32_to_cpu(at->block) &
+				     0x0fffffff) * blksz, blksz, buf,
+				     &actread) || actread != blksz)
+			goto out;
+		entries = (struct dx_entry *)(buf + DX_NODE_OFFSET);
+	}
+
+	/*
+	 * Names with the same hash may run on into the following leaves,
+	 * whose hash then has the low bit set
+	 */
+	end = entries + count;
+	blocks[0] = le32_to_cpu(at->block) & 0x0fffffff;
+	for (n = 1, at++; at < end && n < max; at++, n++) {
+		if ((le32_to_cpu(at->hash) & ~1) != hash ||
+		    !(le32_to_cpu(at->hash) & 1))
+			break;
+		blocks[n] = le32_to_cpu(at->block) & 0x0fffffff;
+	}
+	/*
+	 * The run may carry on past this index block, which is not followed,
+	 * or past the most leaves the caller asked for
+	 */
+	*morep = (at == end && depth) || n == max;
+	ret = n;
+	debug("%s: hash %x leaf %u, %d blocks\n", name, hash, blocks[0], n);
+out:
+	free(buf);
+
+	return ret;
+}
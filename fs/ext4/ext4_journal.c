@@ -18,6 +18,8 @@
 #include <ext4fs.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
+#include <sort.h>
 #include <ext_common.h>
 #include "ext4_common.h"
 
@@ -28,14 +30,45 @@ static int first_node = true;
 int gindex;
 int gd_index;
 int jrnl_blk_idx;
+/* Number of transactions written since ext4fs_init_journal() */
+static int jrnl_trans_cnt;
 struct journal_log *journal_ptr[MAX_JOURNAL_ENTRIES];
 struct dirty_blocks *dirty_block_ptr[MAX_JOURNAL_ENTRIES];
 
+/* Every transaction updates the superblock, so log the block holding it */
+static int ext4fs_log_superblock(void)
+{
+	struct ext_filesystem *fs = get_fs();
+	char *temp;
+
+	if (fs->blksz == 4096) {
+		temp = zalloc(fs->blksz);
+		if (!temp)
+			return -ENOMEM;
+		journal_ptr[gindex]->buf = zalloc(fs->blksz);
+		if (!journal_ptr[gindex]->buf) {
+			free(temp);
+			return -ENOMEM;
+		}
+		ext4fs_devread(0, 0, fs->blksz, temp);
+		memcpy(temp + SUPERBLOCK_SIZE, fs->sb, SUPERBLOCK_SIZE);
+		memcpy(journal_ptr[gindex]->buf, temp, fs->blksz);
+		journal_ptr[gindex++]->blknr = 0;
+		free(temp);
+	} else {
+		journal_ptr[gindex]->buf = zalloc(fs->blksz);
+		if (!journal_ptr[gindex]->buf)
+			return -ENOMEM;
+		memcpy(journal_ptr[gindex]->buf, fs->sb, SUPERBLOCK_SIZE);
+		journal_ptr[gindex++]->blknr = 1;
+	}
+
+	return 0;
+}
+
 int ext4fs_init_journal(void)
 {
 	int i;
-	char *temp = NULL;
-	struct ext_filesystem *fs = get_fs();
 
 	/* init globals */
 	revk_blk_list = NULL;
@@ -43,6 +76,7 @@ int ext4fs_init_journal(void)
 	gindex = 0;
 	gd_index = 0;
 	jrnl_blk_idx = 1;
+	jrnl_trans_cnt = 0;
 
 	for (i = 0; i < MAX_JOURNAL_ENTRIES; i++) {
 		journal_ptr[i] = zalloc(sizeof(struct journal_log));
@@ -58,25 +92,8 @@ int ext4fs_init_journal(void)
 		dirty_block_ptr[i]->blknr = -1;
 	}
 
-	if (fs->blksz == 4096) {
-		temp = zalloc(fs->blksz);
-		if (!temp)
-			goto fail;
-		journal_ptr[gindex]->buf = zalloc(fs->blksz);
-		if (!journal_ptr[gindex]->buf)
-			goto fail;
-		ext4fs_devread(0, 0, fs->blksz, temp);
-		memcpy(temp + SUPERBLOCK_SIZE, fs->sb, SUPERBLOCK_SIZE);
-		memcpy(journal_ptr[gindex]->buf, temp, fs->blksz);
-		journal_ptr[gindex++]->blknr = 0;
-		free(temp);
-	} else {
-		journal_ptr[gindex]->buf = zalloc(fs->blksz);
-		if (!journal_ptr[gindex]->buf)
-			goto fail;
-		memcpy(journal_ptr[gindex]->buf, fs->sb, SUPERBLOCK_SIZE);
-		journal_ptr[gindex++]->blknr = 1;
-	}
+	if (ext4fs_log_superblock())
+		goto fail;
 
 	/* Check the file system state using journal super block */
 	if (ext4fs_check_journal_state(SCAN))
@@ -90,17 +107,70 @@ fail:
 	return -1;
 }
 
+static int dirty_block_cmp(const void *a, const void *b)
+{
+	const struct dirty_blocks *da = *(const struct dirty_blocks **)a;
+	const struct dirty_blocks *db = *(const struct dirty_blocks **)b;
+
+	return da->blknr < db->blknr ? -1 : da->blknr > db->blknr;
+}
+
+/*
+ * Write out the dirty metadata blocks in order of block number. Each run of
+ * neighbouring blocks is written with a single put_ext4() call.
+ */
 void ext4fs_dump_metadata(void)
 {
 	struct ext_filesystem *fs = get_fs();
+	int i, j, n;
+	char *buf;
+
+	if (!gd_index)
+		return;
+	qsort(dirty_block_ptr, gd_index, sizeof(*dirty_block_ptr),
+	      dirty_block_cmp);
+
+	buf = malloc_cache_aligned(gd_index * fs->blksz);
+	for (i = 0; i < gd_index; i += n) {
+		for (n = 1; buf && i + n < gd_index; n++) {
+			if (dirty_block_ptr[i + n]->blknr !=
+			    dirty_block_ptr[i]->blknr + n)
+				break;
+		}
+		if (n == 1) {
+			put_ext4((uint64_t)dirty_block_ptr[i]->blknr * fs->blksz,
+				 dirty_block_ptr[i]->buf, fs->blksz);
+			continue;
+		}
+		for (j = 0; j < n; j++)
+			memcpy(buf + j * fs->blksz, dirty_block_ptr[i + j]->buf,
+			       fs->blksz);
+		put_ext4((uint64_t)dirty_block_ptr[i]->blknr * fs->blksz, buf,
+			 n * fs->blksz);
+	}
+	free(buf);
+}
+
+/*
+ * Drop the blocks logged and dirtied by the last transaction and start a new
+ * one
+ */
+int ext4fs_reset_transaction(void)
+{
 	int i;
+
 	for (i = 0; i < MAX_JOURNAL_ENTRIES; i++) {
-		if (dirty_block_ptr[i]->blknr == -1)
-			break;
-		put_ext4((uint64_t) ((uint64_t)dirty_block_ptr[i]->blknr *
-				(uint64_t)fs->blksz), dirty_block_ptr[i]->buf,
-								fs->blksz);
+		free(journal_ptr[i]->buf);
+		journal_ptr[i]->buf = NULL;
+		journal_ptr[i]->blknr = -1;
+		free(dirty_block_ptr[i]->buf);
+		dirty_block_ptr[i]->buf = NULL;
+		dirty_block_ptr[i]->blknr = -1;
 	}
+	gindex = 0;
+	gd_index = 0;
+
+	return ext4fs_log_superblock();
 }
 
 void ext4fs_free_journal(void)
@@ -165,6 +235,8 @@ int ext4fs_log_journal(char *journal_buffer, uint32_t blknr)
 		if (journal_ptr[i]->blknr == blknr)
 			return 0;
 	}
+	if (gindex == MAX_JOURNAL_ENTRIES)
+		return -ENOSPC;
 
 	journal_ptr[gindex]->buf = zalloc(fs->blksz);
 	if (!journal_ptr[gindex]->buf)
@@ -184,19 +256,27 @@ int ext4fs_log_journal(char *journal_buffer, uint32_t blknr)
 int ext4fs_put_metadata(char *metadata_buffer, uint32_t blknr)
 {
 	struct ext_filesystem *fs = get_fs();
+	int i;
+
 	if (!metadata_buffer) {
 		printf("Invalid input arguments %s\n", __func__);
 		return -EINVAL;
 	}
-	if (dirty_block_ptr[gd_index]->buf)
-		assert(dirty_block_ptr[gd_index]->blknr == blknr);
-	else
-		dirty_block_ptr[gd_index]->buf = zalloc(fs->blksz);
-
-	if (!dirty_block_ptr[gd_index]->buf)
+	/* A block written twice in a transaction only needs writing once */
+	for (i = 0; i < gd_index; i++) {
+		if (dirty_block_ptr[i]->blknr == blknr)
+			break;
+	}
+	if (i == MAX_JOURNAL_ENTRIES)
+		return -ENOSPC;
+	if (!dirty_block_ptr[i]->buf)
+		dirty_block_ptr[i]->buf = zalloc(fs->blksz);
+	if (!dirty_block_ptr[i]->buf)
 		return -ENOMEM;
-	memcpy(dirty_block_ptr[gd_index]->buf, metadata_buffer, fs->blksz);
-	dirty_block_ptr[gd_index++]->blknr = blknr;
+	memcpy(dirty_block_ptr[i]->buf, metadata_buffer, fs->blksz);
+	dirty_block_ptr[i]->blknr = blknr;
+	if (i == gd_index)
+		gd_index++;
 
 	return 0;
 }
@@ -550,117 +630,132 @@ end:
 	return 0;
 }
 
-static void update_descriptor_block(long int blknr)
+static void fill_descriptor_block(char *buf, __be32 sequence)
 {
-	int i;
-	long int jsb_blknr;
 	struct journal_header_t jdb;
 	struct ext3_journal_block_tag tag;
-	struct ext2_inode inode_journal;
-	struct journal_superblock_t *jsb = NULL;
-	char *buf = NULL;
-	char *temp = NULL;
-	struct ext_filesystem *fs = get_fs();
-	char *temp_buff = zalloc(fs->blksz);
-	if (!temp_buff)
-		return;
-
-	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO, &inode_journal);
-	jsb_blknr = read_allocated_block(&inode_journal,
-					 EXT2_JOURNAL_SUPERBLOCK, NULL);
-	ext4fs_devread((lbaint_t)jsb_blknr * fs->sect_perblk, 0, fs->blksz,
-		       temp_buff);
-	jsb = (struct journal_superblock_t *) temp_buff;
+	int i;
 
 	jdb.h_blocktype = cpu_to_be32(EXT3_JOURNAL_DESCRIPTOR_BLOCK);
 	jdb.h_magic = cpu_to_be32(EXT3_JOURNAL_MAGIC_NUMBER);
-	jdb.h_sequence = jsb->s_sequence;
-	buf = zalloc(fs->blksz);
-	if (!buf) {
-		free(temp_buff);
-		return;
-	}
-	temp = buf;
+	jdb.h_sequence = sequence;
 	memcpy(buf, &jdb, sizeof(struct journal_header_t));
-	temp += sizeof(struct journal_header_t);
-
-	for (i = 0; i < MAX_JOURNAL_ENTRIES; i++) {
-		if (journal_ptr[i]->blknr == -1)
-			break;
+	buf += sizeof(struct journal_header_t);
 
+	for (i = 0; i < gindex; i++) {
 		tag.block = cpu_to_be32(journal_ptr[i]->blknr);
-		tag.flags = cpu_to_be32(EXT3_JOURNAL_FLAG_SAME_UUID);
-		memcpy(temp, &tag, sizeof(struct ext3_journal_block_tag));
-		temp = temp + sizeof(struct ext3_journal_block_tag);
+		tag.flags = cpu_to_be32(i == gindex - 1 ?
+					EXT3_JOURNAL_FLAG_LAST_TAG :
+					EXT3_JOURNAL_FLAG_SAME_UUID);
+		memcpy(buf, &tag, sizeof(struct ext3_journal_block_tag));
+		buf += sizeof(struct ext3_journal_block_tag);
 	}
+}
 
-	tag.block = cpu_to_be32(journal_ptr[--i]->blknr);
-	tag.flags = cpu_to_be32(EXT3_JOURNAL_FLAG_LAST_TAG);
-	memcpy(temp - sizeof(struct ext3_journal_block_tag), &tag,
-	       sizeof(struct ext3_journal_block_tag));
-	put_ext4((uint64_t) ((uint64_t)blknr * (uint64_t)fs->blksz), buf, (uint32_t) fs->blksz);
+static void fill_commit_block(char *buf, __be32 sequence)
+{
+	struct journal_header_t jdb;
 
-	free(temp_buff);
-	free(buf);
+	jdb.h_blocktype = cpu_to_be32(EXT3_JOURNAL_COMMIT_BLOCK);
+	jdb.h_magic = cpu_to_be32(EXT3_JOURNAL_MAGIC_NUMBER);
+	jdb.h_sequence = sequence;
+	memcpy(buf, &jdb, sizeof(struct journal_header_t));
 }
 
-static void update_commit_block(long int blknr)
+/*
+ * Write the logged blocks to the journal as one transaction: a descriptor
+ * block, the blocks themselves and a commit block. These are built in one
+ * buffer and written with one put_ext4() call for each contiguous part of
+ * the journal.
+ */
+void ext4fs_update_journal(void)
 {
-	struct journal_header_t jdb;
-	struct ext_filesystem *fs = get_fs();
-	char *buf = NULL;
 	struct ext2_inode inode_journal;
+	struct ext_filesystem *fs = get_fs();
 	struct journal_superblock_t *jsb;
+	struct ext_block_cache cache;
+	uint32_t count = gindex + 2;
 	long int jsb_blknr;
-	char *temp_buff = zalloc(fs->blksz);
-	if (!temp_buff)
+	__be32 sequence;
+	uint64_t blknr;
+	char *buf;
+	int i, n;
+
+	if (!(fs->sb->feature_compatibility & EXT4_FEATURE_COMPAT_HAS_JOURNAL))
+		return;
+	if (!gindex)
 		return;
 
-	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO,
-			  &inode_journal);
+	buf = malloc_cache_aligned(count * fs->blksz);
+	if (!buf)
+		return;
+	memset(buf, '\0', count * fs->blksz);
+
+	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO, &inode_journal);
 	jsb_blknr = read_allocated_block(&inode_journal,
 					 EXT2_JOURNAL_SUPERBLOCK, NULL);
 	ext4fs_devread((lbaint_t)jsb_blknr * fs->sect_perblk, 0, fs->blksz,
-		       temp_buff);
-	jsb = (struct journal_superblock_t *) temp_buff;
-
-	jdb.h_blocktype = cpu_to_be32(EXT3_JOURNAL_COMMIT_BLOCK);
-	jdb.h_magic = cpu_to_be32(EXT3_JOURNAL_MAGIC_NUMBER);
-	jdb.h_sequence = jsb->s_sequence;
-	buf = zalloc(fs->blksz);
-	if (!buf) {
-		free(temp_buff);
-		return;
+		       buf);
+	jsb = (struct journal_superblock_t *)buf;
+	sequence = cpu_to_be32(be32_to_cpu(jsb->s_sequence) + jrnl_trans_cnt);
+	memset(buf, '\0', fs->blksz);
+
+	fill_descriptor_block(buf, sequence);
+	for (i = 0; i < gindex; i++)
+		memcpy(buf + (i + 1) * fs->blksz, journal_ptr[i]->buf,
+		       fs->blksz);
+	fill_commit_block(buf + (count - 1) * fs->blksz, sequence);
+
+	ext_cache_init(&cache);
+	for (i = 0; i < count; i += n) {
+		n = ext4fs_map_blocks(&inode_journal, jrnl_blk_idx + i,
+				      count - i, &cache, &blknr);
+		if (n < 0 || !blknr)
+			break;
+		put_ext4(blknr * fs->blksz, buf + i * fs->blksz,
+			 n * fs->blksz);
 	}
-	memcpy(buf, &jdb, sizeof(struct journal_header_t));
-	put_ext4((uint64_t) ((uint64_t)blknr * (uint64_t)fs->blksz), buf, (uint32_t) fs->blksz);
-
-	free(temp_buff);
+	ext_cache_fini(&cache);
+	jrnl_blk_idx += count;
+	jrnl_trans_cnt++;
 	free(buf);
+	printf("update journal finished\n");
 }
 
-void ext4fs_update_journal(void)
+/*
+ * Mark the journal as empty, once all metadata has been written in place.
+ * The next transaction follows on from the ones written since
+ * ext4fs_init_journal(). Returns 0 on success, -1 on failure.
+ */
+int ext4fs_checkpoint_journal(void)
 {
 	struct ext2_inode inode_journal;
 	struct ext_filesystem *fs = get_fs();
+	struct journal_superblock_t *jsb;
 	long int blknr;
-	int i;
-
-	if (!(fs->sb->feature_compatibility & EXT4_FEATURE_COMPAT_HAS_JOURNAL))
-		return;
+	char *temp_buff;
+	int ret = -1;
 
+	temp_buff = zalloc(fs->blksz);
+	if (!temp_buff)
+		return -1;
 	ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO, &inode_journal);
-	blknr = read_allocated_block(&inode_journal, jrnl_blk_idx++, NULL);
-	update_descriptor_block(blknr);
-	for (i = 0; i < MAX_JOURNAL_ENTRIES; i++) {
-		if (journal_ptr[i]->blknr == -1)
-			break;
-		blknr = read_allocated_block(&inode_journal, jrnl_blk_idx++,
-					     NULL);
-		put_ext4((uint64_t) ((uint64_t)blknr * (uint64_t)fs->blksz),
-			 journal_ptr[i]->buf, fs->blksz);
-	}
-	blknr = read_allocated_block(&inode_journal, jrnl_blk_idx++, NULL);
-	update_commit_block(blknr);
-	printf("update journal finished\n");
+	blknr = read_allocated_block(&inode_journal, EXT2_JOURNAL_SUPERBLOCK,
+				     NULL);
+	if (blknr <= 0 ||
+	    !ext4fs_devread((lbaint_t)blknr * fs->sect_perblk, 0, fs->blksz,
+			    temp_buff))
+		goto fail;
+	jsb = (struct journal_superblock_t *)temp_buff;
+	jsb->s_start = 0;
+	jsb->s_sequence = cpu_to_be32(be32_to_cpu(jsb->s_sequence) +
+				      jrnl_trans_cnt);
+	if (put_ext4((uint64_t)blknr * fs->blksz, temp_buff, fs->blksz))
+		goto fail;
+	jrnl_trans_cnt = 0;
+	ret = 0;
+fail:
+	free(temp_buff);
+
+	return ret;
 }
@@ -120,7 +120,9 @@ int ext4fs_check_journal_state(int recovery_flag);
 int ext4fs_log_journal(char *journal_buffer, uint32_t blknr);
 int ext4fs_put_metadata(char *metadata_buffer, uint32_t blknr);
 void ext4fs_update_journal(void);
+int ext4fs_checkpoint_journal(void);
 void ext4fs_dump_metadata(void);
+int ext4fs_reset_transaction(void);
 void ext4fs_push_revoke_blk(char *buffer);
 void ext4fs_free_journal(void);
 void ext4fs_free_revoke_blks(void);
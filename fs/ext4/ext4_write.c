@@ -29,6 +29,7 @@
 #include <part.h>
 #include <linux/stat.h>
 #include <div64.h>
+#include <u-boot/crc.h>
 #include "ext4_common.h"
 
 static inline void ext4fs_sb_free_inodes_inc(struct ext2_sblock *sb)
@@ -67,6 +68,24 @@ static inline void ext4fs_bg_free_blocks_inc
 		bg->free_blocks_high = cpu_to_le16(free_blocks >> 16);
 }
 
+/* Add a bitmap to the blocks to write if it has changed since last written */
+static void ext4fs_update_bmap(unsigned char *bmap, uint32_t *crcp,
+			       uint64_t blknr)
+{
+	struct ext_filesystem *fs = get_fs();
+	uint32_t crc = crc32(0, bmap, fs->blksz);
+
+	if (crc == *crcp)
+		return;
+	*crcp = crc;
+	if (ext4fs_put_metadata((char *)bmap, blknr))
+		put_ext4(blknr * fs->blksz, bmap, fs->blksz);
+}
+
+/*
+ * Commit the current transaction: write it to the journal, then write the
+ * superblock, group descriptors and all changed metadata blocks in place
+ */
 static void ext4fs_update(void)
 {
 	short i;
@@ -78,21 +97,14 @@ static void ext4fs_update(void)
 	put_ext4((uint64_t)(SUPERBLOCK_SIZE),
 		 (struct ext2_sblock *)fs->sb, (uint32_t)SUPERBLOCK_SIZE);
 
-	/* update block bitmaps */
+	/* update block and inode bitmaps */
 	for (i = 0; i < fs->no_blkgrp; i++) {
 		bgd = ext4fs_get_group_descriptor(fs, i);
 		bgd->bg_checksum = cpu_to_le16(ext4fs_checksum_update(i));
-		uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
-		put_ext4(b_bitmap_blk * fs->blksz,
-			 fs->blk_bmaps[i], fs->blksz);
-	}
-
-	/* update inode bitmaps */
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		bgd = ext4fs_get_group_descriptor(fs, i);
-		uint64_t i_bitmap_blk = ext4fs_bg_get_inode_id(bgd, fs);
-		put_ext4(i_bitmap_blk * fs->blksz,
-			 fs->inode_bmaps[i], fs->blksz);
+		ext4fs_update_bmap(fs->blk_bmaps[i], &fs->blk_bmap_crcs[i],
+				   ext4fs_bg_get_block_id(bgd, fs));
+		ext4fs_update_bmap(fs->inode_bmaps[i], &fs->inode_bmap_crcs[i],
+				   ext4fs_bg_get_inode_id(bgd, fs));
 	}
 
 	/* update the block group descriptor table */
@@ -101,9 +113,7 @@ static void ext4fs_update(void)
 		 (fs->blksz * fs->no_blk_pergdt));
 
 	ext4fs_dump_metadata();
-
-	gindex = 0;
-	gd_index = 0;
+	ext4fs_reset_transaction();
 }
 
 int ext4fs_get_bgdtable(void)
@@ -435,6 +445,41 @@ fail:
 	free(journal_buffer);
 }
 
+/* Release the leaf blocks of an extent tree with one level of index */
+static int delete_extent_leaves(struct ext4_extent_header *eh,
+				char *journal_buffer)
+{
+	struct ext4_extent_idx *idx = (struct ext4_extent_idx *)(eh + 1);
+	uint32_t blk_per_grp = le32_to_cpu(ext4fs_root->sblock.blocks_per_group);
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_block_group *bgd;
+	uint64_t b_bitmap_blk;
+	long int blknr;
+	int i, bg_idx;
+
+	for (i = 0; i < le16_to_cpu(eh->eh_entries); i++) {
+		blknr = le32_to_cpu(idx[i].ei_leaf_lo);
+		bg_idx = blknr / blk_per_grp;
+		if (fs->blksz == 1024 && !(blknr % blk_per_grp))
+			bg_idx--;
+		ext4fs_reset_block_bmap(blknr, fs->blk_bmaps[bg_idx], bg_idx);
+		debug("EXT4 extent leaf releasing %ld: %d\n", blknr, bg_idx);
+
+		bgd = ext4fs_get_group_descriptor(fs, bg_idx);
+		ext4fs_bg_free_blocks_inc(bgd, fs);
+		ext4fs_sb_free_blocks_inc(fs->sb);
+		/* journal backup */
+		b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
+		if (!ext4fs_devread(b_bitmap_blk * fs->sect_perblk, 0,
+				    fs->blksz, journal_buffer))
+			return -EIO;
+		if (ext4fs_log_journal(journal_buffer, b_bitmap_blk))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
 static int ext4fs_delete_file(int inodeno)
 {
 	struct ext2_inode inode;
@@ -457,9 +502,11 @@ static int ext4fs_delete_file(int inodeno)
 	struct ext2_inode *inode_buffer = NULL;
 	struct ext2_block_group *bgd = NULL;
 	struct ext_filesystem *fs = get_fs();
+	struct ext_block_cache cache;
 	char *journal_buffer = zalloc(fs->blksz);
 	if (!journal_buffer)
 		return -ENOMEM;
+	ext_cache_init(&cache);
 	status = ext4fs_read_inode(ext4fs_root, inodeno, &inode);
 	if (status == 0)
 		goto fail;
@@ -479,11 +526,14 @@ static int ext4fs_delete_file(int inodeno)
 	}
 
 	if (le32_to_cpu(inode.flags) & EXT4_EXTENTS_FL) {
-		/* FIXME delete extent index blocks, i.e. eh_depth >= 1 */
+		/* FIXME delete extent index blocks, i.e. eh_depth >= 2 */
 		struct ext4_extent_header *eh =
 			(struct ext4_extent_header *)
 				inode.b.blocks.dir_blocks;
 		debug("del: dep=%d entries=%d\n", eh->eh_depth, eh->eh_entries);
+		if (le16_to_cpu(eh->eh_depth) == 1 &&
+		    delete_extent_leaves(eh, journal_buffer))
+			goto fail;
 	} else {
 		delete_single_indirect_block(&inode);
 		delete_double_indirect_block(&inode);
@@ -492,7 +542,7 @@ static int ext4fs_delete_file(int inodeno)
 
 	/* release data blocks */
 	for (i = 0; i < no_blocks; i++) {
-		blknr = read_allocated_block(&inode, i, NULL);
+		blknr = read_allocated_block(&inode, i, &cache);
 		if (blknr == 0)
 			continue;
 		if (blknr < 0)
@@ -575,20 +625,20 @@ static int ext4fs_delete_file(int inodeno)
 	if (ext4fs_log_journal(journal_buffer, ext4fs_bg_get_inode_id(bgd, fs)))
 		goto fail;
 
+	/*
+	 * Commit now, since writing the new file reads some of the blocks
+	 * changed here back from the disk
+	 */
 	ext4fs_update();
-	ext4fs_deinit();
 	ext4fs_reinit_global();
 
-	if (ext4fs_init() != 0) {
-		printf("error in File System init\n");
-		goto fail;
-	}
-
+	ext_cache_fini(&cache);
 	free(start_block_address);
 	free(journal_buffer);
 
 	return 0;
 fail:
+	ext_cache_fini(&cache);
 	free(start_block_address);
 	free(journal_buffer);
 
@@ -671,6 +721,17 @@ int ext4fs_init(void)
 			goto fail;
 	}
 
+	/* note the bitmap contents, so only changed ones are written back */
+	fs->blk_bmap_crcs = zalloc(fs->no_blkgrp * sizeof(uint32_t));
+	fs->inode_bmap_crcs = zalloc(fs->no_blkgrp * sizeof(uint32_t));
+	if (!fs->blk_bmap_crcs || !fs->inode_bmap_crcs)
+		goto fail;
+	for (i = 0; i < fs->no_blkgrp; i++) {
+		fs->blk_bmap_crcs[i] = crc32(0, fs->blk_bmaps[i], fs->blksz);
+		fs->inode_bmap_crcs[i] = crc32(0, fs->inode_bmaps[i],
+					       fs->blksz);
+	}
+
 	/*
 	 * check filesystem consistency with free blocks of file system
 	 * some time we observed that superblock freeblocks does not match
@@ -693,39 +754,26 @@ fail:
 	return -1;
 }
 
-void ext4fs_deinit(void)
+int ext4fs_deinit(void)
 {
-	int i;
-	struct ext2_inode inode_journal;
-	struct journal_superblock_t *jsb;
-	uint32_t blknr;
+	int i, ret;
 	struct ext_filesystem *fs = get_fs();
 	uint32_t new_feature_incompat;
 
 	/* free journal */
-	char *temp_buff = zalloc(fs->blksz);
-	if (temp_buff) {
-		ext4fs_read_inode(ext4fs_root, EXT2_JOURNAL_INO,
-				  &inode_journal);
-		blknr = read_allocated_block(&inode_journal,
-					EXT2_JOURNAL_SUPERBLOCK, NULL);
-		ext4fs_devread((lbaint_t)blknr * fs->sect_perblk, 0, fs->blksz,
-			       temp_buff);
-		jsb = (struct journal_superblock_t *)temp_buff;
-		jsb->s_start = 0;
-		put_ext4((uint64_t) ((uint64_t)blknr * (uint64_t)fs->blksz),
-			 (struct journal_superblock_t *)temp_buff, fs->blksz);
-		free(temp_buff);
-	}
+	ret = ext4fs_checkpoint_journal();
 	ext4fs_free_journal();
 
-	/* get the superblock */
+	/* get the superblock, leaving it marked for recovery on failure */
 	ext4_read_superblock((char *)fs->sb);
-	new_feature_incompat = le32_to_cpu(fs->sb->feature_incompat);
-	new_feature_incompat &= ~EXT3_FEATURE_INCOMPAT_RECOVER;
-	fs->sb->feature_incompat = cpu_to_le32(new_feature_incompat);
-	put_ext4((uint64_t)(SUPERBLOCK_SIZE),
-		 (struct ext2_sblock *)fs->sb, (uint32_t)SUPERBLOCK_SIZE);
+	if (!ret) {
+		new_feature_incompat = le32_to_cpu(fs->sb->feature_incompat);
+		new_feature_incompat &= ~EXT3_FEATURE_INCOMPAT_RECOVER;
+		fs->sb->feature_incompat = cpu_to_le32(new_feature_incompat);
+		ret = put_ext4((uint64_t)(SUPERBLOCK_SIZE),
+			       (struct ext2_sblock *)fs->sb,
+			       (uint32_t)SUPERBLOCK_SIZE);
+	}
 	free(fs->sb);
 	fs->sb = NULL;
 
@@ -746,7 +794,10 @@ void ext4fs_deinit(void)
 		free(fs->inode_bmaps);
 		fs->inode_bmaps = NULL;
 	}
-
+	free(fs->blk_bmap_crcs);
+	fs->blk_bmap_crcs = NULL;
+	free(fs->inode_bmap_crcs);
+	fs->inode_bmap_crcs = NULL;
 
 	free(fs->gdtable);
 	fs->gdtable = NULL;
@@ -758,86 +809,47 @@ void ext4fs_deinit(void)
 	fs->first_pass_bbmap = 0;
 	fs->curr_inode_no = 0;
 	fs->curr_blkno = 0;
+
+	return ret;
 }
 
 /*
- * Write data to filesystem blocks. Uses same optimization for
- * contigous sectors as ext4fs_read_file
+ * Write data to filesystem blocks, with one write for each run of contiguous
+ * blocks
  */
 static int ext4fs_write_file(struct ext2_inode *file_inode,
 			     int pos, unsigned int len, const char *buf)
 {
-	int i;
-	int blockcnt;
 	uint32_t filesize = le32_to_cpu(file_inode->size);
 	struct ext_filesystem *fs = get_fs();
-	int log2blksz = fs->dev_desc->log2blksz;
-	int log2_fs_blocksize = LOG2_BLOCK_SIZE(ext4fs_root) - log2blksz;
-	int previous_block_number = -1;
-	int delayed_start = 0;
-	int delayed_extent = 0;
-	int delayed_next = 0;
-	const char *delayed_buf = NULL;
+	uint32_t fileblock, blockcnt, maxblocks;
+	struct ext_block_cache cache;
+	int count;
 
 	/* Adjust len so it we can't read past the end of the file. */
 	if (len > filesize)
 		len = filesize;
 
 	blockcnt = ((len + pos) + fs->blksz - 1) / fs->blksz;
-
-	for (i = pos / fs->blksz; i < blockcnt; i++) {
-		long int blknr;
-		int blockend = fs->blksz;
-		int skipfirst = 0;
-		blknr = read_allocated_block(file_inode, i, NULL);
-		if (blknr <= 0)
+	/* Keep each write within the range of put_ext4() */
+	maxblocks = INT_MAX / fs->blksz;
+
+	ext_cache_init(&cache);
+	for (fileblock = pos / fs->blksz; fileblock < blockcnt;
+	     fileblock += count) {
+		uint64_t blknr;
+
+		count = ext4fs_map_blocks(file_inode, fileblock,
+					  min(blockcnt - fileblock, maxblocks),
+					  &cache, &blknr);
+		if (count < 0 || !blknr) {
+			ext_cache_fini(&cache);
 			return -1;
-
-		blknr = blknr << log2_fs_blocksize;
-
-		if (blknr) {
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
-					put_ext4((uint64_t)
-						 ((uint64_t)delayed_start << log2blksz),
-						 delayed_buf,
-						 (uint32_t) delayed_extent);
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_buf = buf;
-					delayed_next = blknr +
-					    (blockend >> log2blksz);
-				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
-				delayed_buf = buf;
-				delayed_next = blknr +
-				    (blockend >> log2blksz);
-			}
-		} else {
-			if (previous_block_number != -1) {
-				/* spill */
-				put_ext4((uint64_t) ((uint64_t)delayed_start <<
-						     log2blksz),
-					 delayed_buf,
-					 (uint32_t) delayed_extent);
-				previous_block_number = -1;
-			}
 		}
-		buf += fs->blksz - skipfirst;
-	}
-	if (previous_block_number != -1) {
-		/* spill */
-		put_ext4((uint64_t) ((uint64_t)delayed_start << log2blksz),
-			 delayed_buf, (uint32_t) delayed_extent);
-		previous_block_number = -1;
+		put_ext4(blknr * fs->blksz, buf, count * fs->blksz);
+		buf += count * fs->blksz;
 	}
+	ext_cache_fini(&cache);
 
 	return len;
 }
@@ -876,13 +888,14 @@ int ext4fs_write(const char *fname, const char *buffer,
 	if (!g_parent_inode)
 		goto fail;
 
-	if (ext4fs_init() != 0) {
-		printf("error in File System init\n");
+	if (le32_to_cpu(ext4fs_root->sblock.feature_ro_compat) &
+	    EXT4_FEATURE_RO_COMPAT_METADATA_CSUM) {
+		printf("Unsupported feature metadata_csum found, not writing.\n");
 		return -1;
 	}
 
-	if (le32_to_cpu(fs->sb->feature_ro_compat) & EXT4_FEATURE_RO_COMPAT_METADATA_CSUM) {
-		printf("Unsupported feature metadata_csum found, not writing.\n");
+	if (ext4fs_init() != 0) {
+		printf("error in File System init\n");
 		return -1;
 	}
 
@@ -957,9 +970,13 @@ int ext4fs_write(const char *fname, const char *buffer,
 	file_inode->ctime = cpu_to_le32(timestamp);
 	file_inode->nlinks = cpu_to_le16(1);
 
-	/* Allocate data blocks */
-	ext4fs_allocate_blocks(file_inode, blocks_remaining,
-			       &blks_reqd_for_file);
+	/*
+	 * Allocate data blocks. A fast symlink keeps its target where the
+	 * block map or extent tree would be, so must not get either.
+	 */
+	if (!store_link_in_inode && blocks_remaining)
+		ext4fs_allocate_blocks(file_inode, blocks_remaining,
+				       &blks_reqd_for_file);
 	file_inode->blockcnt = cpu_to_le32((blks_reqd_for_file * fs->blksz) >>
 					   LOG2_SECTOR_SIZE);
 
@@ -1010,12 +1027,14 @@ int ext4fs_write(const char *fname, const char *buffer,
 		 * both should be kept in 1 buffer
 		 */
 		memcpy(temp_ptr + blkoff, g_parent_inode, fs->inodesz);
-		gd_index--;
 		if (ext4fs_put_metadata(temp_ptr, itable_blkno))
 			goto fail;
 	}
 	ext4fs_update();
-	ext4fs_deinit();
+	if (ext4fs_deinit()) {
+		printf("error in File System deinit\n");
+		ret = -1;
+	}
 
 	fs->first_pass_bbmap = 0;
 	fs->curr_blkno = 0;
@@ -1026,7 +1045,7 @@ int ext4fs_write(const char *fname, const char *buffer,
 	free(temp_ptr);
 	g_parent_inode = NULL;
 
-	return 0;
+	return ret;
 fail:
 	ext4fs_deinit();
 	free(inode_buffer);
@@ -14,6 +14,7 @@
 #include <exports.h>
 #include <fat.h>
 #include <fs.h>
+#include <fs_internal.h>
 #include <log.h>
 #include <asm/byteorder.h>
 #include <part.h>
@@ -196,12 +197,12 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 
 	/* Read a new block of FAT entries into the cache. */
 	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
+		__u32 getsize = mydata->fatbufblocks;
 		__u8 *bufptr = mydata->fatbuf;
 		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
+		__u32 startblock = bufnum * mydata->fatbufblocks;
 
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+		/* Cap length if fatlength is not a multiple of fatbufblocks */
 		if (startblock + getsize > fatlength)
 			getsize = fatlength - startblock;
 
@@ -242,11 +243,13 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 }
 
 /*
- * Read at most 'size' bytes from the specified cluster into 'buffer'.
+ * Read 'size' bytes from 'offset' bytes into the specified cluster into
+ * 'buffer'. The read may run on into the following clusters.
  * Return 0 on success, -1 otherwise.
  */
 static int
-get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
+get_cluster(fsdata *mydata, __u32 clustnum, __u32 offset, __u8 *buffer,
+	    unsigned long size)
 {
 	__u32 startsect;
 	int ret;
@@ -259,51 +262,132 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 
 	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
 
-	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+	if (!cur_dev)
+		return -1;
+	ret = fs_blk_read(cur_dev, cur_part_info.start,
+			  ((u64)startsect << cur_dev->log2blksz) + offset, size,
+			  buffer);
+	if (ret) {
+		debug("Error reading data (got %d)\n", ret);
+		return -1;
+	}
 
-		debug("FAT: Misaligned buffer address (%p)\n", buffer);
+	return 0;
+}
 
-		while (size >= mydata->sect_size) {
-			ret = disk_read(startsect++, 1, tmpbuf);
-			if (ret != 1) {
-				debug("Error reading data (got %d)\n", ret);
-				return -1;
-			}
+/*
+ * The cluster chain of the file last read, as runs of consecutive clusters.
+ * It is kept after the read, so that reading the same file again, e.g. in
+ * chunks at increasing offsets, can seek straight to the clusters needed
+ * instead of following the chain from the start. It is extended as far as
+ * each read needs and dropped when the file, device or FAT changes, or when
+ * the medium is changed or written behind the driver's back.
+ */
+struct fat_run {
+	__u32 fclust;		/* Index of first cluster within the file */
+	__u32 clust;		/* First cluster on disk */
+	__u32 count;		/* Number of clusters in the run */
+};
 
-			memcpy(buffer, tmpbuf, mydata->sect_size);
-			buffer += mydata->sect_size;
-			size -= mydata->sect_size;
-		}
-	} else if (size >= mydata->sect_size) {
-		__u32 bytes_read;
-		__u32 sect_count = size / mydata->sect_size;
+static struct {
+	struct blk_desc *dev;	/* Device holding the file, NULL if none */
+	uint media_gen;		/* Media generation of the device */
+	uint write_gen;		/* Write generation of the device */
+	lbaint_t part_start;	/* Start sector of its partition */
+	__u32 start;		/* First cluster of the file */
+	__u32 size;		/* Size of the file in bytes */
+	__u32 mapped;		/* Number of clusters mapped so far */
+	int nruns;		/* Number of runs in use */
+	int maxruns;		/* Number of runs allocated */
+	struct fat_run *runs;
+} run_map;
+
+static void fat_run_map_invalidate(void)
+{
+	run_map.dev = NULL;
+	run_map.mapped = 0;
+	run_map.nruns = 0;
+}
 
-		ret = disk_read(startsect, sect_count, buffer);
-		if (ret != sect_count) {
-			debug("Error reading data (got %d)\n", ret);
-			return -1;
-		}
-		bytes_read = sect_count * mydata->sect_size;
-		startsect += sect_count;
-		buffer += bytes_read;
-		size -= bytes_read;
+/*
+ * Map the first 'nclust' clusters of the file associated with 'dentptr'.
+ * Return 0 on success, -1 if the chain is broken or memory is short.
+ */
+static int fat_run_map_extend(fsdata *mydata, dir_entry *dentptr,
+			      __u32 nclust)
+{
+	struct fat_run *run = NULL, *runs;
+	__u32 clust;
+
+	if (cur_dev->uncached || run_map.dev != cur_dev ||
+	    run_map.media_gen != cur_dev->media_gen ||
+	    run_map.write_gen != cur_dev->write_gen ||
+	    run_map.part_start != cur_part_info.start ||
+	    run_map.start != START(dentptr) ||
+	    run_map.size != FAT2CPU32(dentptr->size)) {
+		fat_run_map_invalidate();
+		run_map.dev = cur_dev;
+		run_map.media_gen = cur_dev->media_gen;
+		run_map.write_gen = cur_dev->write_gen;
+		run_map.part_start = cur_part_info.start;
+		run_map.start = START(dentptr);
+		run_map.size = FAT2CPU32(dentptr->size);
 	}
-	if (size) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
-
-		ret = disk_read(startsect, 1, tmpbuf);
-		if (ret != 1) {
-			debug("Error reading data (got %d)\n", ret);
+	if (run_map.nruns)
+		run = &run_map.runs[run_map.nruns - 1];
+
+	while (run_map.mapped < nclust) {
+		if (run)
+			clust = get_fatent(mydata, run->clust + run->count - 1);
+		else
+			clust = run_map.start;
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
 			return -1;
 		}
 
-		memcpy(buffer, tmpbuf, size);
+		if (run && clust == run->clust + run->count) {
+			run->count++;
+		} else {
+			if (run_map.nruns == run_map.maxruns) {
+				runs = realloc(run_map.runs,
+					       2 * (run_map.maxruns + 8) *
+					       sizeof(*runs));
+				if (!runs) {
+					fat_run_map_invalidate();
+					return -1;
+				}
+				run_map.runs = runs;
+				run_map.maxruns = 2 * (run_map.maxruns + 8);
+			}
+			run = &run_map.runs[run_map.nruns++];
+			run->fclust = run_map.mapped;
+			run->clust = clust;
+			run->count = 1;
+		}
+		run_map.mapped++;
 	}
 
 	return 0;
 }
 
+/* Find the run holding cluster 'fclust' of the file, which must be mapped */
+static struct fat_run *fat_run_find(__u32 fclust)
+{
+	int lo = 0, hi = run_map.nruns - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (run_map.runs[mid].fclust > fclust)
+			hi = mid - 1;
+		else
+			lo = mid;
+	}
+
+	return &run_map.runs[lo];
+}
+
 /**
  * get_contents() - read from file
  *
@@ -324,8 +408,8 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	struct fat_run *run;
+	__u32 fclust, offset;
 	loff_t actsize;
 
 	*gotsize = 0;
@@ -341,101 +425,49 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
-	}
-
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
+	/* The file size fits in 32 bits, so do the arithmetic in 32 bits */
+	if (fat_run_map_extend(mydata, dentptr,
+			       ((__u32)filesize - 1) / bytesperclust + 1))
+		return -1;
 
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		__u8 *tmp_buffer;
+	fclust = (__u32)pos / bytesperclust;
+	offset = (__u32)pos % bytesperclust;
+	filesize -= pos;
+	run = fat_run_find(fclust);
 
-		actsize = min(filesize, (loff_t)bytesperclust);
-		tmp_buffer = malloc_cache_aligned(actsize);
-		if (!tmp_buffer) {
-			debug("Error: allocating buffer\n");
-			return -1;
-		}
-
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
+	/* read up to the beginning of the next cluster if any */
+	if (offset) {
+		actsize = min(filesize, (loff_t)(bytesperclust - offset));
+		if (get_cluster(mydata, run->clust + fclust - run->fclust,
+				offset, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
-			free(tmp_buffer);
 			return -1;
 		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
-		free(tmp_buffer);
 		*gotsize += actsize;
-		if (!filesize)
-			return 0;
+		filesize -= actsize;
 		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
+		if (++fclust == run->fclust + run->count)
+			run++;
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
-				return -1;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+	/* read the rest of each run of consecutive clusters in one go */
+	while (filesize) {
+		actsize = (loff_t)(run->fclust + run->count - fclust) *
+			bytesperclust;
+		actsize = min(actsize, filesize);
+		if (get_cluster(mydata, run->clust + fclust - run->fclust, 0,
+				buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
 		filesize -= actsize;
 		buffer += actsize;
+		fclust = run->fclust + run->count;
+		run++;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -623,8 +655,20 @@ static int get_fs_info(fsdata *mydata)
 		mydata->root_cluster = 0;
 	}
 
+	/*
+	 * Cache as much of the FAT as configured, in whole multiples of
+	 * FATBUFBLOCKS, but no more than the FAT itself
+	 */
+	mydata->fatbufblocks = CONFIG_VAL(FS_FAT_CACHE_SIZE) * 1024 /
+		mydata->sect_size;
+	mydata->fatbufblocks = min_t(__u32, mydata->fatbufblocks,
+				     roundup(mydata->fatlength, FATBUFBLOCKS));
+	mydata->fatbufblocks = max_t(__u32, rounddown(mydata->fatbufblocks,
+						      FATBUFBLOCKS),
+				     FATBUFBLOCKS);
 	mydata->fatbufnum = -1;
 	mydata->fat_dirty = 0;
+	mydata->free_map = NULL;
 	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
 	if (mydata->fatbuf == NULL) {
 		debug("Error: allocating memory\n");
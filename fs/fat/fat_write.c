@@ -212,10 +212,12 @@ static int disk_write(__u32 block, __u32 nr_blocks, void *buf)
  */
 static int flush_dirty_fat_buffer(fsdata *mydata)
 {
-	int getsize = FATBUFBLOCKS;
+	int getsize = mydata->fat_dirty_end - mydata->fat_dirty_start;
 	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
+	__u8 *bufptr = mydata->fatbuf +
+		mydata->fat_dirty_start * mydata->sect_size;
+	__u32 startblock = mydata->fatbufnum * mydata->fatbufblocks +
+		mydata->fat_dirty_start;
 
 	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
 	      (int)mydata->fat_dirty);
@@ -223,7 +225,7 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
 		return 0;
 
-	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	/* Only the modified sectors are written, capped to the FAT length */
 	if (startblock + getsize > fatlength)
 		getsize = fatlength - startblock;
 
@@ -430,6 +432,26 @@ fill_dir_slot(fat_itr *itr, const char *l_name, const char *shortname)
 	return 0;
 }
 
+/*
+ * Record that @len bytes at @offset in the FAT buffer have been modified, so
+ * that only the sectors holding them are written back
+ */
+static void mark_fat_dirty(fsdata *mydata, __u32 offset, __u32 len)
+{
+	__u32 start = offset / mydata->sect_size;
+	__u32 end = min_t(__u32, (offset + len - 1) / mydata->sect_size + 1,
+			  mydata->fatbufblocks);
+
+	if (!mydata->fat_dirty) {
+		mydata->fat_dirty_start = start;
+		mydata->fat_dirty_end = end;
+		mydata->fat_dirty = 1;
+		return;
+	}
+	mydata->fat_dirty_start = min(mydata->fat_dirty_start, start);
+	mydata->fat_dirty_end = max(mydata->fat_dirty_end, end);
+}
+
 /*
  * Set the entry at index 'entry' in a FAT (12/16/32) table.
  */
@@ -458,12 +480,12 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 
 	/* Read a new block of FAT entries into the cache. */
 	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
+		int getsize = mydata->fatbufblocks;
 		__u8 *bufptr = mydata->fatbuf;
 		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
+		__u32 startblock = bufnum * mydata->fatbufblocks;
 
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+		/* Cap length if fatlength is not a multiple of fatbufblocks */
 		if (startblock + getsize > fatlength)
 			getsize = fatlength - startblock;
 
@@ -479,19 +501,32 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		mydata->fatbufnum = bufnum;
 	}
 
-	/* Mark as dirty */
-	mydata->fat_dirty = 1;
+	/* The chain of the file last read may be changing */
+	fat_run_map_invalidate();
+
+	if (mydata->free_map && entry >= mydata->free_map_start &&
+	    entry - mydata->free_map_start < mydata->free_map_len) {
+		if (entry_value)
+			generic_clear_bit(entry - mydata->free_map_start,
+					  mydata->free_map);
+		else
+			generic_set_bit(entry - mydata->free_map_start,
+					mydata->free_map);
+	}
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
 	case 32:
 		((__u32 *) mydata->fatbuf)[offset] = cpu_to_le32(entry_value);
+		mark_fat_dirty(mydata, offset * 4, 4);
 		break;
 	case 16:
 		((__u16 *) mydata->fatbuf)[offset] = cpu_to_le16(entry_value);
+		mark_fat_dirty(mydata, offset * 2, 2);
 		break;
 	case 12:
 		off16 = (offset * 3) / 4;
+		mark_fat_dirty(mydata, off16 * 2, 4);
 
 		switch (offset & 0x3) {
 		case 0:
@@ -536,14 +571,132 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	return 0;
 }
 
+/*
+ * Number of FAT entries which can refer to a cluster. Clusters are numbered
+ * from 2 and must lie within both the FAT and the partition.
+ */
+static __u32 fat_cluster_count(fsdata *mydata)
+{
+	__u32 clusters;
+	s64 data_sects;
+
+	clusters = (u64)mydata->fatlength * mydata->sect_size * 8 /
+		mydata->fatsize;
+	data_sects = (s64)mydata->total_sect - mydata->data_begin;
+	if (data_sects > 0)
+		clusters = min_t(u64, clusters,
+				 div_u64(data_sects, mydata->clust_size) + 2);
+
+	return clusters;
+}
+
+/* Number of FAT entries held in fatbuf at a time */
+static __u32 fat_entries_per_buf(fsdata *mydata)
+{
+	switch (mydata->fatsize) {
+	case 32:
+		return FAT32BUFSIZE;
+	case 16:
+		return FAT16BUFSIZE;
+	default:
+		return FAT12BUFSIZE;
+	}
+}
+
+/*
+ * Build the bitmap of free clusters, one bit per cluster, set if free, for
+ * the part of the FAT which fits in fatbuf starting at 'start'. This takes
+ * a single read of the FAT, which get_fatent() needs anyway, and uses little
+ * memory however large the FAT. Return 0 on success, -ENOMEM if there is no
+ * memory for the map, -EIO if the FAT cannot be read.
+ */
+static int build_free_map(fsdata *mydata, __u32 start)
+{
+	__u32 per_buf = fat_entries_per_buf(mydata);
+	__u32 clusters = fat_cluster_count(mydata);
+	__u32 entry, end;
+
+	start -= start % per_buf;
+	if (mydata->free_map && mydata->free_map_start == start)
+		return 0;
+
+	if (!mydata->free_map) {
+		mydata->free_map = calloc(BITS_TO_LONGS(per_buf),
+					  sizeof(ulong));
+		if (!mydata->free_map)
+			return -ENOMEM;
+	} else {
+		memset(mydata->free_map, '\0',
+		       BITS_TO_LONGS(per_buf) * sizeof(ulong));
+	}
+	mydata->free_map_start = start;
+	mydata->free_map_len = 0;
+
+	end = min(start + per_buf, clusters);
+	for (entry = max(start, 2U); entry < end; entry++) {
+		if (!get_fatent(mydata, entry))
+			generic_set_bit(entry - start, mydata->free_map);
+		if (mydata->fatbufnum != start / per_buf)
+			return -EIO;
+	}
+	mydata->free_map_len = end - start;
+
+	return 0;
+}
+
+/*
+ * Find the first free cluster at or after 'start', wrapping round to the
+ * start of the FAT, using the free-cluster bitmap of each part of the FAT in
+ * turn. Return 0 if no cluster is free, or if a bitmap cannot be built.
+ */
+static __u32 next_free_cluster(fsdata *mydata, __u32 start)
+{
+	__u32 clusters = fat_cluster_count(mydata);
+	__u32 entry, i, len, searched;
+	ulong *map;
+
+	if (start < 2 || start >= clusters)
+		start = 2;
+	entry = start;
+	for (searched = 0; searched < clusters - 2; ) {
+		if (build_free_map(mydata, entry))
+			return 0;
+		map = mydata->free_map;
+		len = mydata->free_map_len;
+		for (i = entry - mydata->free_map_start; i < len; i++) {
+			/* Skip a whole word of allocated clusters at once */
+			if (!(i % BITS_PER_LONG) && !map[BIT_WORD(i)]) {
+				i += BITS_PER_LONG - 1;
+				continue;
+			}
+			if (map[BIT_WORD(i)] & BIT_MASK(i))
+				return mydata->free_map_start + i;
+		}
+		searched += mydata->free_map_start + len - entry;
+		entry = mydata->free_map_start + len;
+		if (entry >= clusters)
+			entry = 2;
+	}
+
+	return 0;
+}
+
 /*
  * Determine the next free cluster after 'entry' in a FAT (12/16/32) table
  * and link it to 'entry'. EOC marker is not set on returned entry.
  */
 static __u32 determine_fatent(fsdata *mydata, __u32 entry)
 {
-	__u32 next_fat, next_entry = entry + 1;
+	__u32 next_fat, next_entry;
+
+	next_entry = next_free_cluster(mydata, entry + 1);
+	if (next_entry && next_entry != entry) {
+		set_fatent_value(mydata, entry, next_entry);
+		goto out;
+	}
 
+	/* No bitmap or no space: search the FAT directly */
+	next_entry = entry + 1;
 	while (1) {
 		next_fat = get_fatent(mydata, next_entry);
 		if (next_fat == 0) {
@@ -553,6 +706,7 @@ static __u32 determine_fatent(fsdata *mydata, __u32 entry)
 		}
 		next_entry++;
 	}
+out:
 	debug("FAT%d: entry: %08x, entry_value: %04x\n",
 	       mydata->fatsize, entry, next_entry);
 
@@ -799,8 +953,13 @@ get_set_cluster(fsdata *mydata, __u32 clustnum, loff_t pos, __u8 *buffer,
  */
 static int find_empty_cluster(fsdata *mydata)
 {
-	__u32 fat_val, entry = 3;
+	__u32 fat_val, entry;
+
+	entry = next_free_cluster(mydata, 3);
+	if (entry)
+		return entry;
 
+	entry = 3;
 	while (1) {
 		fat_val = get_fatent(mydata, entry);
 		if (fat_val == 0)
@@ -1427,6 +1586,7 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 exit:
 	free(filename_copy);
 	free(mydata->fatbuf);
+	free(mydata->free_map);
 	free(itr);
 	return ret;
 }
@@ -1623,6 +1783,7 @@ int fat_unlink(const char *filename)
 
 exit:
 	free(fsdata.fatbuf);
+	free(fsdata.free_map);
 	free(itr);
 	free(filename_copy);
 
@@ -1767,6 +1928,7 @@ int fat_mkdir(const char *dirname)
 exit:
 	free(dirname_copy);
 	free(mydata->fatbuf);
+	free(mydata->free_map);
 	free(itr);
 	free(dotdent);
 	return ret;
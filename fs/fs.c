@@ -12,20 +12,26 @@
 #include <env.h>
 #include <lmb.h>
 #include <log.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <part.h>
 #include <ext4fs.h>
 #include <fat.h>
 #include <fs.h>
+#include <hash.h>
+#include <image.h>
+#include <memalign.h>
 #include <sandboxfs.h>
 #include <ubifs_uboot.h>
 #include <btrfs.h>
 #include <asm/global_data.h>
 #include <asm/io.h>
 #include <div64.h>
+#include <linux/list.h>
 #include <linux/math64.h>
 #include <efi_loader.h>
 #include <squashfs.h>
+#include "fs_decomp.h"
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -144,6 +150,11 @@ struct fstype_info {
 	 * filesystem.
 	 */
 	bool null_dev_desc_ok;
+	/*
+	 * Can .read() only read from the start of a file? Such files are read
+	 * in one go, rather than a chunk at a time, when hashed on loading.
+	 */
+	bool read_whole_only;
 	int (*probe)(struct blk_desc *fs_dev_desc,
 		     struct disk_partition *fs_partition);
 	int (*ls)(const char *dirname);
@@ -289,6 +300,7 @@ static struct fstype_info fstypes[] = {
 		.fstype = FS_TYPE_SQUASHFS,
 		.name = "squashfs",
 		.null_dev_desc_ok = false,
+		.read_whole_only = true,
 		.probe = sqfs_probe,
 		.opendir = sqfs_opendir,
 		.readdir = sqfs_readdir,
@@ -364,10 +376,398 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/* Number of partitions whose filesystem type is remembered */
+#define FS_MOUNT_CACHE_SIZE	4
+
+/**
+ * struct fs_mount - filesystem type found on a partition
+ *
+ * @desc: Block device holding the partition
+ * @hwpart: Hardware partition selected on the device
+ * @media_gen: Media generation of the device when the type was found
+ * @start: Start block of the partition
+ * @size: Size of the partition in blocks
+ * @fstype: Filesystem type (FS_TYPE_...)
+ */
+struct fs_mount {
+	struct blk_desc *desc;
+	int hwpart;
+	uint media_gen;
+	lbaint_t start;
+	lbaint_t size;
+	int fstype;
+};
+
+/* Most recently used first */
+static struct fs_mount fs_mounts[FS_MOUNT_CACHE_SIZE];
+static int fs_mount_count;
+
+static int fs_mount_find(struct blk_desc *desc, struct disk_partition *info)
+{
+	struct fs_mount *mnt;
+	int i;
+
+	for (i = 0, mnt = fs_mounts; i < fs_mount_count; i++, mnt++) {
+		if (mnt->desc == desc && mnt->hwpart == desc->hwpart &&
+		    mnt->media_gen == desc->media_gen &&
+		    mnt->start == info->start && mnt->size == info->size)
+			return i;
+	}
+
+	return -ENOENT;
+}
+
+/* Get the type last found on a partition, or FS_TYPE_ANY if unknown */
+static int fs_mount_lookup(struct blk_desc *desc, struct disk_partition *info)
+{
+	int i;
+
+	if (!desc || desc->uncached)
+		return FS_TYPE_ANY;
+	i = fs_mount_find(desc, info);
+
+	return i < 0 ? FS_TYPE_ANY : fs_mounts[i].fstype;
+}
+
+static void fs_mount_add(struct blk_desc *desc, struct disk_partition *info,
+			 int fstype)
+{
+	struct fs_mount mnt = {
+		.desc = desc,
+		.start = info->start,
+		.size = info->size,
+		.fstype = fstype,
+	};
+	int i;
+
+	if (!desc || desc->uncached)
+		return;
+	mnt.hwpart = desc->hwpart;
+	mnt.media_gen = desc->media_gen;
+
+	/* Move the entry to the front, dropping the oldest if it is new */
+	i = fs_mount_find(desc, info);
+	if (i < 0) {
+		if (fs_mount_count < FS_MOUNT_CACHE_SIZE)
+			fs_mount_count++;
+		i = fs_mount_count - 1;
+	}
+	memmove(&fs_mounts[1], &fs_mounts[0], i * sizeof(mnt));
+	fs_mounts[0] = mnt;
+}
+#else
+static int fs_mount_lookup(struct blk_desc *desc, struct disk_partition *info)
+{
+	return FS_TYPE_ANY;
+}
+
+static void fs_mount_add(struct blk_desc *desc, struct disk_partition *info,
+			 int fstype)
+{
+}
+#endif
+
+#if CONFIG_IS_ENABLED(FS_PAGE_CACHE)
+/* Size of each page of file data kept in the cache */
+#define FS_CACHE_PAGE_SHIFT	16
+#define FS_CACHE_PAGE_SIZE	(1 << FS_CACHE_PAGE_SHIFT)
+/* Most files whose size or data is kept */
+#define FS_CACHE_MAX_FILES	32
+
+/**
+ * struct fs_cache_page - a page of file data
+ *
+ * @lru: Entry in fs_cache_pages, most recently used first
+ * @file: File the page belongs to
+ * @index: Page number in the file
+ * @len: Number of bytes held, less than FS_CACHE_PAGE_SIZE only at EOF
+ * @data: Page contents
+ */
+struct fs_cache_page {
+	struct list_head lru;
+	struct fs_cache_file *file;
+	ulong index;
+	ulong len;
+	char data[];
+};
+
+/**
+ * struct fs_cache_file - a file known to the page cache
+ *
+ * @sibling: Entry in fs_cache_files, most recently used first
+ * @desc: Block device holding the filesystem
+ * @hwpart: Hardware partition selected on the device
+ * @media_gen: Media generation of the device when the file was added
+ * @write_gen: Write generation of the device when the file was added
+ * @start: Start block of the partition
+ * @fstype: Filesystem type (FS_TYPE_...)
+ * @size: Size of the file in bytes
+ * @pages: Cached pages indexed by page number, NULL until data is added
+ * @name: Path of the file, as passed to fs_read() etc.
+ */
+struct fs_cache_file {
+	struct list_head sibling;
+	struct blk_desc *desc;
+	int hwpart;
+	uint media_gen;
+	uint write_gen;
+	lbaint_t start;
+	int fstype;
+	loff_t size;
+	struct fs_cache_page **pages;
+	char name[];
+};
+
+static LIST_HEAD(fs_cache_files);
+static LIST_HEAD(fs_cache_pages);
+static int fs_cache_nfiles;
+static ulong fs_cache_used;
+
+/* Get the most memory that file data may use */
+static ulong fs_cache_budget(void)
+{
+	return env_get_hex("fs_cache_size", CONFIG_FS_PAGE_CACHE_SIZE);
+}
+
+static void fs_cache_free_page(struct fs_cache_page *page)
+{
+	page->file->pages[page->index] = NULL;
+	list_del(&page->lru);
+	fs_cache_used -= page->len;
+	free(page);
+}
+
+static void fs_cache_free_file(struct fs_cache_file *file)
+{
+	ulong i, count;
+
+	if (file->pages) {
+		count = (file->size + FS_CACHE_PAGE_SIZE - 1) >>
+			FS_CACHE_PAGE_SHIFT;
+		for (i = 0; i < count; i++) {
+			if (file->pages[i])
+				fs_cache_free_page(file->pages[i]);
+		}
+	}
+	list_del(&file->sibling);
+	fs_cache_nfiles--;
+	free(file->pages);
+	free(file);
+}
+
+/* Drop the least recently used pages until no more than @budget is used */
+static void fs_cache_trim(ulong budget)
+{
+	while (fs_cache_used > budget)
+		fs_cache_free_page(list_last_entry(&fs_cache_pages,
+						   struct fs_cache_page, lru));
+}
+
+/*
+ * Find a file on the current partition. Files on the device which are out of
+ * date because it was written to or changed are dropped on the way.
+ */
+static struct fs_cache_file *fs_cache_find(const char *filename)
+{
+	struct blk_desc *desc = fs_dev_desc;
+	struct fs_cache_file *file, *next;
+
+	if (!desc || desc->uncached)
+		return NULL;
+
+	list_for_each_entry_safe(file, next, &fs_cache_files, sibling) {
+		if (file->desc != desc)
+			continue;
+		if (file->media_gen != desc->media_gen ||
+		    file->write_gen != desc->write_gen) {
+			fs_cache_free_file(file);
+			continue;
+		}
+		if (file->hwpart == desc->hwpart &&
+		    file->start == fs_partition.start &&
+		    file->fstype == fs_type && !strcmp(file->name, filename)) {
+			list_move(&file->sibling, &fs_cache_files);
+			return file;
+		}
+	}
+
+	return NULL;
+}
+
+static void fs_cache_set_size(const char *filename, loff_t size)
+{
+	struct fs_cache_file *file;
+
+	if (!fs_dev_desc || fs_dev_desc->uncached || !fs_cache_budget() ||
+	    fs_cache_find(filename))
+		return;
+
+	file = calloc(1, sizeof(*file) + strlen(filename) + 1);
+	if (!file)
+		return;
+	file->desc = fs_dev_desc;
+	file->hwpart = fs_dev_desc->hwpart;
+	file->media_gen = fs_dev_desc->media_gen;
+	file->write_gen = fs_dev_desc->write_gen;
+	file->start = fs_partition.start;
+	file->fstype = fs_type;
+	file->size = size;
+	strcpy(file->name, filename);
+
+	if (fs_cache_nfiles == FS_CACHE_MAX_FILES)
+		fs_cache_free_file(list_last_entry(&fs_cache_files,
+						   struct fs_cache_file,
+						   sibling));
+	list_add(&file->sibling, &fs_cache_files);
+	fs_cache_nfiles++;
+}
+
+static int fs_cache_get_size(const char *filename, loff_t *size)
+{
+	struct fs_cache_file *file = fs_cache_find(filename);
+
+	if (!file)
+		return -ENOENT;
+	*size = file->size;
+
+	return 0;
+}
+
+/* Read from the cache, returning -ENOENT unless all the data is there */
+static int fs_cache_read(const char *filename, void *buf, loff_t offset,
+			 loff_t len, loff_t *actread)
+{
+	struct fs_cache_file *file = fs_cache_find(filename);
+	struct fs_cache_page *page;
+	loff_t pos, end;
+	ulong i, poff, n;
+
+	if (!file || !file->pages || offset >= file->size)
+		return -ENOENT;
+	end = file->size;
+	if (len && offset + len < end)
+		end = offset + len;
+
+	for (i = offset >> FS_CACHE_PAGE_SHIFT;
+	     i <= (end - 1) >> FS_CACHE_PAGE_SHIFT; i++) {
+		if (!file->pages[i])
+			return -ENOENT;
+	}
+
+	for (pos = offset; pos < end; pos += n) {
+		page = file->pages[pos >> FS_CACHE_PAGE_SHIFT];
+		poff = pos & (FS_CACHE_PAGE_SIZE - 1);
+		n = min_t(loff_t, end - pos, page->len - poff);
+		memcpy(buf + (pos - offset), page->data + poff, n);
+		list_move(&page->lru, &fs_cache_pages);
+	}
+	*actread = end - offset;
+
+	return 0;
+}
+
+/*
+ * Add the pages wholly covered by @len bytes just read from the filesystem,
+ * where @req_len is the length asked for
+ */
+static void fs_cache_fill(struct fstype_info *info, const char *filename,
+			  const void *buf, loff_t offset, loff_t req_len,
+			  loff_t len)
+{
+	ulong budget = fs_cache_budget();
+	struct fs_cache_file *file;
+	struct fs_cache_page *page;
+	loff_t pos, end, size;
+	ulong i, n;
+
+	/* Data larger than the cache would only push itself out */
+	if (!fs_dev_desc || fs_dev_desc->uncached || !len || len > budget)
+		return;
+
+	file = fs_cache_find(filename);
+	if (!file) {
+		/* Reading the whole file gives its size */
+		size = len;
+		if ((offset || req_len) && info->size(filename, &size))
+			return;
+		fs_cache_set_size(filename, size);
+		file = fs_cache_find(filename);
+		if (!file)
+			return;
+	}
+	if (!file->pages) {
+		file->pages = calloc((file->size + FS_CACHE_PAGE_SIZE - 1) >>
+				     FS_CACHE_PAGE_SHIFT, sizeof(*file->pages));
+		if (!file->pages)
+			return;
+	}
+
+	end = offset + len;
+	pos = (offset + FS_CACHE_PAGE_SIZE - 1) & ~(loff_t)(FS_CACHE_PAGE_SIZE - 1);
+	for (; pos < end; pos += FS_CACHE_PAGE_SIZE) {
+		i = pos >> FS_CACHE_PAGE_SHIFT;
+		n = min_t(loff_t, FS_CACHE_PAGE_SIZE, file->size - pos);
+		if (pos + n > end)
+			break;
+		if (file->pages[i])
+			continue;
+
+		fs_cache_trim(budget - n);
+		page = malloc(sizeof(*page) + n);
+		if (!page)
+			return;
+		page->file = file;
+		page->index = i;
+		page->len = n;
+		memcpy(page->data, buf + (pos - offset), n);
+		file->pages[i] = page;
+		list_add(&page->lru, &fs_cache_pages);
+		fs_cache_used += n;
+	}
+}
+#else
+static void fs_cache_set_size(const char *filename, loff_t size)
+{
+}
+
+static int fs_cache_get_size(const char *filename, loff_t *size)
+{
+	return -ENOENT;
+}
+
+static int fs_cache_read(const char *filename, void *buf, loff_t offset,
+			 loff_t len, loff_t *actread)
+{
+	return -ENOENT;
+}
+
+static void fs_cache_fill(struct fstype_info *info, const char *filename,
+			  const void *buf, loff_t offset, loff_t req_len,
+			  loff_t len)
+{
+}
+#endif
+
+/*
+ * Try to mount the current partition as the filesystem described by @info.
+ * Return 0 if OK, -1 if it is not that filesystem
+ */
+static int fs_try_probe(struct fstype_info *info, int part)
+{
+	if (info->probe(fs_dev_desc, &fs_partition))
+		return -1;
+	fs_type = info->fstype;
+	fs_dev_part = part;
+	fs_mount_add(fs_dev_desc, &fs_partition, fs_type);
+
+	return 0;
+}
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
-	int part, i;
+	int part, found, i;
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 	static int relocated;
 
@@ -390,6 +790,12 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	/* Try the type found here last time before probing them all */
+	found = fs_mount_lookup(fs_dev_desc, &fs_partition);
+	if (found != FS_TYPE_ANY && (fstype == FS_TYPE_ANY || fstype == found) &&
+	    !fs_try_probe(fs_get_info(found), part))
+		return 0;
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -398,11 +804,8 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 		if (!fs_dev_desc && !info->null_dev_desc_ok)
 			continue;
 
-		if (!info->probe(fs_dev_desc, &fs_partition)) {
-			fs_type = info->fstype;
-			fs_dev_part = part;
+		if (!fs_try_probe(info, part))
 			return 0;
-		}
 	}
 
 	return -1;
@@ -412,7 +815,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 {
 	struct fstype_info *info;
-	int ret, i;
+	int ret, found, i;
 
 	if (part >= 1)
 		ret = part_get_info(desc, part, &fs_partition);
@@ -422,24 +825,31 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 		return ret;
 	fs_dev_desc = desc;
 
+	found = fs_mount_lookup(fs_dev_desc, &fs_partition);
+	if (found != FS_TYPE_ANY && !fs_try_probe(fs_get_info(found), part))
+		return 0;
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
-		if (!info->probe(fs_dev_desc, &fs_partition)) {
-			fs_type = info->fstype;
-			fs_dev_part = part;
+		if (!fs_try_probe(info, part))
 			return 0;
-		}
 	}
 
 	return -1;
 }
 
-void fs_close(void)
+int fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
+	int ret;
 
 	info->close();
 
+	/* Write back anything the filesystem left in the block cache */
+	ret = blkcache_set_writeback(false);
+
 	fs_type = FS_TYPE_ANY;
+
+	return ret;
 }
 
 int fs_uuid(char *uuid_str)
@@ -467,8 +877,12 @@ int fs_exists(const char *filename)
 	int ret;
 
 	struct fstype_info *info = fs_get_info(fs_type);
+	loff_t size;
 
-	ret = info->exists(filename);
+	if (!fs_cache_get_size(filename, &size))
+		ret = 1;
+	else
+		ret = info->exists(filename);
 
 	fs_close();
 
@@ -481,7 +895,12 @@ int fs_size(const char *filename, loff_t *size)
 
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	ret = info->size(filename, size);
+	ret = fs_cache_get_size(filename, size);
+	if (ret) {
+		ret = info->size(filename, size);
+		if (!ret)
+			fs_cache_set_size(filename, *size);
+	}
 
 	fs_close();
 
@@ -521,15 +940,94 @@ static int fs_read_lmb_check(const char *filename, ulong addr, loff_t offset,
 	log_err("** Reading file would overwrite reserved memory **\n");
 	return -ENOSPC;
 }
+
+/* Get the amount of memory which can be written to from @addr onwards */
+static ulong fs_free_size(ulong addr)
+{
+	struct lmb lmb;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+
+	return lmb_get_free_size(&lmb, addr);
+}
+#else
+static ulong fs_free_size(ulong addr)
+{
+	return ULONG_MAX - addr;
+}
 #endif
 
+/* Bytes read at a time when hashing a file as it is loaded */
+#define FS_HASH_CHUNK	(1 << 20)
+
+/*
+ * Read a file a chunk at a time, hashing each chunk straight after reading it
+ * while it is still in the CPU cache
+ */
+static int fs_read_hashed(struct fstype_info *info, const char *filename,
+			  void *buf, loff_t offset, loff_t len,
+			  struct hash_algo *algo, u8 *digest, loff_t *actread)
+{
+	loff_t size, pos, chunk, n;
+	void *ctx;
+	int ret;
+
+	if (info->read_whole_only) {
+		ret = info->read(filename, buf, offset, len, actread);
+		if (!ret)
+			algo->hash_func_ws(buf, *actread, digest,
+					   algo->chunk_size);
+		return ret;
+	}
+
+	/* The size is needed to tell which chunk is the last */
+	if (!len) {
+		ret = info->size(filename, &size);
+		if (ret)
+			return ret;
+		len = size > offset ? size - offset : 0;
+	}
+
+	ret = algo->hash_init(algo, &ctx);
+	if (ret)
+		return ret;
+	for (pos = 0; pos < len; pos += n) {
+		chunk = min_t(loff_t, len - pos, FS_HASH_CHUNK);
+		ret = info->read(filename, buf + pos, offset + pos, chunk, &n);
+		if (ret) {
+			algo->hash_finish(algo, ctx, digest, algo->digest_size);
+			return ret;
+		}
+		/* A short read means the end of the file */
+		if (n < chunk)
+			len = pos + n;
+		ret = algo->hash_update(algo, ctx, buf + pos, n,
+					pos + n >= len);
+		if (ret) {
+			algo->hash_finish(algo, ctx, digest, algo->digest_size);
+			return ret;
+		}
+	}
+	*actread = pos;
+
+	return algo->hash_finish(algo, ctx, digest, algo->digest_size);
+}
+
 static int _fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
-		    int do_lmb_check, loff_t *actread)
+		    int do_lmb_check, const char *algo_name, u8 *digest,
+		    loff_t *actread)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
+	struct hash_algo *algo = NULL;
 	void *buf;
 	int ret;
 
+	if (CONFIG_IS_ENABLED(HASH) && algo_name) {
+		ret = hash_progressive_lookup_algo(algo_name, &algo);
+		if (ret)
+			return ret;
+	}
+
 #ifdef CONFIG_LMB
 	if (do_lmb_check) {
 		ret = fs_read_lmb_check(filename, addr, offset, len, info);
@@ -543,7 +1041,19 @@ static int _fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	 * means read the whole file.
 	 */
 	buf = map_sysmem(addr, len);
-	ret = info->read(filename, buf, offset, len, actread);
+	ret = fs_cache_read(filename, buf, offset, len, actread);
+	if (!ret && algo) {
+		algo->hash_func_ws(buf, *actread, digest, algo->chunk_size);
+	} else if (ret) {
+		if (algo)
+			ret = fs_read_hashed(info, filename, buf, offset, len,
+					     algo, digest, actread);
+		else
+			ret = info->read(filename, buf, offset, len, actread);
+		if (!ret)
+			fs_cache_fill(info, filename, buf, offset, len,
+				      *actread);
+	}
 	unmap_sysmem(buf);
 
 	/* If we requested a specific number of bytes, check we got it */
@@ -557,9 +1067,118 @@ static int _fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	    loff_t *actread)
 {
-	return _fs_read(filename, addr, offset, len, 0, actread);
+	return _fs_read(filename, addr, offset, len, 0, NULL, NULL, actread);
+}
+
+int fs_read_hash(const char *filename, ulong addr, loff_t offset, loff_t len,
+		 const char *algo_name, u8 *digest, loff_t *actread)
+{
+	if (!CONFIG_IS_ENABLED(HASH))
+		return -EPROTONOSUPPORT;
+
+	return _fs_read(filename, addr, offset, len, 0, algo_name, digest,
+			actread);
+}
+
+#if CONFIG_IS_ENABLED(FS_DECOMP)
+/* Compressed data read at a time when decompressing a file as it is loaded */
+#define FS_DECOMP_CHUNK	(256 << 10)
+
+static int fs_read_chunks(struct fstype_info *info, const char *filename,
+			  void *buf, loff_t offset, loff_t end, int comp,
+			  void *out, ulong size, loff_t *actread)
+{
+	struct fs_decomp dc;
+	loff_t pos, chunk, n;
+	long ret;
+
+	chunk = min_t(loff_t, end - offset, FS_DECOMP_CHUNK);
+	ret = info->read(filename, buf, offset, chunk, &n);
+	if (ret)
+		return ret;
+	if (comp < 0)
+		comp = image_decomp_type(buf, n);
+	ret = fs_decomp_init(&dc, comp, out, size);
+	if (ret) {
+		if (comp == IH_COMP_NONE)
+			log_err("File is not compressed\n");
+		else
+			log_err("Cannot decompress %s data while loading\n",
+				genimg_get_comp_name(comp));
+		return ret;
+	}
+
+	/*
+	 * Each chunk is decompressed straight after reading it, while it is
+	 * still in the CPU cache, into its final place
+	 */
+	for (pos = offset; ; ) {
+		ret = fs_decomp_feed(&dc, buf, n);
+		pos += n;
+		if (ret || dc.done || pos >= end || !n)
+			break;
+		chunk = min_t(loff_t, end - pos, FS_DECOMP_CHUNK);
+		ret = info->read(filename, buf, pos, chunk, &n);
+		if (ret)
+			break;
+	}
+	*actread = dc.pos;
+	if (ret) {
+		fs_decomp_finish(&dc);
+		return ret;
+	}
+	ret = fs_decomp_finish(&dc);
+	if (ret < 0) {
+		log_err("Compressed data ends early\n");
+		return ret;
+	}
+
+	return 0;
 }
 
+int fs_read_decomp(const char *filename, ulong addr, ulong size,
+		   loff_t offset, loff_t len, int comp, loff_t *actread)
+{
+	struct fstype_info *info = fs_get_info(fs_type);
+	loff_t file_size, end;
+	void *buf, *out;
+	int ret;
+
+	*actread = 0;
+	if (info->read_whole_only) {
+		log_err("Cannot decompress while loading from %s\n",
+			info->name);
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+	ret = info->size(filename, &file_size);
+	if (ret)
+		goto out;
+	end = file_size;
+	if (len && offset + len < end)
+		end = offset + len;
+	if (offset >= end) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	buf = malloc_cache_aligned(FS_DECOMP_CHUNK);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	out = map_sysmem(addr, size);
+	ret = fs_read_chunks(info, filename, buf, offset, end, comp, out, size,
+			     actread);
+	unmap_sysmem(out);
+	free(buf);
+out:
+	fs_close();
+
+	return ret;
+}
+#endif
+
 int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	     loff_t *actwrite)
 {
@@ -568,14 +1187,16 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	int ret;
 
 	buf = map_sysmem(addr, len);
+	blkcache_set_writeback(true);
 	ret = info->write(filename, buf, offset, len, actwrite);
 	unmap_sysmem(buf);
 
+	if (fs_close() && !ret)
+		ret = -EIO;
 	if (ret < 0 && len != *actwrite) {
 		log_err("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
-	fs_close();
 
 	return ret;
 }
@@ -638,9 +1259,11 @@ int fs_unlink(const char *filename)
 
 	struct fstype_info *info = fs_get_info(fs_type);
 
+	blkcache_set_writeback(true);
 	ret = info->unlink(filename);
 
-	fs_close();
+	if (fs_close() && !ret)
+		ret = -EIO;
 
 	return ret;
 }
@@ -651,9 +1274,11 @@ int fs_mkdir(const char *dirname)
 
 	struct fstype_info *info = fs_get_info(fs_type);
 
+	blkcache_set_writeback(true);
 	ret = info->mkdir(dirname);
 
-	fs_close();
+	if (fs_close() && !ret)
+		ret = -EIO;
 
 	return ret;
 }
@@ -663,13 +1288,15 @@ int fs_ln(const char *fname, const char *target)
 	struct fstype_info *info = fs_get_info(fs_type);
 	int ret;
 
+	blkcache_set_writeback(true);
 	ret = info->ln(fname, target);
 
+	if (fs_close() && !ret)
+		ret = -EIO;
 	if (ret < 0) {
 		log_err("** Unable to create link %s -> %s **\n", fname, target);
 		ret = -1;
 	}
-	fs_close();
 
 	return ret;
 }
@@ -699,13 +1326,50 @@ int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 	unsigned long addr;
 	const char *addr_str;
 	const char *filename;
+	const char *algo_name = NULL;
+	u8 digest[HASH_MAX_DIGEST_SIZE];
+	char digest_str[HASH_MAX_DIGEST_SIZE * 2 + 1];
+	struct hash_algo *algo;
 	loff_t bytes;
 	loff_t pos;
 	loff_t len_read;
-	int ret;
+	int ret, i;
+	int comp = IH_COMP_NONE;
 	unsigned long time;
 	char *ep;
 
+	while (argc > 2 && argv[1][0] == '-') {
+		if (CONFIG_IS_ENABLED(HASH) && !strcmp(argv[1], "-h")) {
+			/* -h <algo> hashes the file as it is loaded */
+			algo_name = argv[2];
+			if (hash_progressive_lookup_algo(algo_name, &algo)) {
+				log_err("Unknown hash algorithm '%s'\n",
+					algo_name);
+				return CMD_RET_FAILURE;
+			}
+		} else if (CONFIG_IS_ENABLED(FS_DECOMP) &&
+			   !strcmp(argv[1], "-z")) {
+			/* -z <comp> decompresses the file as it is loaded */
+			if (!strcmp(argv[2], "auto")) {
+				comp = -1;
+			} else {
+				comp = genimg_get_comp_id(argv[2]);
+				if (!fs_decomp_supported(comp)) {
+					log_err("Unknown compression '%s'\n",
+						argv[2]);
+					return CMD_RET_FAILURE;
+				}
+			}
+		} else {
+			return CMD_RET_USAGE;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+	/* The hash would be of the compressed data, which is not kept */
+	if (algo_name && comp != IH_COMP_NONE)
+		return CMD_RET_USAGE;
+
 	if (argc < 2)
 		return CMD_RET_USAGE;
 	if (argc > 7)
@@ -746,7 +1410,14 @@ int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 		pos = 0;
 
 	time = get_timer(0);
-	ret = _fs_read(filename, addr, pos, bytes, 1, &len_read);
+	if (CONFIG_IS_ENABLED(FS_DECOMP) && comp != IH_COMP_NONE) {
+		/* The uncompressed size is not known, so use all free memory */
+		ret = fs_read_decomp(filename, addr, fs_free_size(addr), pos,
+				     bytes, comp, &len_read);
+	} else {
+		ret = _fs_read(filename, addr, pos, bytes, 1, algo_name,
+			       digest, &len_read);
+	}
 	time = get_timer(time);
 	if (ret < 0) {
 		log_err("Failed to load '%s'\n", filename);
@@ -769,6 +1440,11 @@ int do_load(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[],
 
 	env_set_hex("fileaddr", addr);
 	env_set_hex("filesize", len_read);
+	if (algo_name) {
+		for (i = 0; i < algo->digest_size; i++)
+			sprintf(digest_str + i * 2, "%02x", digest[i]);
+		env_set("filehash", digest_str);
+	}
 
 	return 0;
 }
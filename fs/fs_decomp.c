@@ -0,0 +1,386 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Decompressing files while they are loaded
+ *
+ * Each compressed format is decoded a chunk at a time as the file is read,
+ * with the output written straight to where it is wanted, so that there is
+ * no need to load the whole compressed file somewhere first.
+ */
+
+#include <common.h>
+#include <gzip.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/unaligned.h>
+#include <u-boot/lz4.h>
+#include "fs_decomp.h"
+
+#define LZMA_HEADER_SIZE	(LZMA_PROPS_SIZE + sizeof(u64))
+
+#define LZ4F_BLOCKUNCOMPRESSED_FLAG	0x80000000U
+
+/* Parts of an LZ4 frame which the decoder is waiting for */
+enum {
+	LZ4_BLOCK_HEADER,
+	LZ4_BLOCK_DATA,
+	LZ4_BLOCK_CHECKSUM,
+};
+
+static int gzip_feed(struct fs_decomp *dc, const void *in, ulong len)
+{
+	z_stream *zs = &dc->zs;
+	int offset, r;
+
+	if (!dc->started) {
+		offset = gzip_parse_header(in, len);
+		if (offset < 0)
+			return -EINVAL;
+		zs->zalloc = gzalloc;
+		zs->zfree = gzfree;
+		if (inflateInit2(zs, -MAX_WBITS) != Z_OK)
+			return -ENOMEM;
+		dc->started = true;
+		in += offset;
+		len -= offset;
+	}
+
+	zs->next_in = (unsigned char *)in;
+	zs->avail_in = len;
+	zs->next_out = dc->dst + dc->pos;
+	zs->avail_out = dc->size - dc->pos;
+	r = inflate(zs, Z_NO_FLUSH);
+	dc->pos = zs->next_out - dc->dst;
+	if (r == Z_STREAM_END) {
+		dc->done = true;
+		return 0;
+	}
+	if (r != Z_OK && r != Z_BUF_ERROR) {
+		log_debug("inflate() returned %d\n", r);
+		return -EPROTO;
+	}
+	/* Input is left over only if the output is full */
+	if (zs->avail_in)
+		return -ENOBUFS;
+
+	return 0;
+}
+
+static int zstd_feed(struct fs_decomp *dc, const void *in, ulong len)
+{
+	ZSTD_inBuffer in_buf;
+	ZSTD_outBuffer out_buf;
+	size_t res;
+
+	if (!dc->started) {
+		ZSTD_frameParams params;
+		size_t wsize;
+
+		res = ZSTD_getFrameParams(&params, in, len);
+		if (ZSTD_isError(res) || res)
+			return -EINVAL;
+		wsize = ZSTD_DStreamWorkspaceBound(params.windowSize);
+		dc->zstd.workspace = malloc(wsize);
+		if (!dc->zstd.workspace)
+			return -ENOMEM;
+		dc->started = true;
+		dc->zstd.stream = ZSTD_initDStream(params.windowSize,
+						   dc->zstd.workspace, wsize);
+		if (!dc->zstd.stream)
+			return -EPROTO;
+	}
+
+	in_buf.src = in;
+	in_buf.pos = 0;
+	in_buf.size = len;
+	out_buf.dst = dc->dst;
+	out_buf.pos = dc->pos;
+	out_buf.size = dc->size;
+	while (in_buf.pos < in_buf.size) {
+		res = ZSTD_decompressStream(dc->zstd.stream, &out_buf, &in_buf);
+		dc->pos = out_buf.pos;
+		if (ZSTD_isError(res)) {
+			log_debug("ZSTD_decompressStream error %d\n",
+				  ZSTD_getErrorCode(res));
+			return -EPROTO;
+		}
+		if (!res) {
+			dc->done = true;
+			break;
+		}
+		if (out_buf.pos == out_buf.size)
+			return -ENOBUFS;
+	}
+
+	return 0;
+}
+
+static void *lzma_alloc(void *p, size_t size)
+{
+	return malloc(size);
+}
+
+static void lzma_free(void *p, void *address)
+{
+	free(address);
+}
+
+static ISzAlloc lzma_allocator = { lzma_alloc, lzma_free };
+
+static int lzma_feed(struct fs_decomp *dc, const void *in, ulong len)
+{
+	CLzmaDec *dec = &dc->lzma.dec;
+	ELzmaStatus status;
+	SizeT limit, src_len;
+	SRes res;
+
+	if (!dc->started) {
+		if (len < LZMA_HEADER_SIZE)
+			return -EINVAL;
+		LzmaDec_Construct(dec);
+		res = LzmaDec_AllocateProbs(dec, in, LZMA_PROPS_SIZE,
+					    &lzma_allocator);
+		if (res != SZ_OK)
+			return res == SZ_ERROR_MEM ? -ENOMEM : -EINVAL;
+		dc->started = true;
+		/* All ones means the size is not known and an end mark is used */
+		dc->lzma.unpacked = get_unaligned_le64(in + LZMA_PROPS_SIZE);
+		dec->dic = dc->dst;
+		dec->dicBufSize = dc->size;
+		LzmaDec_Init(dec);
+		in += LZMA_HEADER_SIZE;
+		len -= LZMA_HEADER_SIZE;
+	}
+
+	limit = min_t(u64, dc->size, dc->lzma.unpacked);
+	src_len = len;
+	res = LzmaDec_DecodeToDic(dec, limit, in, &src_len, LZMA_FINISH_ANY,
+				  &status);
+	dc->pos = dec->dicPos;
+	if (res != SZ_OK) {
+		log_debug("LzmaDec_DecodeToDic() returned %d\n", res);
+		return -EPROTO;
+	}
+	if (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+	    dc->pos == dc->lzma.unpacked)
+		dc->done = true;
+	else if (dc->pos == dc->size)
+		return -ENOBUFS;
+
+	return 0;
+}
+
+static int lz4_start(struct fs_decomp *dc, const void *in, ulong len)
+{
+	u8 flags, block_desc, size_code;
+	uint header_len;
+
+	if (len < sizeof(u32) + 3 * sizeof(u8))
+		return -EINVAL;
+	if (get_unaligned_le32(in) != LZ4F_MAGIC)
+		return -EINVAL;
+	flags = *(u8 *)(in + 4);
+	block_desc = *(u8 *)(in + 5);
+	if (((flags >> 6) & 0x3) != 1)
+		return -EPROTONOSUPPORT;
+	if ((flags & 0x03) || (block_desc & 0x8f))
+		return -EINVAL;
+	/* As with ulz4fn(), blocks which refer to earlier ones are not handled */
+	if (!(flags & 0x20))
+		return -EPROTONOSUPPORT;
+	size_code = block_desc >> 4;
+	if (size_code < 4)
+		return -EINVAL;
+
+	header_len = sizeof(u32) + 3 * sizeof(u8);
+	if (flags & 0x08)
+		header_len += sizeof(u64);
+	if (len < header_len)
+		return -EINVAL;
+
+	dc->lz4.block_max = 1 << (8 + 2 * size_code);
+	dc->lz4.checksum = flags & 0x10;
+	dc->lz4.state = LZ4_BLOCK_HEADER;
+	dc->lz4.need = sizeof(u32);
+	dc->started = true;
+
+	return header_len;
+}
+
+/* Deal with the next whole part of the frame, which is at @src */
+static int lz4_step(struct fs_decomp *dc, const void *src)
+{
+	u32 size;
+	size_t n;
+	int ret;
+
+	switch (dc->lz4.state) {
+	case LZ4_BLOCK_HEADER:
+		dc->lz4.block_header = get_unaligned_le32(src);
+		if (!dc->lz4.block_header) {
+			dc->done = true;
+			break;
+		}
+		size = dc->lz4.block_header & ~LZ4F_BLOCKUNCOMPRESSED_FLAG;
+		if (size > dc->lz4.block_max)
+			return -EINVAL;
+		dc->lz4.state = LZ4_BLOCK_DATA;
+		dc->lz4.need = size;
+		break;
+	case LZ4_BLOCK_DATA:
+		size = dc->lz4.need;
+		if (dc->lz4.block_header & LZ4F_BLOCKUNCOMPRESSED_FLAG) {
+			if (size > dc->size - dc->pos)
+				return -ENOBUFS;
+			memcpy(dc->dst + dc->pos, src, size);
+			dc->pos += size;
+		} else {
+			n = dc->size - dc->pos;
+			ret = ulz4_decompress_block(src, size, dc->dst + dc->pos,
+						    &n);
+			if (ret)
+				return ret;
+			dc->pos += n;
+		}
+		dc->lz4.state = dc->lz4.checksum ? LZ4_BLOCK_CHECKSUM :
+			LZ4_BLOCK_HEADER;
+		dc->lz4.need = sizeof(u32);
+		break;
+	case LZ4_BLOCK_CHECKSUM:
+		dc->lz4.state = LZ4_BLOCK_HEADER;
+		dc->lz4.need = sizeof(u32);
+		break;
+	}
+
+	return 0;
+}
+
+static int lz4_feed(struct fs_decomp *dc, const void *in, ulong len)
+{
+	const void *src;
+	u32 n;
+	int ret;
+
+	if (!dc->started) {
+		ret = lz4_start(dc, in, len);
+		if (ret < 0)
+			return ret;
+		in += ret;
+		len -= ret;
+	}
+
+	while (len && !dc->done) {
+		/*
+		 * Decode straight from the input if the whole part is there,
+		 * else gather it in a buffer until the next chunk comes
+		 */
+		if (!dc->lz4.have && len >= dc->lz4.need) {
+			src = in;
+			in += dc->lz4.need;
+			len -= dc->lz4.need;
+		} else {
+			if (!dc->lz4.buf) {
+				dc->lz4.buf = malloc(dc->lz4.block_max);
+				if (!dc->lz4.buf)
+					return -ENOMEM;
+			}
+			n = min_t(ulong, dc->lz4.need - dc->lz4.have, len);
+			memcpy(dc->lz4.buf + dc->lz4.have, in, n);
+			dc->lz4.have += n;
+			in += n;
+			len -= n;
+			if (dc->lz4.have < dc->lz4.need)
+				break;
+			src = dc->lz4.buf;
+			dc->lz4.have = 0;
+		}
+		ret = lz4_step(dc, src);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+bool fs_decomp_supported(int comp)
+{
+	switch (comp) {
+	case IH_COMP_GZIP:
+		return CONFIG_IS_ENABLED(GZIP);
+	case IH_COMP_ZSTD:
+		return CONFIG_IS_ENABLED(ZSTD);
+	case IH_COMP_LZMA:
+		return CONFIG_IS_ENABLED(LZMA);
+	case IH_COMP_LZ4:
+		return CONFIG_IS_ENABLED(LZ4);
+	}
+
+	return false;
+}
+
+int fs_decomp_init(struct fs_decomp *dc, int comp, void *dst, ulong size)
+{
+	if (!fs_decomp_supported(comp))
+		return -EPROTONOSUPPORT;
+
+	memset(dc, '\0', sizeof(*dc));
+	dc->comp = comp;
+	dc->dst = dst;
+	dc->size = size;
+
+	return 0;
+}
+
+int fs_decomp_feed(struct fs_decomp *dc, const void *in, ulong len)
+{
+	if (dc->done || !len)
+		return 0;
+
+	switch (dc->comp) {
+	case IH_COMP_GZIP:
+		if (CONFIG_IS_ENABLED(GZIP))
+			return gzip_feed(dc, in, len);
+		break;
+	case IH_COMP_ZSTD:
+		if (CONFIG_IS_ENABLED(ZSTD))
+			return zstd_feed(dc, in, len);
+		break;
+	case IH_COMP_LZMA:
+		if (CONFIG_IS_ENABLED(LZMA))
+			return lzma_feed(dc, in, len);
+		break;
+	case IH_COMP_LZ4:
+		if (CONFIG_IS_ENABLED(LZ4))
+			return lz4_feed(dc, in, len);
+		break;
+	}
+
+	return -EPROTONOSUPPORT;
+}
+
+long fs_decomp_finish(struct fs_decomp *dc)
+{
+	if (dc->started) {
+		switch (dc->comp) {
+		case IH_COMP_GZIP:
+			if (CONFIG_IS_ENABLED(GZIP))
+				inflateEnd(&dc->zs);
+			break;
+		case IH_COMP_ZSTD:
+			free(dc->zstd.workspace);
+			break;
+		case IH_COMP_LZMA:
+			if (CONFIG_IS_ENABLED(LZMA))
+				LzmaDec_FreeProbs(&dc->lzma.dec,
+						  &lzma_allocator);
+			break;
+		case IH_COMP_LZ4:
+			free(dc->lz4.buf);
+			break;
+		}
+	}
+	if (!dc->done)
+		return -EINVAL;
+
+	return dc->pos;
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Decompressing files while they are loaded
+ */
+
+#ifndef __FS_DECOMP_H
+#define __FS_DECOMP_H
+
+#include <u-boot/zlib.h>
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+#include <linux/zstd.h>
+
+/**
+ * struct fs_decomp - state of a streaming decompression
+ *
+ * The compressed data is passed in a chunk at a time, in order, and the
+ * output goes straight to its final place in memory.
+ *
+ * @comp: Compression type (IH_COMP_...)
+ * @dst: Start of the output buffer
+ * @size: Size of the output buffer
+ * @pos: Number of bytes decompressed so far
+ * @started: true once the stream header has been parsed
+ * @done: true once the end of the compressed stream has been seen
+ */
+struct fs_decomp {
+	int comp;
+	u8 *dst;
+	ulong size;
+	ulong pos;
+	bool started;
+	bool done;
+	union {
+		z_stream zs;
+		struct {
+			ZSTD_DStream *stream;
+			void *workspace;
+		} zstd;
+		struct {
+			CLzmaDec dec;
+			u64 unpacked;
+		} lzma;
+		struct {
+			u8 *buf;
+			u32 block_max;
+			u32 block_header;
+			u32 need;
+			u32 have;
+			int state;
+			bool checksum;
+		} lz4;
+	};
+};
+
+/**
+ * fs_decomp_supported() - Check whether a compression type can be streamed
+ *
+ * @comp: Compression type (IH_COMP_...)
+ * Return: true if fs_decomp_init() accepts @comp
+ */
+bool fs_decomp_supported(int comp);
+
+/**
+ * fs_decomp_init() - Set up a streaming decompression
+ *
+ * @dc: State to set up
+ * @comp: Compression type (IH_COMP_...)
+ * @dst: Output buffer
+ * @size: Size of the output buffer
+ * Return: 0 if OK, -EPROTONOSUPPORT if @comp is not supported
+ */
+int fs_decomp_init(struct fs_decomp *dc, int comp, void *dst, ulong size);
+
+/**
+ * fs_decomp_feed() - Decompress the next chunk of compressed data
+ *
+ * The first chunk must hold the whole stream header. Once @dc->done is set,
+ * any further data is ignored.
+ *
+ * @dc: Decompression state
+ * @in: Compressed data
+ * @len: Length of @in in bytes
+ * Return: 0 if OK, -ENOBUFS if the output buffer is full, -EINVAL or -EPROTO
+ *	if the data is corrupt, -ENOMEM if out of memory
+ */
+int fs_decomp_feed(struct fs_decomp *dc, const void *in, ulong len);
+
+/**
+ * fs_decomp_finish() - Finish a streaming decompression and free its memory
+ *
+ * This must be called once fs_decomp_init() has succeeded, even on error.
+ *
+ * @dc: Decompression state
+ * Return: number of bytes decompressed, or -EINVAL if the stream did not end
+ */
+long fs_decomp_finish(struct fs_decomp *dc);
+
+#endif
@@ -10,87 +10,114 @@
 #include <common.h>
 #include <blk.h>
 #include <compiler.h>
+#include <fs_internal.h>
 #include <log.h>
 #include <part.h>
 #include <memalign.h>
 
+/*
+ * Read whole blocks into a buffer which is not aligned for DMA. The blocks
+ * but the last are read to the first aligned address in the buffer, which
+ * they still fit after, and moved down into place; the last goes through
+ * @bounce. This avoids a separate read for each block.
+ */
+static int fs_read_misaligned(struct blk_desc *desc, lbaint_t sector,
+			      lbaint_t count, u8 *buf, u8 *bounce)
+{
+	u8 *aligned = PTR_ALIGN(buf, ARCH_DMA_MINALIGN);
+	ulong len;
+
+	if (count > 1 && aligned - buf < desc->blksz &&
+	    !(desc->blksz % ARCH_DMA_MINALIGN)) {
+		len = (count - 1) << desc->log2blksz;
+		if (blk_dread(desc, sector, count - 1, aligned) != count - 1)
+			return -EIO;
+		memmove(buf, aligned, len);
+		sector += count - 1;
+		buf += len;
+		count = 1;
+	}
+	for (; count; count--, sector++, buf += desc->blksz) {
+		if (blk_dread(desc, sector, 1, bounce) != 1)
+			return -EIO;
+		memcpy(buf, bounce, desc->blksz);
+	}
+
+	return 0;
+}
+
+int fs_blk_read(struct blk_desc *desc, lbaint_t start, u64 offset, ulong len,
+		void *buf)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, bounce, desc->blksz);
+	lbaint_t sector, count;
+	ulong skip, n;
+
+	sector = start + (offset >> desc->log2blksz);
+	skip = offset & (desc->blksz - 1);
+
+	/* Head: the end of a block which is only partly wanted */
+	if (skip && len) {
+		if (blk_dread(desc, sector, 1, bounce) != 1)
+			return -EIO;
+		n = min(desc->blksz - skip, len);
+		memcpy(buf, bounce + skip, n);
+		buf += n;
+		len -= n;
+		sector++;
+	}
+
+	/* Middle: whole blocks, read straight into the buffer if possible */
+	count = len >> desc->log2blksz;
+	if (count) {
+		if (IS_ALIGNED((ulong)buf, ARCH_DMA_MINALIGN)) {
+			if (blk_dread(desc, sector, count, buf) != count)
+				return -EIO;
+		} else {
+			log_debug("Misaligned buffer %p\n", buf);
+			if (fs_read_misaligned(desc, sector, count, buf, bounce))
+				return -EIO;
+		}
+		n = count << desc->log2blksz;
+		buf += n;
+		len -= n;
+		sector += count;
+	}
+
+	/* Tail: the start of the last block */
+	if (len) {
+		if (blk_dread(desc, sector, 1, bounce) != 1)
+			return -EIO;
+		memcpy(buf, bounce, len);
+	}
+
+	return 0;
+}
+
 int fs_devread(struct blk_desc *blk, struct disk_partition *partition,
 	       lbaint_t sector, int byte_offset, int byte_len, char *buf)
 {
-	unsigned block_len;
-	int log2blksz;
-	ALLOC_CACHE_ALIGN_BUFFER(char, sec_buf, (blk ? blk->blksz : 0));
 	if (blk == NULL) {
 		log_err("** Invalid Block Device Descriptor (NULL)\n");
 		return 0;
 	}
-	log2blksz = blk->log2blksz;
 
 	/* Check partition boundaries */
-	if ((sector + ((byte_offset + byte_len - 1) >> log2blksz))
+	if ((sector + ((byte_offset + byte_len - 1) >> blk->log2blksz))
 	    >= partition->size) {
 		log_err("%s read outside partition " LBAFU "\n", __func__,
 			sector);
 		return 0;
 	}
 
-	/* Get the read to the beginning of a partition */
-	sector += byte_offset >> log2blksz;
-	byte_offset &= blk->blksz - 1;
-
 	log_debug(" <" LBAFU ", %d, %d>\n", sector, byte_offset, byte_len);
 
-	if (byte_offset != 0) {
-		int readlen;
-		/* read first part which isn't aligned with start of sector */
-		if (blk_dread(blk, partition->start + sector, 1,
-			      (void *)sec_buf) != 1) {
-			log_err(" ** %s read error **\n", __func__);
-			return 0;
-		}
-		readlen = min((int)blk->blksz - byte_offset,
-			      byte_len);
-		memcpy(buf, sec_buf + byte_offset, readlen);
-		buf += readlen;
-		byte_len -= readlen;
-		sector++;
-	}
-
-	if (byte_len == 0)
-		return 1;
-
-	/* read sector aligned part */
-	block_len = byte_len & ~(blk->blksz - 1);
-
-	if (block_len == 0) {
-		ALLOC_CACHE_ALIGN_BUFFER(u8, p, blk->blksz);
-
-		block_len = blk->blksz;
-		blk_dread(blk, partition->start + sector, 1,
-			  (void *)p);
-		memcpy(buf, p, byte_len);
-		return 1;
-	}
-
-	if (blk_dread(blk, partition->start + sector,
-		      block_len >> log2blksz, (void *)buf) !=
-			block_len >> log2blksz) {
-		log_err(" ** %s read error - block\n", __func__);
+	if (fs_blk_read(blk, partition->start,
+			((u64)sector << blk->log2blksz) + byte_offset, byte_len,
+			buf)) {
+		log_err(" ** %s read error **\n", __func__);
 		return 0;
 	}
-	block_len = byte_len & ~(blk->blksz - 1);
-	buf += block_len;
-	byte_len -= block_len;
-	sector += block_len / blk->blksz;
-
-	if (byte_len != 0) {
-		/* read rest of data which are not in whole sector */
-		if (blk_dread(blk, partition->start + sector, 1,
-			      (void *)sec_buf) != 1) {
-			log_err("* %s read error - last part\n", __func__);
-			return 0;
-		}
-		memcpy(buf, sec_buf, byte_len);
-	}
+
 	return 1;
 }
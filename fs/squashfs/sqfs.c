@@ -10,6 +10,7 @@
 #include <asm/unaligned.h>
 #include <errno.h>
 #include <fs.h>
+#include <fs_internal.h>
 #include <linux/types.h>
 #include <linux/byteorder/little_endian.h>
 #include <linux/byteorder/generic.h>
@@ -25,6 +26,74 @@
 
 static struct squashfs_ctxt ctxt;
 
+/* A decompressed data or fragment block */
+struct sqfs_cached_block {
+	/* Byte offset of the compressed block in the filesystem */
+	u64 start;
+	/* Decompressed length, zero if the entry is unused */
+	unsigned long len;
+	ulong last_used;
+	char *data;
+};
+
+/*
+ * Decompressed metadata and blocks of the filesystem used last. fs.c probes
+ * and closes the filesystem around every command, so this is kept across
+ * sqfs_close() and checked against the device and superblock in
+ * sqfs_probe() instead.
+ */
+static struct {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	uint media_gen;
+	struct squashfs_super_block sblk;
+	struct squashfs_tables *tables;
+	struct sqfs_cached_block blocks[CONFIG_FS_SQUASHFS_BLOCK_CACHE];
+	ulong clock;
+} cache;
+
+static void sqfs_put_tables(struct squashfs_tables *tables)
+{
+	if (!tables || --tables->refcount)
+		return;
+
+	free(tables->inode_table);
+	free(tables->dir_table);
+	free(tables->pos_list);
+	free(tables);
+}
+
+static void sqfs_cache_drop(void)
+{
+	int i;
+
+	sqfs_put_tables(cache.tables);
+	cache.tables = NULL;
+	for (i = 0; i < ARRAY_SIZE(cache.blocks); i++) {
+		free(cache.blocks[i].data);
+		cache.blocks[i].data = NULL;
+		cache.blocks[i].len = 0;
+	}
+}
+
+/* Drop the cache unless it belongs to the filesystem in ctxt */
+static void sqfs_cache_check(void)
+{
+	struct blk_desc *dev = ctxt.cur_dev;
+
+	if (!dev->uncached && cache.dev == dev &&
+	    cache.part_start == ctxt.cur_part_info.start &&
+	    cache.media_gen == dev->media_gen &&
+	    !memcmp(&cache.sblk, ctxt.sblk, sizeof(cache.sblk)))
+		return;
+
+	sqfs_cache_drop();
+	cache.dev = dev;
+	cache.part_start = ctxt.cur_part_info.start;
+	cache.media_gen = dev->media_gen;
+	memcpy(&cache.sblk, ctxt.sblk, sizeof(cache.sblk));
+}
+
 static int sqfs_disk_read(__u32 block, __u32 nr_blocks, void *buf)
 {
 	ulong ret;
@@ -92,6 +161,66 @@ static int sqfs_calc_n_blks(__le64 start, __le64 end, u64 *offset)
 	return DIV_ROUND_UP(table_size + *offset, ctxt.cur_dev->blksz);
 }
 
+/*
+ * Points @datap to the decompressed contents of the compressed block of
+ * @size bytes at byte @start of the filesystem, reading the block in if it
+ * is not cached. The data stays valid until the next call.
+ */
+static int sqfs_get_block(u64 start, u32 size, char **datap,
+			  unsigned long *lenp)
+{
+	u32 block_size = get_unaligned_le32(&ctxt.sblk->block_size);
+	struct sqfs_cached_block *blk, *lru = NULL;
+	u64 sect, n_blks, offset;
+	char *buf = NULL;
+	int i, ret = 0;
+
+	for (i = 0; i < ARRAY_SIZE(cache.blocks); i++) {
+		blk = &cache.blocks[i];
+		if (blk->len && blk->start == start)
+			goto found;
+		if (!lru || blk->last_used < lru->last_used)
+			lru = blk;
+	}
+
+	blk = lru;
+	blk->len = 0;
+	if (!blk->data) {
+		blk->data = malloc(block_size);
+		if (!blk->data)
+			return -ENOMEM;
+	}
+
+	sect = start / ctxt.cur_dev->blksz;
+	offset = start - sect * ctxt.cur_dev->blksz;
+	n_blks = DIV_ROUND_UP(size + offset, ctxt.cur_dev->blksz);
+	buf = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	if (sqfs_disk_read(sect, n_blks, buf) < 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	blk->len = block_size;
+	ret = sqfs_decompress(&ctxt, blk->data, &blk->len, buf + offset, size);
+	if (ret) {
+		blk->len = 0;
+		goto out;
+	}
+	blk->start = start;
+
+found:
+	blk->last_used = ++cache.clock;
+	*datap = blk->data;
+	*lenp = blk->len;
+out:
+	free(buf);
+
+	return ret;
+}
+
 /*
  * Retrieves fragment block entry and returns true if the fragment block is
  * compressed
@@ -868,13 +997,49 @@ out:
 	return metablks_count;
 }
 
+/*
+ * Returns a reference to the decompressed tables, decompressing them if they
+ * are not cached already
+ */
+static struct squashfs_tables *sqfs_get_tables(void)
+{
+	struct squashfs_tables *tables = cache.tables;
+
+	if (tables) {
+		tables->refcount++;
+		return tables;
+	}
+
+	tables = calloc(1, sizeof(*tables));
+	if (!tables)
+		return NULL;
+
+	tables->refcount = 1;
+	if (sqfs_read_inode_table(&tables->inode_table))
+		goto err;
+
+	tables->metablks_count = sqfs_read_directory_table(&tables->dir_table,
+							   &tables->pos_list);
+	if (tables->metablks_count < 1)
+		goto err;
+
+	/* One reference for the cache and one for the caller */
+	tables->refcount++;
+	cache.tables = tables;
+
+	return tables;
+err:
+	sqfs_put_tables(tables);
+
+	return NULL;
+}
+
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
+	int j, token_count = 0, ret = 0;
 	struct squashfs_dir_stream *dirs;
+	struct squashfs_tables *tables;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -887,17 +1052,12 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
-	if (ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
+	tables = sqfs_get_tables();
+	if (!tables) {
 		ret = -EINVAL;
 		goto out;
 	}
+	dirs->tables = tables;
 
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
@@ -926,10 +1086,10 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	dirs->inode_table = tables->inode_table;
+	dirs->dir_table = tables->dir_table;
+	ret = sqfs_search_dir(dirs, token_list, token_count, tables->pos_list,
+			      tables->metablks_count);
 	if (ret)
 		goto out;
 
@@ -953,10 +1113,9 @@ out:
 	for (j = 0; j < token_count; j++)
 		free(token_list[j]);
 	free(token_list);
-	free(pos_list);
 	free(path);
 	if (ret) {
-		free(inode_table);
+		sqfs_put_tables(dirs->tables);
 		free(dirs);
 	}
 
@@ -1102,6 +1261,8 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 		goto error;
 	}
 
+	sqfs_cache_check();
+
 	return 0;
 error:
 	ctxt.cur_dev = NULL;
@@ -1308,9 +1469,9 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	      loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL, *data_buffer = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
-	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
+	char *dir = NULL, *fragment_block, *datablock = NULL;
+	char *file = NULL, *resolved;
+	u64 table_size, data_offset, sparse_size;
 	int ret, j, i_number, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
@@ -1428,49 +1589,9 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		len = finfo.size;
 	}
 
-	if (datablk_count) {
-		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
-		if (!datablock) {
-			ret = -ENOMEM;
-			goto out;
-		}
-	}
-
+	data_offset = finfo.start;
 	for (j = 0; j < datablk_count; j++) {
-		start = data_offset / ctxt.cur_dev->blksz;
 		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
-		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
-		n_blks = DIV_ROUND_UP(table_size + table_offset,
-				      ctxt.cur_dev->blksz);
-
-		/* Don't load any data for sparse blocks */
-		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
-		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-			if (!data_buffer) {
-				ret = -ENOMEM;
-				goto out;
-			}
-
-			ret = sqfs_disk_read(start, n_blks, data_buffer);
-			if (ret < 0) {
-				/*
-				 * Possible causes: too many data blocks or too large
-				 * SquashFS block size. Tip: re-compile the SquashFS
-				 * image with mksquashfs's -b <block_size> option.
-				 */
-				printf("Error: too many data blocks to be read.\n");
-				goto out;
-			}
-
-			data = data_buffer + table_offset;
-		}
 
 		/* Load the data */
 		if (finfo.blk_sizes[j] == 0) {
@@ -1481,9 +1602,8 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			memset(buf + *actread, 0, sparse_size);
 			*actread += sparse_size;
 		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
+			ret = sqfs_get_block(data_offset, table_size, &datablock,
+					     &dest_len);
 			if (ret)
 				goto out;
 
@@ -1492,16 +1612,18 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			memcpy(buf + *actread, datablock, dest_len);
 			*actread += dest_len;
 		} else {
+			/* Uncompressed data goes straight into the buffer */
 			if ((*actread + table_size) > len)
 				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
+			ret = fs_blk_read(ctxt.cur_dev, ctxt.cur_part_info.start,
+					  data_offset, table_size,
+					  buf + *actread);
+			if (ret)
+				goto out;
 			*actread += table_size;
 		}
 
 		data_offset += table_size;
-		if (data_buffer)
-			free(data_buffer);
-		data_buffer = NULL;
 		if (*actread >= len)
 			break;
 	}
@@ -1514,57 +1636,26 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
-	start = frag_entry.start / ctxt.cur_dev->blksz;
 	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-	if (!fragment) {
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
-		goto out;
 
 	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
+	if (finfo.comp) {
+		ret = sqfs_get_block(frag_entry.start, table_size,
+				     &fragment_block, &dest_len);
+		if (ret)
 			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
+		memcpy(buf + *actread, &fragment_block[finfo.offset],
+		       finfo.size - *actread);
+	} else {
+		ret = fs_blk_read(ctxt.cur_dev, ctxt.cur_part_info.start,
+				  frag_entry.start + finfo.offset,
+				  finfo.size - *actread, buf + *actread);
+		if (ret)
 			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
 	}
+	*actread = finfo.size;
 
 out:
-	free(fragment);
-	if (datablk_count) {
-		free(data_buffer);
-		free(datablock);
-	}
 	free(file);
 	free(dir);
 	free(finfo.blk_sizes);
@@ -1716,8 +1807,7 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	sqfs_put_tables(sqfs_dirs->tables);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
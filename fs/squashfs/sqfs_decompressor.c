@@ -14,6 +14,10 @@
 #include <linux/lzo.h>
 #endif
 
+#if IS_ENABLED(CONFIG_LZ4)
+#include <u-boot/lz4.h>
+#endif
+
 #if IS_ENABLED(CONFIG_ZLIB)
 #include <u-boot/zlib.h>
 #endif
@@ -22,6 +26,11 @@
 #include <linux/zstd.h>
 #endif
 
+#if IS_ENABLED(CONFIG_XZ)
+#include <lzma/LzmaTypes.h>
+#include <lzma/XzTools.h>
+#endif
+
 #include "sqfs_decompressor.h"
 #include "sqfs_utils.h"
 
@@ -38,12 +47,24 @@ int sqfs_decompressor_init(struct squashfs_ctxt *ctxt)
 	case SQFS_COMP_ZLIB:
 		break;
 #endif
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		break;
+#endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
 		ctxt->zstd_workspace = malloc(ZSTD_DCtxWorkspaceBound());
 		if (!ctxt->zstd_workspace)
 			return -ENOMEM;
 		break;
+#endif
+#if IS_ENABLED(CONFIG_XZ)
+	case SQFS_COMP_XZ:
+		break;
+#else
+	case SQFS_COMP_XZ:
+		printf("Error: XZ compression is not supported.\n");
+		return -EPROTONOSUPPORT;
 #endif
 	default:
 		printf("Error: unknown compression type.\n");
@@ -66,10 +87,18 @@ void sqfs_decompressor_cleanup(struct squashfs_ctxt *ctxt)
 	case SQFS_COMP_ZLIB:
 		break;
 #endif
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		break;
+#endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
 		free(ctxt->zstd_workspace);
 		break;
+#endif
+#if IS_ENABLED(CONFIG_XZ)
+	case SQFS_COMP_XZ:
+		break;
 #endif
 	}
 }
@@ -136,6 +165,21 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 
 		break;
 #endif
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4: {
+		size_t lz4_dest_len = *dest_len;
+
+		ret = ulz4_decompress_block(source, src_len, dest,
+					    &lz4_dest_len);
+		if (ret) {
+			printf("LZ4 decompression failed. Error code: %d\n", ret);
+			return -EINVAL;
+		}
+		*dest_len = lz4_dest_len;
+
+		break;
+	}
+#endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
 		ret = sqfs_zstd_decompress(ctxt, dest, *dest_len, source, src_len);
@@ -145,6 +189,21 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 		}
 
 		break;
+#endif
+#if IS_ENABLED(CONFIG_XZ)
+	case SQFS_COMP_XZ: {
+		SizeT xz_dest_len = *dest_len;
+
+		ret = xzBuffToBuffDecompress(dest, &xz_dest_len, source,
+					     src_len);
+		if (ret) {
+			printf("XZ decompression failed. Error code: %d\n", ret);
+			return -EINVAL;
+		}
+		*dest_len = xz_dest_len;
+
+		break;
+	}
 #endif
 	default:
 		printf("Error: unknown compression type.\n");
@@ -249,6 +249,19 @@ struct squashfs_fragment_block_entry {
 	u32 _unused;
 };
 
+/*
+ * Decompressed inode and directory tables. They are shared by the open
+ * directory streams and the table cache, and freed with the last reference.
+ */
+struct squashfs_tables {
+	int refcount;
+	unsigned char *inode_table;
+	unsigned char *dir_table;
+	/* Positions of the directory table's metadata blocks */
+	u32 *pos_list;
+	int metablks_count;
+};
+
 struct squashfs_dir_stream {
 	struct fs_dir_stream fs_dirs;
 	struct fs_dirent dentp;
@@ -274,8 +287,10 @@ struct squashfs_dir_stream {
 	struct squashfs_ldir_inode i_ldir;
 	/*
 	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * sqfs_opendir() and point into 'tables', which is released in
+	 * sqfs_closedir().
 	 */
+	struct squashfs_tables *tables;
 	unsigned char *inode_table;
 	unsigned char *dir_table;
 };
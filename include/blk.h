@@ -38,6 +38,7 @@ enum if_type {
 	IF_TYPE_PVBLOCK,
 	IF_TYPE_VIRTIO,
 	IF_TYPE_EFI_MEDIA,
+	IF_TYPE_BLKMAP,
 
 	IF_TYPE_COUNT,			/* Number of interface types */
 };
@@ -87,6 +88,13 @@ struct blk_desc {
 	char		vendor[BLK_VEN_SIZE + 1]; /* device vendor string */
 	char		product[BLK_PRD_SIZE + 1]; /* device product number */
 	char		revision[BLK_REV_SIZE + 1]; /* firmware revision */
+	/* changes whenever the medium or its partitions may have changed */
+	unsigned int	media_gen;
+	/* changes whenever the device is written or erased */
+	unsigned int	write_gen;
+	/* contents can change behind the block layer, e.g. memory: no caching */
+	bool		uncached;
+	struct gpt_cache *gpt_cache;	/* GPT read from the device, if any */
 	enum sig_type	sig_type;	/* Partition table signature type */
 	union {
 		uint32_t mbr_sig;	/* MBR integer signature */
@@ -136,7 +144,8 @@ int blkcache_init(void);
  * @param blksz - size in bytes of each block
  * @param buf - buffer to contain cached data
  *
- * @return - 1 if block returned from cache, 0 otherwise.
+ * @return - 1 if block returned from cache, 0 otherwise, or -EIO if cached
+ * writes to these blocks could not be written back first
  */
 int blkcache_read(int iftype, int dev,
 		  lbaint_t start, lbaint_t blkcnt,
@@ -146,6 +155,8 @@ int blkcache_read(int iftype, int dev,
  * blkcache_fill() - make data read from a block device available
  * to the block cache
  *
+ * Blocks which are already in the cache are left alone.
+ *
  * @param iftype - IF_TYPE_x for type of device
  * @param dev - device index of particular type
  * @param start - starting block number
@@ -158,10 +169,58 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_write() - handle a write to a block device
+ *
+ * With CONFIG_BLOCK_CACHE_WRITEBACK, while write-back is enabled by
+ * blkcache_set_writeback(), small writes are kept in the cache and only
+ * written to the device by blkcache_flush(), or when the blocks are evicted.
+ * Otherwise any cached copies of the blocks are dropped and the caller must
+ * write the data to the device.
+ *
+ * @param desc - block device being written to
+ * @param start - starting block number
+ * @param blkcnt - number of blocks to write
+ * @param buf - buffer containing data to write
+ *
+ * @return - 1 if the cache took the data, 0 if the caller must write it
+ */
+int blkcache_write(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		   const void *buffer);
+
+/**
+ * blkcache_flush() - write back the cached blocks of a device
+ *
+ * This does nothing unless CONFIG_BLOCK_CACHE_WRITEBACK is enabled.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ *
+ * @return - 0 if OK, -ve on error
+ */
+int blkcache_flush(int iftype, int dev);
+
+/**
+ * blkcache_set_writeback() - allow writes to be held in the cache
+ *
+ * Write-back is only enabled while a filesystem writes through fs_write() and
+ * friends, all of which close the filesystem when done. Writes made in other
+ * ways, such as raw block or environment writes, always go straight to the
+ * device. This does nothing unless CONFIG_BLOCK_CACHE_WRITEBACK is enabled.
+ *
+ * @param enable - true to hold writes, false to write back all dirty blocks
+ *		   and write straight to the device from then on
+ *
+ * @return - 0 if OK, -ve if a dirty block could not be written back
+ */
+int blkcache_set_writeback(bool enable);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
  *
+ * Any blocks waiting to be written back are written first.
+ *
  * @param iftype - IF_TYPE_x for type of device
  * @param dev - device index of particular type
  */
@@ -170,10 +229,13 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * The cache size can also be set in MiB with the 'blkcachesize' environment
+ * variable.
+ *
+ * @param blocks - maximum blocks per read or write to cache
+ * @param size_mb - maximum size of the cache in MiB
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure(unsigned blocks, unsigned size_mb);
 
 /*
  * statistics of the block cache
@@ -181,9 +243,13 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
-	unsigned entries; /* current entry count */
+	unsigned evictions;
+	unsigned writebacks; /* blocks written back */
+	unsigned entries; /* current number of cached blocks */
+	unsigned dirty; /* cached blocks waiting to be written */
+	unsigned long size; /* current size in bytes */
+	unsigned long max_size;
 	unsigned max_blocks_per_entry;
-	unsigned max_entries;
 };
 
 /**
@@ -206,6 +272,22 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline int blkcache_write(struct blk_desc *desc, lbaint_t start,
+				 lbaint_t blkcnt, const void *buffer)
+{
+	return 0;
+}
+
+static inline int blkcache_flush(int iftype, int dev)
+{
+	return 0;
+}
+
+static inline int blkcache_set_writeback(bool enable)
+{
+	return 0;
+}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 #endif
@@ -213,6 +295,78 @@ static inline void blkcache_invalidate(int iftype, int dev) {}
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
 
+/**
+ * struct blk_req - an asynchronous read or write request
+ *
+ * Set up @start, @blkcnt, @buffer and @write, then pass this to
+ * blk_submit(). The request and buffer must stay valid until blk_poll() or
+ * blk_wait() reports that it is complete.
+ *
+ * @start: Start block number (0=first)
+ * @blkcnt: Number of blocks to transfer
+ * @buffer: Data buffer
+ * @write: true to write @buffer to the device, false to read into it
+ * @done: true once the request is complete (set by the uclass)
+ * @result: Number of blocks transferred, or -ve error number, once complete
+ * @submit_us: Time the request was passed to the driver, in microseconds (set
+ *	by the uclass for statistics)
+ */
+struct blk_req {
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	bool write;
+	bool done;
+	long result;
+	ulong submit_us;
+};
+
+/* Operation types recorded in block-device statistics */
+enum blk_stats_op {
+	BLK_STATS_READ,
+	BLK_STATS_WRITE,
+	BLK_STATS_ERASE,
+
+	BLK_STATS_OP_COUNT,
+};
+
+/*
+ * Number of buckets in each histogram. Bucket n counts values in the range
+ * [2^n, 2^(n+1)), except that bucket 0 also counts 0 and the last bucket
+ * counts everything larger.
+ */
+#define BLK_STATS_HIST_SIZE	16
+
+/**
+ * struct blk_op_stats - statistics for one type of operation on a device
+ *
+ * Only requests passed to the driver are counted, not those handled by the
+ * block cache. Writes held by the block cache are counted when they are
+ * written back. A request which fails is counted, but its blocks are not.
+ *
+ * @count: Number of requests
+ * @blocks: Total number of blocks transferred
+ * @time_us: Total time taken by the requests, in microseconds
+ * @size_hist: Histogram of request sizes in blocks
+ * @time_hist: Histogram of request latencies in microseconds
+ */
+struct blk_op_stats {
+	ulong count;
+	u64 blocks;
+	u64 time_us;
+	ulong size_hist[BLK_STATS_HIST_SIZE];
+	ulong time_hist[BLK_STATS_HIST_SIZE];
+};
+
+/**
+ * struct blk_stats - I/O statistics for a block device
+ *
+ * @op: Statistics for each operation, indexed by enum blk_stats_op
+ */
+struct blk_stats {
+	struct blk_op_stats op[BLK_STATS_OP_COUNT];
+};
+
 /* Operations on block devices */
 struct blk_ops {
 	/**
@@ -271,6 +425,32 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - start a read or write without waiting for it (optional)
+	 *
+	 * Drivers which do not provide this have their requests carried out
+	 * by the uclass, synchronously, in blk_submit().
+	 *
+	 * @dev:	Device to access
+	 * @req:	Request to start
+	 * @return 0 if started, -EBUSY if the device cannot take another
+	 *	request until an earlier one completes, other -ve on error
+	 */
+	int (*submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * poll() - check whether a submitted request has completed
+	 *
+	 * This must be provided if submit() is. It must not wait for the
+	 * request to complete.
+	 *
+	 * @dev:	Device to check
+	 * @req:	Request previously passed to submit()
+	 * @return 0 if complete, with @req->result set, -EINPROGRESS if not
+	 *	complete yet
+	 */
+	int (*poll)(struct udevice *dev, struct blk_req *req);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -288,6 +468,84 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_write_back() - Write blocks held by the block cache to the device
+ *
+ * The blocks are passed straight to the driver, bypassing the block cache,
+ * and are counted in the device's statistics like any other write.
+ *
+ * @desc: Block device to write to
+ * @start: First block number to write
+ * @blkcnt: Number of blocks to write
+ * @buffer: Data to write
+ * @return number of blocks written, or -ve error number
+ */
+ulong blk_write_back(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		     const void *buffer);
+
+/**
+ * blk_submit() - Start an asynchronous read or write
+ *
+ * With a driver which supports asynchronous I/O (virtio-blk, NVMe and the
+ * sandbox host device) the caller can do other work while the device
+ * transfers data. Reads which can be satisfied from the block cache, and all
+ * requests to other devices, including MMC, complete before this returns.
+ *
+ * @desc: Block device to access
+ * @req: Request to start, see struct blk_req
+ * @return 0 if OK (the request may already be complete), -EBUSY if the device
+ *	cannot take another request until an earlier one completes, other -ve on
+ *	error
+ */
+int blk_submit(struct blk_desc *desc, struct blk_req *req);
+
+/**
+ * blk_poll() - Check whether an asynchronous request has completed
+ *
+ * @desc: Block device the request was submitted to
+ * @req: Request to check
+ * @return 0 if complete (see @req->result), -EINPROGRESS if not yet
+ */
+int blk_poll(struct blk_desc *desc, struct blk_req *req);
+
+/**
+ * blk_wait() - Wait for an asynchronous request to complete
+ *
+ * Other threads are given a chance to run while waiting.
+ *
+ * @desc: Block device the request was submitted to
+ * @req: Request to wait for
+ * @return number of blocks transferred, or -ve error number
+ */
+long blk_wait(struct blk_desc *desc, struct blk_req *req);
+
+#if CONFIG_IS_ENABLED(BLK_STATS)
+/**
+ * blk_get_stats() - Get the I/O statistics for a block device
+ *
+ * The statistics are kept while the device is probed and start from zero
+ * each time it is probed.
+ *
+ * @dev: Block device (must be probed)
+ * @return pointer to the statistics
+ */
+struct blk_stats *blk_get_stats(struct udevice *dev);
+
+/**
+ * blk_reset_stats() - Clear the I/O statistics for a block device
+ *
+ * @dev: Block device (must be probed)
+ */
+void blk_reset_stats(struct udevice *dev);
+#else
+static inline struct blk_stats *blk_get_stats(struct udevice *dev)
+{
+	return NULL;
+}
+
+static inline void blk_reset_stats(struct udevice *dev) {}
+#endif
+
 /**
  * blk_find_device() - Find a block device
  *
@@ -455,7 +713,7 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 {
 	ulong blks_read;
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
-			  start, blkcnt, block_dev->blksz, buffer))
+			  start, blkcnt, block_dev->blksz, buffer) > 0)
 		return blkcnt;
 
 	/*
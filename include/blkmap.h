@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Block devices made up of slices of memory or of other block devices
+ */
+
+#ifndef _BLKMAP_H
+#define _BLKMAP_H
+
+#include <blk.h>
+
+struct udevice;
+
+/**
+ * blkmap_map_linear() - Map a range of blocks on another device
+ *
+ * @dev: blkmap device
+ * @blknr: First block of the blkmap to map
+ * @blkcnt: Number of blocks to map
+ * @lblk: Block device to map onto
+ * @lblknr: First block on @lblk to map onto
+ * Return: 0 if OK, -EINVAL if the block sizes differ or @blkcnt is 0,
+ *	-EBUSY if the range is already mapped, -ENOMEM if out of memory
+ */
+int blkmap_map_linear(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
+		      struct udevice *lblk, lbaint_t lblknr);
+
+/**
+ * blkmap_map_mem() - Map a region of memory
+ *
+ * The memory must stay valid, and should not be changed other than through
+ * the blkmap, until the blkmap is destroyed.
+ *
+ * @dev: blkmap device
+ * @blknr: First block of the blkmap to map
+ * @blkcnt: Number of blocks to map
+ * @addr: Start of the memory to map
+ * Return: 0 if OK, -EINVAL if @blkcnt is 0, -EBUSY if the range is already
+ *	mapped, -ENOMEM if out of memory
+ */
+int blkmap_map_mem(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
+		   void *addr);
+
+/**
+ * blkmap_map_pmem() - Map a region of memory given by its physical address
+ *
+ * This is as blkmap_map_mem(), but maps the memory with map_sysmem() for as
+ * long as it is mapped to the blkmap.
+ *
+ * @dev: blkmap device
+ * @blknr: First block of the blkmap to map
+ * @blkcnt: Number of blocks to map
+ * @paddr: Physical address of the memory to map
+ * Return: 0 if OK, or -ve error as for blkmap_map_mem()
+ */
+int blkmap_map_pmem(struct udevice *dev, lbaint_t blknr, lbaint_t blkcnt,
+		    phys_addr_t paddr);
+
+/**
+ * blkmap_from_label() - Find a blkmap by its label
+ *
+ * @label: Label given when the blkmap was created
+ * Return: blkmap device, or NULL if there is none with that label
+ */
+struct udevice *blkmap_from_label(const char *label);
+
+/**
+ * blkmap_create() - Create a blkmap with nothing mapped
+ *
+ * @label: Label for the new blkmap, which must not be in use
+ * @devp: Returns the blkmap device
+ * Return: 0 if OK, -EBUSY if @label is in use, or other -ve error
+ */
+int blkmap_create(const char *label, struct udevice **devp);
+
+/**
+ * blkmap_destroy() - Remove a blkmap and everything mapped to it
+ *
+ * @dev: blkmap device
+ * Return: 0 if OK, -ve on error
+ */
+int blkmap_destroy(struct udevice *dev);
+
+#endif
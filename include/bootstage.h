@@ -19,6 +19,12 @@ enum bootstage_flags {
 	BOOTSTAGEF_ALLOC	= 1 << 1,	/* Allocate an id */
 };
 
+/* Output formats for bootstage_export() */
+enum bootstage_export_fmt {
+	BOOTSTAGE_EXPORT_CSV,
+	BOOTSTAGE_EXPORT_JSON,
+};
+
 /* bootstate sub-IDs used for kernel and ramdisk ranges */
 enum {
 	BOOTSTAGE_SUB_FORMAT,
@@ -345,6 +351,25 @@ int bootstage_stash(void *base, int size);
  */
 int bootstage_unstash(const void *base, int size);
 
+/**
+ * bootstage_export() - Export bootstage records in a machine-readable format
+ *
+ * Each record is written with its ID, name, start time and accumulated time
+ * (both in microseconds). For 'mark' records the start time is the time of
+ * the mark and the accumulated time is 0.
+ *
+ * CSV output has a header line followed by one line per record. JSON output
+ * is a single object with a "records" array. Names are quoted and escaped as
+ * each format requires.
+ *
+ * @buf: Buffer to write to, or NULL to just obtain the size needed
+ * @size: Size of buffer in bytes
+ * @fmt: Output format to use
+ * @return number of bytes in the output, not including the terminating nul.
+ *	If this is >= @size the output was truncated
+ */
+int bootstage_export(char *buf, int size, enum bootstage_export_fmt fmt);
+
 /**
  * bootstage_get_size() - Get the size of the bootstage data
  *
@@ -421,6 +446,12 @@ static inline int bootstage_unstash(const void *base, int size)
 	return 0;	/* Pretend to succeed */
 }
 
+static inline int bootstage_export(char *buf, int size,
+				   enum bootstage_export_fmt fmt)
+{
+	return 0;
+}
+
 static inline int bootstage_get_size(void)
 {
 	return 0;
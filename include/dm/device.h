@@ -80,6 +80,12 @@ struct driver_info;
  */
 #define DM_FLAG_VITAL			(1 << 14)
 
+/*
+ * Binding of this device's devicetree subnodes has been deferred until a
+ * lookup needs one of them (see CONFIG_SIMPLE_BUS_LAZY_BIND)
+ */
+#define DM_FLAG_BIND_PENDING		(1 << 15)
+
 /*
  * One or multiple of these flags are passed to device_remove() so that
  * a selective device removal as specified by the remove-stage and the
@@ -6,10 +6,53 @@
 #ifndef __DM_SIMPLE_BUS_H
 #define __DM_SIMPLE_BUS_H
 
+#include <dm/ofnode.h>
+#include <dm/uclass-id.h>
+
 struct simple_bus_plat {
 	fdt_addr_t base;
 	fdt_size_t size;
 	fdt_addr_t target;
+#if CONFIG_IS_ENABLED(SIMPLE_BUS_LAZY_BIND)
+	/* Uclasses that may have devices among the pending subnodes */
+	DECLARE_BITMAP(pending_ids, UCLASS_COUNT);
+	/* true once pending_ids has been worked out */
+	bool pending_ids_valid;
+#endif
 };
 
+#if CONFIG_IS_ENABLED(SIMPLE_BUS_LAZY_BIND)
+/**
+ * simple_bus_bind_pending() - Bind deferred simple-bus children for a uclass
+ *
+ * Looks through the simple-bus devices whose children have not been bound yet
+ * and binds the children of each bus with a subnode that a driver in uclass
+ * @id is compatible with.
+ *
+ * @id: Uclass being looked up
+ * @return 0 if OK, -ve on error
+ */
+int simple_bus_bind_pending(enum uclass_id id);
+
+/**
+ * simple_bus_bind_pending_node() - Bind deferred simple-bus children for a node
+ *
+ * Binds the children of each pending simple-bus which contains @node.
+ *
+ * @node: Node being looked up
+ * @return 0 if OK, -ve on error
+ */
+int simple_bus_bind_pending_node(ofnode node);
+#else
+static inline int simple_bus_bind_pending(enum uclass_id id)
+{
+	return 0;
+}
+
+static inline int simple_bus_bind_pending_node(ofnode node)
+{
+	return 0;
+}
+#endif
+
 #endif
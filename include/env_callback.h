@@ -30,6 +30,12 @@
 #define SPLASHIMAGE_CALLBACK
 #endif
 
+#ifdef CONFIG_BLOCK_CACHE
+#define BLKCACHE_CALLBACK "blkcachesize:blkcachesize,"
+#else
+#define BLKCACHE_CALLBACK
+#endif
+
 #ifdef CONFIG_REGEX
 #define ENV_DOT_ESCAPE "\\"
 #else
@@ -64,6 +70,7 @@
 #define ENV_CALLBACK_LIST_STATIC ENV_DOT_ESCAPE ENV_CALLBACK_VAR ":callbacks," \
 	ENV_DOT_ESCAPE ENV_FLAGS_VAR ":flags," \
 	"baudrate:baudrate," \
+	BLKCACHE_CALLBACK \
 	NET_CALLBACKS \
 	"loadaddr:loadaddr," \
 	SILENT_CALLBACK \
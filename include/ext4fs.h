@@ -60,6 +60,12 @@ struct ext4_extent {
 	__le32	ee_start_lo;	/* low 32 bits of physical block */
 };
 
+/*
+ * Extents longer than this are uninitialised: they are allocated but read as
+ * zeroes, and their length is ee_len - EXT_INIT_MAX_LEN
+ */
+#define EXT_INIT_MAX_LEN	(1UL << 15)
+
 /*
  * This is index on-disk structure.
  * It's used at all the levels except the bottom.
@@ -105,11 +111,15 @@ struct ext_filesystem {
 
 	/* Block Bitmap Related */
 	unsigned char **blk_bmaps;
+	/* CRC32 of each block bitmap as on disk, to find those to write */
+	uint32_t *blk_bmap_crcs;
 	long int curr_blkno;
 	uint16_t first_pass_bbmap;
 
 	/* Inode Bitmap Related */
 	unsigned char **inode_bmaps;
+	/* CRC32 of each inode bitmap as on disk */
+	uint32_t *inode_bmap_crcs;
 	int curr_inode_no;
 	uint16_t first_pass_ibmap;
 
@@ -134,7 +144,7 @@ extern int gd_index;
 extern int gindex;
 
 int ext4fs_init(void);
-void ext4fs_deinit(void);
+int ext4fs_deinit(void);
 int ext4fs_filename_unlink(char *filename);
 int ext4fs_write(const char *fname, const char *buffer,
 				 unsigned long sizebytes, int type);
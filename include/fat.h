@@ -25,8 +25,9 @@ struct disk_partition;
 #define DIRENTSPERCLUST	((mydata->clust_size * mydata->sect_size) / \
 			 sizeof(dir_entry))
 
+/* fatbufblocks is a multiple of this, so FAT12 entries do not straddle */
 #define FATBUFBLOCKS	6
-#define FATBUFSIZE	(mydata->sect_size * FATBUFBLOCKS)
+#define FATBUFSIZE	(mydata->sect_size * mydata->fatbufblocks)
 #define FAT12BUFSIZE	((FATBUFSIZE*2)/3)
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
 #define FAT32BUFSIZE	(FATBUFSIZE/4)
@@ -178,6 +179,12 @@ typedef struct {
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
 	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	__u32	fatbufblocks;	/* Size of fatbuf in sectors */
+	__u32	fat_dirty_start; /* First modified sector in fatbuf */
+	__u32	fat_dirty_end;	/* Sector after the last one modified */
+	ulong	*free_map;	/* Free-cluster bitmap, NULL until needed */
+	__u32	free_map_start;	/* First cluster covered by free_map */
+	__u32	free_map_len;	/* Number of clusters covered by free_map */
 	int	rootdir_size;	/* Size of root dir for non-FAT32 */
 	__u32	root_cluster;	/* First cluster of root dir for FAT32 */
 	u32	total_sect;	/* Number of sectors */
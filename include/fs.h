@@ -75,8 +75,11 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  * Many file functions implicitly call fs_close(), e.g. fs_closedir(),
  * fs_exist(), fs_ln(), fs_ls(), fs_mkdir(), fs_read(), fs_size(), fs_write(),
  * fs_unlink().
+ *
+ * Returns 0 on success.
+ * Returns non-zero if writes held in the block cache could not be written back.
  */
-void fs_close(void);
+int fs_close(void);
 
 /**
  * fs_get_type() - Get type of current filesystem
@@ -138,6 +141,44 @@ int fs_size(const char *filename, loff_t *size);
 int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	    loff_t *actread);
 
+/**
+ * fs_read_hash() - read a file and calculate its hash at the same time
+ *
+ * This works like fs_read() but hashes each chunk of the file straight after
+ * reading it, rather than going over the whole file again afterwards.
+ *
+ * @filename:	full path of the file to read from
+ * @addr:	address of the buffer to write to
+ * @offset:	offset in the file from where to start reading
+ * @len:	the number of bytes to read. Use 0 to read entire file.
+ * @algo_name:	name of the hash algorithm, e.g. "sha256"
+ * @digest:	returns the digest, which must have room for
+ *		HASH_MAX_DIGEST_SIZE bytes
+ * @actread:	returns the actual number of bytes read
+ * Return:	0 if OK with valid *actread and digest, -ve on error
+ */
+int fs_read_hash(const char *filename, ulong addr, loff_t offset, loff_t len,
+		 const char *algo_name, u8 *digest, loff_t *actread);
+
+/**
+ * fs_read_decomp() - read a compressed file, decompressing it on the way
+ *
+ * The file is read a chunk at a time and each chunk is decompressed straight
+ * into the buffer, so the compressed file is never held in memory as a whole.
+ *
+ * @filename:	full path of the file to read from
+ * @addr:	address of the buffer for the uncompressed data
+ * @size:	size of the buffer
+ * @offset:	offset in the file of the compressed data
+ * @len:	length of the compressed data. Use 0 to read to the end.
+ * @comp:	compression type (IH_COMP_...), or -1 to detect it from the
+ *		start of the data
+ * @actread:	returns the number of bytes decompressed
+ * Return:	0 if OK with valid *actread, -ve on error
+ */
+int fs_read_decomp(const char *filename, ulong addr, ulong size,
+		   loff_t offset, loff_t len, int comp, loff_t *actread);
+
 /**
  * fs_write() - write file to the partition previously set by fs_set_blk_dev()
  *
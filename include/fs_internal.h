@@ -13,4 +13,22 @@
 int fs_devread(struct blk_desc *, struct disk_partition *, lbaint_t, int, int,
 	       char *);
 
+/**
+ * fs_blk_read() - Read bytes from a block device into a buffer
+ *
+ * The read is split into the part of the first block which is wanted, the
+ * whole blocks, which are read straight into @buf when it is aligned for DMA,
+ * and the part of the last block which is wanted. Only the partial blocks go
+ * through a bounce buffer.
+ *
+ * @desc: Block device to read from
+ * @start: Block number which @offset is relative to, e.g. partition start
+ * @offset: Byte offset of the data from @start
+ * @len: Number of bytes to read
+ * @buf: Buffer for the data
+ * Return: 0 if OK, -EIO on a read error
+ */
+int fs_blk_read(struct blk_desc *desc, lbaint_t start, u64 offset, ulong len,
+		void *buf);
+
 #endif /* __U_BOOT_FS_INTERNAL_H__ */
@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Fake include for XzTools.h
+ */
+
+#ifndef __XZTOOLS_H__FAKE__
+#define __XZTOOLS_H__FAKE__
+
+#include "../../lib/lzma/XzTools.h"
+
+#endif
@@ -186,6 +186,19 @@ unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
 void eth_halt_state_only(void); /* Set passive state */
+
+struct phy_device;
+
+/**
+ * eth_set_phydev() - Record the PHY connected to an Ethernet device
+ *
+ * This is called by phy_connect_dev(). With CONFIG_ETH_EARLY_ANEG the
+ * uclass starts autonegotiation on this PHY once the device is probed.
+ *
+ * @dev: Ethernet device
+ * @phydev: PHY connected to @dev
+ */
+void eth_set_phydev(struct udevice *dev, struct phy_device *phydev);
 #endif
 
 #ifndef CONFIG_DM_ETH
@@ -480,4 +480,17 @@ long os_get_time_offset(void);
  */
 void os_set_time_offset(long offset);
 
+/**
+ * os_initjmp() - set up a jump buffer to start a function on a new stack
+ *
+ * A later longjmp() to @jmp calls @func running on the given stack.
+ *
+ * @jmp:	host jump buffer to set up
+ * @func:	function to call, which must not return
+ * @stack:	lowest address of the stack
+ * @size:	size of the stack in bytes
+ * Return:	0 for success, -errno on error
+ */
+int os_initjmp(ulong *jmp, void (*func)(void), void *stack, ulong size);
+
 #endif
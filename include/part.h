@@ -119,6 +119,17 @@ void part_print(struct blk_desc *dev_desc);
 void part_init(struct blk_desc *dev_desc);
 void dev_print(struct blk_desc *dev_desc);
 
+/**
+ * part_new_media_gen() - Start a new media generation on a device
+ *
+ * Caches of data read from the device note its media generation and are
+ * dropped when it changes. Generations are unique across all devices, so a
+ * descriptor which is reused for a new device never matches old entries.
+ *
+ * @dev_desc: Block device whose medium or partitions may have changed
+ */
+void part_new_media_gen(struct blk_desc *dev_desc);
+
 /**
  * blk_get_device_by_str() - Get a block device given its interface/hw partition
  *
@@ -265,6 +276,10 @@ static inline int part_get_info_whole_disk(struct blk_desc *dev_desc,
 { return -1; }
 static inline void part_print(struct blk_desc *dev_desc) {}
 static inline void part_init(struct blk_desc *dev_desc) {}
+static inline void part_new_media_gen(struct blk_desc *dev_desc)
+{
+	dev_desc->media_gen++;
+}
 static inline void dev_print(struct blk_desc *dev_desc) {}
 static inline int blk_get_device_by_str(const char *ifname, const char *dev_str,
 					struct blk_desc **dev_desc)
@@ -467,6 +482,18 @@ int gpt_verify_partitions(struct blk_desc *dev_desc,
  */
 int get_disk_guid(struct blk_desc *dev_desc, char *guid);
 
+/**
+ * part_drop_cache() - Free the cached partition table of a device
+ *
+ * The GPT is cached on the block device once read and checked, and read
+ * again whenever the device's media generation changes. This frees the
+ * cache, e.g. when the device is removed.
+ *
+ * @dev_desc: Block device
+ */
+void part_drop_cache(struct blk_desc *dev_desc);
+#else
+static inline void part_drop_cache(struct blk_desc *dev_desc) {}
 #endif
 
 #if CONFIG_IS_ENABLED(DOS_PARTITION)
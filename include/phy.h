@@ -161,6 +161,12 @@ struct phy_device {
 	u32 mmds;
 
 	int autoneg;
+	/*
+	 * Timer value when autonegotiation was last restarted; only valid
+	 * while aneg_pending is true
+	 */
+	ulong aneg_start;
+	bool aneg_pending;
 	int addr;
 	int pause;
 	int asym_pause;
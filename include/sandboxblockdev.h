@@ -12,6 +12,10 @@ struct host_block_dev {
 #endif
 	char *filename;
 	int fd;
+#ifdef CONFIG_BLK
+	struct blk_req *pending;	/* asynchronous request, if any */
+	bool pending_done;		/* @pending was carried out already */
+#endif
 };
 
 /**
@@ -21,4 +21,20 @@
  */
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
 
+/**
+ * ulz4_decompress_block() - Decompress a raw LZ4 block
+ *
+ * This handles a single block without the frame header, as used by SquashFS
+ * for example.
+ *
+ * @src: Source data to decompress
+ * @srcn: Length of source data
+ * @dst: Destination for uncompressed data
+ * @dstn: On entry, the size of @dst; returns length of uncompressed data
+ * @return 0 if OK, -EPROTO if the compressed data is corrupt or does not fit
+ *	in @dst
+ */
+int ulz4_decompress_block(const void *src, size_t srcn, void *dst,
+			  size_t *dstn);
+
 #endif
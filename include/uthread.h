@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Cooperative threads
+ */
+
+#ifndef __UTHREAD_H
+#define __UTHREAD_H
+
+#include <linux/list.h>
+#include <linux/types.h>
+
+#if CONFIG_IS_ENABLED(UTHREAD)
+#include <asm/setjmp.h>
+
+/**
+ * struct uthread - a cooperative thread
+ *
+ * Threads only switch in uthread_schedule(), which is called from delay and
+ * wait loops. There is no preemption and no locking is needed between
+ * threads, as long as a thread does not yield while it is in the middle of
+ * updating shared state.
+ *
+ * @fn: Thread entry point
+ * @arg: Argument passed to @fn
+ * @ctx: Saved context, used to resume the thread
+ * @stack: Stack of the thread, or NULL for the main thread
+ * @done: true once @fn has returned
+ * @grp_id: Group ID of the thread, see uthread_grp_new_id()
+ * @list: Node in the list of threads
+ */
+struct uthread {
+	void (*fn)(void *arg);
+	void *arg;
+	jmp_buf ctx;
+	void *stack;
+	bool done;
+	unsigned int grp_id;
+	struct list_head list;
+};
+
+/**
+ * uthread_create() - Create a new thread
+ *
+ * The thread does not start running until the current thread calls
+ * uthread_schedule().
+ *
+ * @uthr: Thread to set up (must stay valid until the thread is done)
+ * @fn: Thread entry point
+ * @arg: Argument passed to @fn
+ * @stack_sz: Stack size, or 0 to use CONFIG_UTHREAD_STACK_SIZE
+ * @grp_id: Group ID for the thread, 0 for none
+ * @return 0 if OK, -ENOMEM if the stack could not be allocated
+ */
+int uthread_create(struct uthread *uthr, void (*fn)(void *), void *arg,
+		   size_t stack_sz, unsigned int grp_id);
+
+/**
+ * uthread_schedule() - Give other threads a chance to run
+ *
+ * Switches to the next thread that is ready to run, if any. This returns
+ * once the calling thread is scheduled again.
+ *
+ * @return true if another thread ran, false if there was no other thread
+ */
+bool uthread_schedule(void);
+
+/**
+ * uthread_grp_new_id() - Allocate a new thread group ID
+ *
+ * @return new group ID, never 0
+ */
+unsigned int uthread_grp_new_id(void);
+
+/**
+ * uthread_grp_done() - Check whether all threads of a group have finished
+ *
+ * @grp_id: Group ID to check
+ * @return true if no thread in the group is still running
+ */
+bool uthread_grp_done(unsigned int grp_id);
+
+/**
+ * uthread_grp_join() - Run threads until all threads of a group have finished
+ *
+ * @grp_id: Group ID to wait for
+ */
+void uthread_grp_join(unsigned int grp_id);
+#else
+struct uthread;
+
+static inline int uthread_create(struct uthread *uthr, void (*fn)(void *),
+				 void *arg, size_t stack_sz,
+				 unsigned int grp_id)
+{
+	fn(arg);
+
+	return 0;
+}
+
+static inline bool uthread_schedule(void)
+{
+	return false;
+}
+
+static inline unsigned int uthread_grp_new_id(void)
+{
+	return 0;
+}
+
+static inline bool uthread_grp_done(unsigned int grp_id)
+{
+	return true;
+}
+
+static inline void uthread_grp_join(unsigned int grp_id)
+{
+}
+#endif
+
+#endif /* __UTHREAD_H */
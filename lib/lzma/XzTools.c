@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Decompression of XZ streams, using the LZMA decoder from the LZMA SDK
+ *
+ * An XZ stream holds a header, a series of blocks, an index and a footer.
+ * Each block holds a header listing its filters, the compressed data and a
+ * check of the uncompressed data. The data is LZMA2, which is a series of
+ * chunks, each either stored or LZMA-compressed, any of which may reset the
+ * dictionary, the LZMA state or the LZMA properties. See xz-file-format.txt
+ * in the XZ Utils sources.
+ *
+ * Only the blocks are decoded. The index and footer only help to find the
+ * blocks without reading the stream in order, which is not needed here.
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <asm/unaligned.h>
+#include <linux/string.h>
+#include <u-boot/crc.h>
+
+#include "LzmaDec.h"
+#include "XzTools.h"
+
+/* Not declared in LzmaDec.h, but used by the SDK's LZMA2 decoder */
+void LzmaDec_InitDicAndState(CLzmaDec *p, Bool initDic, Bool initState);
+
+#define XZ_HEADER_SIZE		12
+#define XZ_CHECK_NONE		0
+#define XZ_CHECK_CRC32		1
+#define XZ_CHECK_MAX		15
+
+#define XZ_BLOCK_FILTERS_MASK	0x03
+#define XZ_BLOCK_RESERVED	0x3c
+#define XZ_BLOCK_COMP_SIZE	0x40
+#define XZ_BLOCK_UNCOMP_SIZE	0x80
+
+#define XZ_FILTER_LZMA2		0x21
+#define XZ_DICT_MAX		40
+
+/* LZMA2 limits the literal context and position bits together to this */
+#define LZMA2_LCLP_MAX		4
+
+static const u8 xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0 };
+
+static void *xz_alloc(void *p, size_t size) { return malloc(size); }
+static void xz_free(void *p, void *address) { free(address); }
+
+/* Read a variable-length integer, returning its length or 0 if invalid */
+static int xz_get_vli(const u8 *in, const u8 *end, u64 *valp)
+{
+	u64 val = 0;
+	int i;
+
+	for (i = 0; i < 9 && in + i < end; i++) {
+		val |= (u64)(in[i] & 0x7f) << (i * 7);
+		if (!(in[i] & 0x80)) {
+			/* The shortest encoding must be used */
+			if (i && !in[i])
+				return 0;
+			*valp = val;
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Decode the LZMA2 data of a block into @out, using the whole of @out as the
+ * dictionary. On success @in_len and @out_len are set to the number of bytes
+ * used.
+ */
+static int xz_lzma2(CLzmaDec *dec, const u8 *in, SizeT *in_len, u8 *out,
+		    SizeT *out_len)
+{
+	const u8 *start = in, *end = in + *in_len;
+	bool need_dict = true, need_props = true;
+	ELzmaStatus status;
+	SizeT unpack, pack, used;
+	uint ctrl, mode, props;
+	SRes res;
+
+	dec->dic = out;
+	dec->dicBufSize = *out_len;
+	dec->dicPos = 0;
+
+	while (1) {
+		if (in == end)
+			return SZ_ERROR_DATA;
+		ctrl = *in++;
+		if (!ctrl)
+			break;
+
+		if (ctrl == 1 || ctrl == 2) {
+			/* Stored chunk, optionally resetting the dictionary */
+			if (end - in < 2)
+				return SZ_ERROR_DATA;
+			unpack = get_unaligned_be16(in) + 1;
+			in += 2;
+			if (ctrl == 1) {
+				LzmaDec_InitDicAndState(dec, True, False);
+				need_dict = false;
+				need_props = true;
+			} else if (need_dict) {
+				return SZ_ERROR_DATA;
+			}
+			if (end - in < unpack ||
+			    dec->dicBufSize - dec->dicPos < unpack)
+				return SZ_ERROR_DATA;
+			memcpy(dec->dic + dec->dicPos, in, unpack);
+			in += unpack;
+
+			/* As LzmaDec_UpdateWithUncompressed() in the SDK */
+			if (!dec->checkDicSize &&
+			    dec->prop.dicSize - dec->processedPos <= unpack)
+				dec->checkDicSize = dec->prop.dicSize;
+			dec->processedPos += unpack;
+			dec->dicPos += unpack;
+			continue;
+		}
+		if (ctrl < 0x80)
+			return SZ_ERROR_DATA;
+
+		/*
+		 * LZMA chunk. The mode says what to reset first: 0 nothing,
+		 * 1 the state, 2 the state and properties, 3 everything
+		 */
+		mode = (ctrl >> 5) & 3;
+		if (end - in < 4)
+			return SZ_ERROR_DATA;
+		unpack = ((ctrl & 0x1f) << 16) + get_unaligned_be16(in) + 1;
+		pack = get_unaligned_be16(in + 2) + 1;
+		in += 4;
+		if (mode == 3)
+			need_dict = false;
+		else if (need_dict)
+			return SZ_ERROR_DATA;
+		if (mode >= 2) {
+			if (in == end)
+				return SZ_ERROR_DATA;
+			props = *in++;
+			if (props >= 9 * 5 * 5)
+				return SZ_ERROR_DATA;
+			dec->prop.lc = props % 9;
+			props /= 9;
+			dec->prop.lp = props % 5;
+			dec->prop.pb = props / 5;
+			if (dec->prop.lc + dec->prop.lp > LZMA2_LCLP_MAX)
+				return SZ_ERROR_DATA;
+			need_props = false;
+		} else if (need_props) {
+			return SZ_ERROR_DATA;
+		}
+		if (end - in < pack || dec->dicBufSize - dec->dicPos < unpack)
+			return SZ_ERROR_DATA;
+
+		LzmaDec_InitDicAndState(dec, mode == 3, mode != 0);
+		unpack += dec->dicPos;
+		used = pack;
+		res = LzmaDec_DecodeToDic(dec, unpack, in, &used, LZMA_FINISH_END,
+					  &status);
+		/* The range coder must finish exactly at the end of the chunk */
+		if (res != SZ_OK || dec->dicPos != unpack || used != pack ||
+		    status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
+			return SZ_ERROR_DATA;
+		in += pack;
+	}
+
+	*in_len = in - start;
+	*out_len = dec->dicPos;
+
+	return SZ_OK;
+}
+
+/* Decode one block, starting at its header, and return its length in @lenp */
+static int xz_block(CLzmaDec *dec, const u8 *in, const u8 *end, uint check,
+		    u8 *out, SizeT *out_len, SizeT *lenp)
+{
+	const u8 *start = in, *hdr_end;
+	u64 comp_size = 0, uncomp_size = 0, id, size;
+	uint hdr_len, check_len, flags, dict;
+	SizeT in_len;
+	int ret, n;
+
+	hdr_len = (*in + 1) * 4;
+	if (end - in < hdr_len ||
+	    crc32(0, in, hdr_len - 4) != get_unaligned_le32(in + hdr_len - 4))
+		return SZ_ERROR_DATA;
+	hdr_end = in + hdr_len - 4;
+	flags = in[1];
+	in += 2;
+	if (flags & XZ_BLOCK_RESERVED)
+		return SZ_ERROR_UNSUPPORTED;
+	if (flags & XZ_BLOCK_COMP_SIZE) {
+		n = xz_get_vli(in, hdr_end, &comp_size);
+		if (!n)
+			return SZ_ERROR_DATA;
+		in += n;
+	}
+	if (flags & XZ_BLOCK_UNCOMP_SIZE) {
+		n = xz_get_vli(in, hdr_end, &uncomp_size);
+		if (!n)
+			return SZ_ERROR_DATA;
+		in += n;
+	}
+
+	/* Only LZMA2 on its own is supported, with no BCJ or delta filter */
+	n = xz_get_vli(in, hdr_end, &id);
+	if (!n)
+		return SZ_ERROR_DATA;
+	in += n;
+	if ((flags & XZ_BLOCK_FILTERS_MASK) || id != XZ_FILTER_LZMA2) {
+		log_err("XZ filter %llx is not supported\n", id);
+		return SZ_ERROR_UNSUPPORTED;
+	}
+	n = xz_get_vli(in, hdr_end, &size);
+	if (!n || size != 1 || in + n >= hdr_end)
+		return SZ_ERROR_DATA;
+	in += n;
+	dict = *in++;
+	if (dict > XZ_DICT_MAX)
+		return SZ_ERROR_DATA;
+	for (; in < hdr_end; in++) {
+		if (*in)
+			return SZ_ERROR_DATA;
+	}
+	in += 4;
+
+	/* Blocks are decoded straight into the output, so this is only a limit */
+	if (dict == XZ_DICT_MAX)
+		dec->prop.dicSize = 0xffffffff;
+	else
+		dec->prop.dicSize = (2 | (dict & 1)) << (dict / 2 + 11);
+
+	in_len = end - in;
+	ret = xz_lzma2(dec, in, &in_len, out, out_len);
+	if (ret)
+		return ret;
+	if ((flags & XZ_BLOCK_COMP_SIZE) && comp_size != in_len)
+		return SZ_ERROR_DATA;
+	if ((flags & XZ_BLOCK_UNCOMP_SIZE) && uncomp_size != *out_len)
+		return SZ_ERROR_DATA;
+	in += in_len;
+
+	/* The block is padded to a multiple of four bytes */
+	for (; (in - start) & 3; in++) {
+		if (in == end || *in)
+			return SZ_ERROR_DATA;
+	}
+
+	check_len = check ? 4 << ((check - 1) / 3) : 0;
+	if (end - in < check_len)
+		return SZ_ERROR_DATA;
+	if (check == XZ_CHECK_CRC32 &&
+	    crc32(0, out, *out_len) != get_unaligned_le32(in))
+		return SZ_ERROR_CRC;
+	in += check_len;
+	*lenp = in - start;
+
+	return SZ_OK;
+}
+
+int xzBuffToBuffDecompress(unsigned char *outStream, SizeT *uncompressedSize,
+			   const unsigned char *inStream, SizeT length)
+{
+	const u8 *in = inStream, *end = inStream + length;
+	ISzAlloc alloc = { xz_alloc, xz_free };
+	/* Allocate for the largest probability table LZMA2 allows */
+	u8 props[LZMA_PROPS_SIZE] = { LZMA2_LCLP_MAX, 0, 0, 0, 0 };
+	SizeT total = 0, out_len, len;
+	CLzmaDec dec;
+	uint check;
+	int ret;
+
+	if (length < XZ_HEADER_SIZE || memcmp(in, xz_magic, sizeof(xz_magic)) ||
+	    crc32(0, in + 6, 2) != get_unaligned_le32(in + 8))
+		return SZ_ERROR_DATA;
+	check = in[7];
+	if (in[6] || check > XZ_CHECK_MAX)
+		return SZ_ERROR_UNSUPPORTED;
+	in += XZ_HEADER_SIZE;
+
+	LzmaDec_Construct(&dec);
+	ret = LzmaDec_AllocateProbs(&dec, props, LZMA_PROPS_SIZE, &alloc);
+	if (ret)
+		return ret;
+
+	/* A zero byte starts the index, which follows the last block */
+	while (in < end && *in) {
+		out_len = *uncompressedSize - total;
+		ret = xz_block(&dec, in, end, check, outStream + total,
+			       &out_len, &len);
+		if (ret)
+			break;
+		in += len;
+		total += out_len;
+	}
+	if (!ret && in == end)
+		ret = SZ_ERROR_DATA;
+	LzmaDec_FreeProbs(&dec, &alloc);
+	if (ret)
+		return ret;
+	*uncompressedSize = total;
+
+	return SZ_OK;
+}
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Decompression of XZ streams, using the LZMA decoder from the LZMA SDK
+ */
+
+#ifndef __XZ_TOOL_H__
+#define __XZ_TOOL_H__
+
+#include <lzma/LzmaTypes.h>
+
+/**
+ * xzBuffToBuffDecompress() - Decompress an XZ stream held in memory
+ *
+ * Only blocks which use the LZMA2 filter alone can be decompressed, which is
+ * what 'xz' and 'mksquashfs -comp xz' produce unless a branch/call/jump
+ * filter is asked for. CRC32 checks are verified; other check types are
+ * skipped.
+ *
+ * @outStream: Buffer for the decompressed data
+ * @uncompressedSize: On entry, size of @outStream; on success, the number of
+ *	bytes decompressed
+ * @inStream: XZ stream
+ * @length: Length of @inStream in bytes
+ * @return SZ_OK on success, SZ_ERROR_UNSUPPORTED if the stream uses a filter
+ *	other than LZMA2, SZ_ERROR_MEM if out of memory, SZ_ERROR_DATA if the
+ *	stream is corrupt or does not fit in @outStream, SZ_ERROR_CRC if a check
+ *	fails
+ */
+int xzBuffToBuffDecompress(unsigned char *outStream, SizeT *uncompressedSize,
+			   const unsigned char *inStream, SizeT length);
+
+#endif
@@ -12,6 +12,7 @@
 #include <spl.h>
 #include <time.h>
 #include <timer.h>
+#include <uthread.h>
 #include <watchdog.h>
 #include <div64.h>
 #include <asm/global_data.h>
@@ -195,6 +196,7 @@ void udelay(unsigned long usec)
 
 	do {
 		WATCHDOG_RESET();
+		uthread_schedule();
 		kv = usec > CONFIG_WD_PERIOD ? CONFIG_WD_PERIOD : usec;
 		__udelay(kv);
 		usec -= kv;
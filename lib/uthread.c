@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Cooperative threads
+ *
+ * The threads form a ring together with the main thread, which is the thread
+ * U-Boot starts on. uthread_schedule() switches round-robin to the next thread
+ * which has not finished. Context switching uses setjmp()/longjmp(), with
+ * initjmp() provided by the architecture to start a thread on its own stack.
+ */
+
+#include <common.h>
+#include <hang.h>
+#include <log.h>
+#include <malloc.h>
+#include <uthread.h>
+#include <linux/errno.h>
+
+static struct uthread main_thread = {
+	.list = LIST_HEAD_INIT(main_thread.list),
+};
+
+static struct uthread *current = &main_thread;
+
+static unsigned int next_grp_id;
+
+static void __noreturn uthread_entry(void)
+{
+	struct uthread *uthr = current;
+
+	uthr->fn(uthr->arg);
+	uthr->done = true;
+
+	/* A finished thread is never picked again, so this does not return */
+	uthread_schedule();
+	hang();
+}
+
+int uthread_create(struct uthread *uthr, void (*fn)(void *), void *arg,
+		   size_t stack_sz, unsigned int grp_id)
+{
+	int ret;
+
+	if (!stack_sz)
+		stack_sz = CONFIG_UTHREAD_STACK_SIZE;
+
+	memset(uthr, '\0', sizeof(*uthr));
+	uthr->stack = memalign(16, stack_sz);
+	if (!uthr->stack)
+		return -ENOMEM;
+	uthr->fn = fn;
+	uthr->arg = arg;
+	uthr->grp_id = grp_id;
+
+	ret = initjmp(uthr->ctx, uthread_entry, uthr->stack, stack_sz);
+	if (ret) {
+		free(uthr->stack);
+		return ret;
+	}
+	list_add_tail(&uthr->list, &main_thread.list);
+	log_debug("created thread %p, group %u\n", uthr, grp_id);
+
+	return 0;
+}
+
+/* Drop a finished thread from the ring and release its stack */
+static void uthread_reap(struct uthread *uthr)
+{
+	log_debug("reaping thread %p\n", uthr);
+	list_del(&uthr->list);
+	free(uthr->stack);
+	uthr->stack = NULL;
+}
+
+bool uthread_schedule(void)
+{
+	struct uthread *prev = current;
+	struct list_head *pos = prev->list.next;
+	struct uthread *next;
+
+	while (pos != &prev->list) {
+		next = list_entry(pos, struct uthread, list);
+		pos = pos->next;
+		if (!next->done)
+			goto found;
+		uthread_reap(next);
+	}
+
+	return false;
+
+found:
+	current = next;
+	if (!setjmp(prev->ctx))
+		longjmp(next->ctx, 1);
+
+	return true;
+}
+
+unsigned int uthread_grp_new_id(void)
+{
+	return ++next_grp_id;
+}
+
+bool uthread_grp_done(unsigned int grp_id)
+{
+	struct uthread *uthr;
+
+	list_for_each_entry(uthr, &main_thread.list, list) {
+		if (uthr->grp_id == grp_id && !uthr->done)
+			return false;
+	}
+
+	return true;
+}
+
+void uthread_grp_join(unsigned int grp_id)
+{
+	while (!uthread_grp_done(grp_id))
+		uthread_schedule();
+}
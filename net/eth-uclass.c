@@ -13,6 +13,7 @@
 #include <env.h>
 #include <log.h>
 #include <net.h>
+#include <phy.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
@@ -26,10 +27,12 @@ DECLARE_GLOBAL_DATA_PTR;
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @phydev: PHY connected to the device, if known (see eth_set_phydev())
  */
 struct eth_device_priv {
 	enum eth_state_t state;
 	bool running;
+	struct phy_device *phydev;
 };
 
 /**
@@ -515,6 +518,35 @@ static bool eth_dev_get_mac_address(struct udevice *dev, u8 mac[ARP_HLEN])
 #endif
 }
 
+void eth_set_phydev(struct udevice *dev, struct phy_device *phydev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	if (priv)
+		priv->phydev = phydev;
+}
+
+/*
+ * Start autonegotiation now, so that it runs in the background while the
+ * rest of U-Boot starts up. The driver's start() method then only waits for
+ * whatever part of it is left, see genphy_update_link().
+ */
+static void eth_start_aneg(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+	struct phy_device *phydev = priv->phydev;
+	int ret;
+
+	if (!phydev || phydev->autoneg != AUTONEG_ENABLE ||
+	    phydev->aneg_pending)
+		return;
+
+	ret = phy_config(phydev);
+	if (ret)
+		log_debug("%s: cannot start autonegotiation (err=%d)\n",
+			  dev->name, ret);
+}
+
 static int eth_post_probe(struct udevice *dev)
 {
 	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
@@ -592,6 +624,9 @@ static int eth_post_probe(struct udevice *dev)
 
 	eth_write_hwaddr(dev);
 
+	if (IS_ENABLED(CONFIG_ETH_EARLY_ANEG))
+		eth_start_aneg(dev);
+
 	return 0;
 }
 
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for exporting bootstage records
+ */
+
+#include <common.h>
+#include <bootstage.h>
+#include <test/common.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+/* A name which needs quoting in both formats */
+#define ODD_NAME	"odd, \"name\"\\"
+
+static int test_bootstage_export(struct unit_test_state *uts)
+{
+	char buf[4096];
+	int len;
+
+	bootstage_mark_name(BOOTSTAGE_ID_ALLOC, ODD_NAME);
+
+	len = bootstage_export(buf, sizeof(buf), BOOTSTAGE_EXPORT_CSV);
+	ut_assert(len < sizeof(buf));
+	ut_assertnonnull(strstr(buf, ",\"odd, \"\"name\"\"\\\","));
+
+	len = bootstage_export(buf, sizeof(buf), BOOTSTAGE_EXPORT_JSON);
+	ut_assert(len < sizeof(buf));
+	ut_assertnonnull(strstr(buf, "\"name\":\"odd, \\\"name\\\"\\\\\","));
+
+	return 0;
+}
+COMMON_TEST(test_bootstage_export, 0);
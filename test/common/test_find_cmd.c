@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for looking up commands
+ */
+
+#include <common.h>
+#include <command.h>
+#include <test/common.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+static int test_find_cmd(struct unit_test_state *uts)
+{
+	struct cmd_tbl *cmdtp;
+
+	/* Full names */
+	cmdtp = find_cmd("setenv");
+	ut_assertnonnull(cmdtp);
+	ut_asserteq_str("setenv", cmdtp->name);
+	cmdtp = find_cmd("echo");
+	ut_assertnonnull(cmdtp);
+	ut_asserteq_str("echo", cmdtp->name);
+
+	/* Size suffixes are ignored */
+	cmdtp = find_cmd("md.b");
+	ut_assertnonnull(cmdtp);
+	ut_asserteq_str("md", cmdtp->name);
+
+	/* A unique abbreviation still works */
+	cmdtp = find_cmd("printen");
+	ut_assertnonnull(cmdtp);
+	ut_asserteq_str("printenv", cmdtp->name);
+
+	/* Ambiguous and unknown commands */
+	ut_assertnull(find_cmd("m"));
+	ut_assertnull(find_cmd("no-such-command"));
+	ut_assertnull(find_cmd(""));
+	ut_assertnull(find_cmd(NULL));
+
+	return 0;
+}
+COMMON_TEST(test_find_cmd, 0);
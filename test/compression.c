@@ -20,6 +20,7 @@
 #include <lzma/LzmaTypes.h>
 #include <lzma/LzmaDec.h>
 #include <lzma/LzmaTools.h>
+#include <lzma/XzTools.h>
 
 #include <linux/lzo.h>
 #include <test/compression.h>
@@ -74,6 +75,30 @@ static const char lzma_compressed[] =
 	"\xfd\xf5\x50\x8d\xca";
 static const unsigned long lzma_compressed_size = 229;
 
+#if IS_ENABLED(CONFIG_XZ)
+/* xz --check=crc32 -c /tmp/plain.txt > /tmp/plain.xz */
+static const char xz_compressed[] =
+	"\xfd\x37\x7a\x58\x5a\x00\x00\x01\x69\x22\xde\x36\x04\xc0\xda\x01"
+	"\xde\x02\x21\x01\x16\x00\x00\x00\x00\x00\x00\x00\x47\xb0\xfe\xf7"
+	"\xe0\x01\x5d\x00\xd2\x5d\x00\x24\x88\x08\x26\xd8\x41\xff\x99\xc8"
+	"\xcf\x66\x3d\x80\xac\xba\x17\xf1\xc8\xb9\xdf\x49\x37\xb1\x68\xa0"
+	"\x2a\xdd\x63\xd1\xa7\xa3\x66\xf8\x15\xef\xa6\x67\x8a\x14\x18\x80"
+	"\xcb\xc7\xb1\xcb\x84\x6a\xb2\x51\x16\xa1\x45\xa0\xd6\x3e\x55\x44"
+	"\x8a\x5c\xa0\x7c\xe5\xa8\xbd\x04\x57\x8f\x24\xfd\xb9\x34\x50\x83"
+	"\x2f\xf3\x46\x3e\xb9\xb0\x00\x1a\xf5\xd3\x86\x7e\x8f\x77\xd1\x5d"
+	"\x0e\x7c\xe1\xac\xde\xf8\x65\x1f\x4d\xce\x7f\xa7\x3d\xaa\xcf\x26"
+	"\xa7\x58\x69\x1e\x4c\xea\x68\x8a\xe5\x89\xd1\xdc\x4d\xc7\xe0\x07"
+	"\x42\xbf\x0c\x9d\x06\xd7\x51\xa2\x0b\x7c\x83\x35\xe1\x85\xdf\xee"
+	"\xfb\xa3\xee\x2f\x47\x5f\x8b\x70\x2b\xe1\x37\xf3\x16\xf6\x27\x54"
+	"\x8a\x33\x72\x49\xea\x53\x7d\x60\x0b\x21\x90\x66\xe7\x9e\x56\x61"
+	"\x5d\xd8\xdc\x59\xf0\xac\x2f\xd6\x49\x6b\x85\x40\x08\x1f\xdf\x26"
+	"\x25\x3b\x72\x44\xb0\xb8\x21\x2f\xb3\xd7\x9b\x24\x30\x78\x26\x44"
+	"\x07\xc3\x33\xd1\x4c\xe1\x05\x55\x6d\x00\x00\x00\x16\xe9\x08\xcd"
+	"\x00\x01\xf2\x01\xde\x02\x00\x00\xbb\x5f\x60\x63\x3e\x30\x0d\x8b"
+	"\x02\x00\x00\x00\x00\x01\x59\x5a";
+static const unsigned long xz_compressed_size = 280;
+#endif
+
 /* lzop -c /tmp/plain.txt > /tmp/plain.lzo */
 static const char lzo_compressed[] =
 	"\x89\x4c\x5a\x4f\x00\x0d\x0a\x1a\x0a\x10\x30\x20\x60\x09\x40\x01"
@@ -226,6 +251,42 @@ static int uncompress_using_lzma(struct unit_test_state *uts,
 	return (ret != SZ_OK);
 }
 
+#if IS_ENABLED(CONFIG_XZ)
+static int compress_using_xz(struct unit_test_state *uts,
+			     void *in, unsigned long in_size,
+			     void *out, unsigned long out_max,
+			     unsigned long *out_size)
+{
+	/* There is no xz compression in u-boot, so fake it. */
+	ut_asserteq(in_size,  strlen(plain));
+	ut_asserteq_mem(plain, in, in_size);
+
+	if (xz_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, xz_compressed, xz_compressed_size);
+	if (out_size)
+		*out_size = xz_compressed_size;
+
+	return 0;
+}
+
+static int uncompress_using_xz(struct unit_test_state *uts,
+			       void *in, unsigned long in_size,
+			       void *out, unsigned long out_max,
+			       unsigned long *out_size)
+{
+	int ret;
+	SizeT inout_size = out_max;
+
+	ret = xzBuffToBuffDecompress(out, &inout_size, in, in_size);
+	if (out_size)
+		*out_size = inout_size;
+
+	return (ret != SZ_OK);
+}
+#endif
+
 static int compress_using_lzo(struct unit_test_state *uts,
 			      void *in, unsigned long in_size,
 			      void *out, unsigned long out_max,
@@ -428,6 +489,14 @@ static int compression_test_lzma(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lzma, 0);
 
+#if IS_ENABLED(CONFIG_XZ)
+static int compression_test_xz(struct unit_test_state *uts)
+{
+	return run_test(uts, "xz", compress_using_xz, uncompress_using_xz);
+}
+COMPRESSION_TEST(compression_test_xz, 0);
+#endif
+
 static int compression_test_lzo(struct unit_test_state *uts)
 {
 	return run_test(uts, "lzo", compress_using_lzo, uncompress_using_lzo);
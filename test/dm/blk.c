@@ -4,8 +4,11 @@
  */
 
 #include <common.h>
+#include <command.h>
 #include <dm.h>
+#include <os.h>
 #include <part.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/global_data.h>
 #include <asm/state.h>
@@ -217,3 +220,235 @@ static int dm_test_blk_iter(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_iter, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test the block cache, including write-back if enabled */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	char buf[512], raw[512], big[9 * 512];
+	struct block_cache_stats stats;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	ulong max_size;
+	uint blocks;
+
+	ut_assertok(blk_get_device(IF_TYPE_MMC, 0, &dev));
+	desc = dev_get_uclass_plat(dev);
+
+	blkcache_stats(&stats);
+	blocks = stats.max_blocks_per_entry;
+	max_size = stats.max_size;
+	blkcache_configure(8, 1);
+	blkcache_invalidate(desc->if_type, desc->devnum);
+
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(1, stats.misses);
+	ut_asserteq(1, stats.entries);
+
+	/* Reads which are too large are not cached */
+	ut_asserteq(9, blk_dread(desc, 20, 9, big));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.entries);
+
+	/* Writes update the cache */
+	memset(buf, 0xa5, sizeof(buf));
+	ut_asserteq(1, blk_dwrite(desc, 10, 1, buf));
+	memset(buf, '\0', sizeof(buf));
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	ut_asserteq(0xa5, (u8)buf[0]);
+
+	if (IS_ENABLED(CONFIG_BLOCK_CACHE_WRITEBACK)) {
+		const struct blk_ops *ops = blk_get_ops(dev);
+
+		/* Outside a filesystem write the device sees writes at once */
+		blkcache_stats(&stats);
+		ut_asserteq(0, stats.dirty);
+		ut_asserteq(1, ops->read(dev, 10, 1, raw));
+		ut_assertok(memcmp(buf, raw, sizeof(buf)));
+
+		/* Within one, the device has not seen the write yet */
+		ut_assertok(blkcache_set_writeback(true));
+		memset(buf, 0x5a, sizeof(buf));
+		ut_asserteq(1, blk_dwrite(desc, 10, 1, buf));
+		blkcache_stats(&stats);
+		ut_asserteq(1, stats.dirty);
+		ut_asserteq(1, ops->read(dev, 10, 1, raw));
+		ut_assert(memcmp(buf, raw, sizeof(buf)));
+
+		ut_assertok(blkcache_set_writeback(false));
+		blkcache_stats(&stats);
+		ut_asserteq(0, stats.dirty);
+		ut_asserteq(1, stats.writebacks);
+		ut_asserteq(1, ops->read(dev, 10, 1, raw));
+		ut_assertok(memcmp(buf, raw, sizeof(buf)));
+	}
+
+	blkcache_configure(blocks, max_size >> 20);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLK_READAHEAD)
+/* Test that sequential reads pull the following blocks into the cache */
+static int dm_test_blk_readahead(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	char buf[512];
+
+	ut_assertok(blk_get_device(IF_TYPE_MMC, 0, &dev));
+	desc = dev_get_uclass_plat(dev);
+	blkcache_invalidate(desc->if_type, desc->devnum);
+	blkcache_stats(&stats);
+
+	/* The first read is not sequential, so nothing extra is read */
+	ut_asserteq(1, blk_dread(desc, 100, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.entries);
+
+	/* This one is, so it reads a block ahead, then two */
+	ut_asserteq(1, blk_dread(desc, 101, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(3, stats.entries);
+	ut_asserteq(1, blk_dread(desc, 102, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(1, blk_dread(desc, 103, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(6, stats.entries);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_readahead, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
+
+/* Test asynchronous requests, with and without driver support */
+static int dm_test_blk_async(struct unit_test_state *uts)
+{
+	const char *fname = "blk_async.img";
+	struct blk_req req, req2;
+	char buf[1024], data[1024];
+	struct blk_desc *desc;
+	struct udevice *dev;
+	int fd;
+
+	/* The MMC driver has no submit(), so this completes straight away */
+	ut_assertok(blk_get_device(IF_TYPE_MMC, 0, &dev));
+	desc = dev_get_uclass_plat(dev);
+	memset(data, 0x5a, sizeof(data));
+	req.start = 4;
+	req.blkcnt = 2;
+	req.buffer = data;
+	req.write = true;
+	ut_assertok(blk_submit(desc, &req));
+	ut_asserteq(true, req.done);
+	ut_asserteq(2, blk_wait(desc, &req));
+
+	req.buffer = buf;
+	req.write = false;
+	ut_assertok(blk_submit(desc, &req));
+	ut_asserteq(2, blk_wait(desc, &req));
+	ut_asserteq_mem(data, buf, sizeof(buf));
+
+	/* The host driver holds the request until it is polled */
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT | OS_O_TRUNC);
+	ut_assert(fd >= 0);
+	ut_asserteq(sizeof(data), os_write(fd, data, sizeof(data)));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname, false));
+	ut_assertok(blk_get_device(IF_TYPE_HOST, 0, &dev));
+	desc = dev_get_uclass_plat(dev);
+	blkcache_invalidate(desc->if_type, desc->devnum);
+
+	memset(buf, '\0', sizeof(buf));
+	req.start = 0;
+	ut_assertok(blk_submit(desc, &req));
+	ut_asserteq(false, req.done);
+
+	/* Only one request at a time */
+	req2 = req;
+	ut_asserteq(-EBUSY, blk_submit(desc, &req2));
+
+	ut_assertok(blk_poll(desc, &req));
+	ut_asserteq(true, req.done);
+	ut_asserteq(2, req.result);
+	ut_asserteq_mem(data, buf, sizeof(buf));
+
+	/* A synchronous read sees a write which is still pending */
+	memset(data, 0xa5, sizeof(data));
+	req.buffer = data;
+	req.write = true;
+	ut_assertok(blk_submit(desc, &req));
+	ut_asserteq(false, req.done);
+	blkcache_invalidate(desc->if_type, desc->devnum);
+	ut_asserteq(2, blk_dread(desc, 0, 2, buf));
+	ut_asserteq_mem(data, buf, sizeof(buf));
+	ut_asserteq(2, blk_wait(desc, &req));
+
+	ut_assertok(host_dev_bind(0, NULL, false));
+	ut_assertok(os_unlink(fname));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLK_STATS)
+/* Test that requests passed to the driver are counted */
+static int dm_test_blk_stats(struct unit_test_state *uts)
+{
+	struct blk_op_stats *st;
+	struct blk_stats *stats;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	char buf[4 * 512];
+
+	ut_assertok(blk_get_device(IF_TYPE_MMC, 0, &dev));
+	desc = dev_get_uclass_plat(dev);
+	blkcache_invalidate(desc->if_type, desc->devnum);
+	blk_reset_stats(dev);
+	stats = blk_get_stats(dev);
+
+	/* The second read comes from the block cache */
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	ut_asserteq(1, blk_dread(desc, 10, 1, buf));
+	ut_asserteq(4, blk_dread(desc, 30, 4, buf));
+	st = &stats->op[BLK_STATS_READ];
+	ut_asserteq(2, st->count);
+	ut_asserteq(5, st->blocks);
+	ut_asserteq(1, st->size_hist[0]);
+	ut_asserteq(1, st->size_hist[2]);
+
+	/* A failed read is counted, but not the blocks it asked for */
+	ut_asserteq(0, blk_dread(desc, desc->lba - 1, 2, buf));
+	ut_asserteq(3, st->count);
+	ut_asserteq(5, st->blocks);
+
+	ut_asserteq(2, blk_dwrite(desc, 50, 2, buf));
+	st = &stats->op[BLK_STATS_WRITE];
+	ut_asserteq(1, st->count);
+	ut_asserteq(2, st->blocks);
+	ut_asserteq(1, st->size_hist[1]);
+
+	/* Blocks held by the block cache are counted when written back */
+	if (IS_ENABLED(CONFIG_BLOCK_CACHE_WRITEBACK)) {
+		ut_assertok(blkcache_set_writeback(true));
+		ut_asserteq(2, blk_dwrite(desc, 60, 2, buf));
+		ut_asserteq(1, st->count);
+		ut_assertok(blkcache_set_writeback(false));
+		ut_asserteq(2, st->count);
+		ut_asserteq(4, st->blocks);
+	}
+
+	ut_assertok(run_command("blk reset mmc 0", 0));
+	ut_asserteq(0, stats->op[BLK_STATS_READ].count);
+	ut_asserteq(0, stats->op[BLK_STATS_WRITE].count);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_stats, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for composable virtual block devices
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <blkmap.h>
+#include <dm.h>
+#include <malloc.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define BLKSZ	512
+
+/* Fill @buf with @blkcnt blocks, each filled with its block number plus @base */
+static void fill_blocks(u8 *buf, int blkcnt, int base)
+{
+	int i;
+
+	for (i = 0; i < blkcnt; i++)
+		memset(buf + i * BLKSZ, base + i, BLKSZ);
+}
+
+/* Check that @buf holds @blkcnt blocks as written by fill_blocks() */
+static int check_blocks(struct unit_test_state *uts, const u8 *buf,
+			int blkcnt, int base)
+{
+	int i, j;
+
+	for (i = 0; i < blkcnt; i++) {
+		for (j = 0; j < BLKSZ; j++)
+			ut_asserteq((u8)(base + i), buf[i * BLKSZ + j]);
+	}
+
+	return 0;
+}
+
+static struct blk_desc *blkmap_desc(struct udevice *dev)
+{
+	struct udevice *blk;
+
+	if (device_find_first_child_by_uclass(dev, UCLASS_BLK, &blk))
+		return NULL;
+
+	return dev_get_uclass_plat(blk);
+}
+
+/* Test mapping memory to a blkmap, and reading and writing it */
+static int dm_test_blkmap_mem(struct unit_test_state *uts)
+{
+	struct blk_desc *bd;
+	struct udevice *dev;
+	u8 *low, *high, *buf;
+
+	low = malloc(4 * BLKSZ);
+	high = malloc(4 * BLKSZ);
+	buf = malloc(8 * BLKSZ);
+	ut_assertnonnull(low);
+	ut_assertnonnull(high);
+	ut_assertnonnull(buf);
+	fill_blocks(low, 4, 0);
+	fill_blocks(high, 4, 0x10);
+
+	ut_assertok(blkmap_create("test", &dev));
+	ut_asserteq(-EBUSY, blkmap_create("test", NULL));
+	ut_asserteq_ptr(dev, blkmap_from_label("test"));
+	bd = blkmap_desc(dev);
+	ut_assertnonnull(bd);
+	ut_asserteq(IF_TYPE_BLKMAP, bd->if_type);
+	ut_asserteq(0, bd->lba);
+
+	/* Slices can be mapped in any order, but must not overlap */
+	ut_assertok(blkmap_map_mem(dev, 4, 4, high));
+	ut_asserteq(8, bd->lba);
+	ut_assertok(blkmap_map_mem(dev, 0, 4, low));
+	ut_asserteq(8, bd->lba);
+	ut_asserteq(-EBUSY, blkmap_map_mem(dev, 3, 2, low));
+	ut_asserteq(-EBUSY, blkmap_map_mem(dev, 0, 8, low));
+	ut_asserteq(-EINVAL, blkmap_map_mem(dev, 8, 0, low));
+
+	/* A read may cross from one slice to the next */
+	ut_asserteq(6, blk_dread(bd, 1, 6, buf));
+	ut_assertok(check_blocks(uts, buf, 3, 1));
+	ut_assertok(check_blocks(uts, buf + 3 * BLKSZ, 3, 0x10));
+
+	/* Writes go to the memory */
+	fill_blocks(buf, 2, 0x20);
+	ut_asserteq(2, blk_dwrite(bd, 3, 2, buf));
+	ut_assertok(check_blocks(uts, low + 3 * BLKSZ, 1, 0x20));
+	ut_assertok(check_blocks(uts, high, 1, 0x21));
+
+	/* Blocks which are not mapped cannot be read */
+	ut_assertok(blkmap_map_mem(dev, 10, 1, low));
+	ut_asserteq(11, bd->lba);
+	ut_asserteq(1, blk_dread(bd, 7, 4, buf));
+
+	ut_assertok(blkmap_destroy(dev));
+	ut_assertnull(blkmap_from_label("test"));
+
+	free(buf);
+	free(high);
+	free(low);
+
+	return 0;
+}
+DM_TEST(dm_test_blkmap_mem, 0);
+
+/* Test that memory loaded over while it is mapped is read again */
+static int dm_test_blkmap_reload(struct unit_test_state *uts)
+{
+	struct blk_desc *bd;
+	struct udevice *dev;
+	u8 *mem, *buf;
+
+	mem = malloc(4 * BLKSZ);
+	buf = malloc(4 * BLKSZ);
+	ut_assertnonnull(mem);
+	ut_assertnonnull(buf);
+	fill_blocks(mem, 4, 0);
+
+	ut_assertok(blkmap_create("test", &dev));
+	ut_assertok(blkmap_map_mem(dev, 0, 4, mem));
+	bd = blkmap_desc(dev);
+	ut_assertnonnull(bd);
+	ut_assert(bd->uncached);
+
+	ut_asserteq(4, blk_dread(bd, 0, 4, buf));
+	ut_assertok(check_blocks(uts, buf, 4, 0));
+	ut_asserteq(1, blk_dread(bd, 1, 1, buf));
+	ut_assertok(check_blocks(uts, buf, 1, 1));
+
+	/* Load a new image over the memory, as tftp or load would */
+	fill_blocks(mem, 4, 0x40);
+	ut_asserteq(4, blk_dread(bd, 0, 4, buf));
+	ut_assertok(check_blocks(uts, buf, 4, 0x40));
+	ut_asserteq(1, blk_dread(bd, 1, 1, buf));
+	ut_assertok(check_blocks(uts, buf, 1, 0x41));
+
+	ut_assertok(blkmap_destroy(dev));
+
+	free(buf);
+	free(mem);
+
+	return 0;
+}
+DM_TEST(dm_test_blkmap_reload, 0);
+
+/* Test mapping blocks of another device to a blkmap */
+static int dm_test_blkmap_linear(struct unit_test_state *uts)
+{
+	struct udevice *src, *dev;
+	struct blk_desc *sbd, *bd;
+	u8 *mem, *buf;
+
+	mem = malloc(8 * BLKSZ);
+	buf = malloc(8 * BLKSZ);
+	ut_assertnonnull(mem);
+	ut_assertnonnull(buf);
+	fill_blocks(mem, 8, 0);
+
+	ut_assertok(blkmap_create("src", &src));
+	ut_assertok(blkmap_map_mem(src, 0, 8, mem));
+	sbd = blkmap_desc(src);
+	ut_assertnonnull(sbd);
+
+	/* Put the second half of the source in front of the first */
+	ut_assertok(blkmap_create("dst", &dev));
+	ut_assertok(blkmap_map_linear(dev, 0, 4, sbd->bdev, 4));
+	ut_assertok(blkmap_map_linear(dev, 4, 4, sbd->bdev, 0));
+	bd = blkmap_desc(dev);
+	ut_assertnonnull(bd);
+	ut_asserteq(8, bd->lba);
+
+	ut_asserteq(8, blk_dread(bd, 0, 8, buf));
+	ut_assertok(check_blocks(uts, buf, 4, 4));
+	ut_assertok(check_blocks(uts, buf + 4 * BLKSZ, 4, 0));
+
+	fill_blocks(buf, 1, 0x30);
+	ut_asserteq(1, blk_dwrite(bd, 5, 1, buf));
+	ut_assertok(check_blocks(uts, mem + BLKSZ, 1, 0x30));
+
+	ut_assertok(blkmap_destroy(dev));
+	ut_assertok(blkmap_destroy(src));
+
+	free(buf);
+	free(mem);
+
+	return 0;
+}
+DM_TEST(dm_test_blkmap_linear, 0);
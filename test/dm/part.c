@@ -4,13 +4,18 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <dm.h>
+#include <memalign.h>
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
+/* Blocks holding the protective MBR and primary GPT */
+#define GPT_BLKS	34
+
 static inline int do_test(struct unit_test_state *uts, int expected,
 			  const char *part_str, bool whole)
 {
@@ -97,3 +102,76 @@ out:
 	return ret;
 }
 DM_TEST(dm_test_part, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+static int dm_test_part_cache(struct unit_test_state *uts)
+{
+	char str_disk_guid[UUID_STR_LEN + 1];
+	struct disk_partition parts[1] = {
+		{
+			.start = 48,
+			.size = 1,
+			.name = "test1",
+		},
+	};
+	struct disk_partition info;
+	struct blk_desc *desc;
+	uint media_gen;
+	ALLOC_CACHE_ALIGN_BUFFER(u8, buf, 512);
+	ALLOC_CACHE_ALIGN_BUFFER(u8, tbl, GPT_BLKS * 512);
+
+	ut_asserteq(1, blk_get_device_by_str("mmc", "1", &desc));
+	ut_asserteq(512, desc->blksz);
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(desc, str_disk_guid, parts, ARRAY_SIZE(parts)));
+
+	/* The GPT is read once and then kept */
+	ut_assertok(part_get_info(desc, 1, &info));
+	ut_asserteq_str("test1", (char *)info.name);
+	ut_assertnonnull(desc->gpt_cache);
+	media_gen = desc->media_gen;
+	ut_asserteq(1, part_get_info_by_name(desc, "test1", &info));
+	ut_asserteq(media_gen, desc->media_gen);
+
+	/* Writing inside a partition leaves the table alone */
+	ut_asserteq(1, blk_dread(desc, 48, 1, buf));
+	ut_asserteq(1, blk_dwrite(desc, 48, 1, buf));
+	ut_asserteq(media_gen, desc->media_gen);
+
+	/* Writing the GPT header means it must be read again */
+	ut_asserteq(1, blk_dread(desc, 1, 1, buf));
+	ut_asserteq(1, blk_dwrite(desc, 1, 1, buf));
+	ut_assert(desc->media_gen != media_gen);
+
+	/* A new table is seen straight away */
+	strcpy((char *)parts[0].name, "test2");
+	ut_assertok(gpt_restore(desc, str_disk_guid, parts, ARRAY_SIZE(parts)));
+	ut_assertok(part_get_info(desc, 1, &info));
+	ut_asserteq_str("test2", (char *)info.name);
+
+	/*
+	 * Another hardware partition has its own table, though selecting it
+	 * need not start a new media generation. Sandbox MMC has none, so put
+	 * the old table back behind the cache's back, as if it were found on
+	 * the boot partition.
+	 */
+	ut_asserteq(GPT_BLKS, blk_dread(desc, 0, GPT_BLKS, tbl));
+	strcpy((char *)parts[0].name, "test3");
+	ut_assertok(gpt_restore(desc, str_disk_guid, parts, ARRAY_SIZE(parts)));
+	ut_assertok(part_get_info(desc, 1, &info));
+	ut_asserteq_str("test3", (char *)info.name);
+	ut_asserteq(GPT_BLKS,
+		    blk_get_ops(desc->bdev)->write(desc->bdev, 0, GPT_BLKS, tbl));
+	blkcache_invalidate(desc->if_type, desc->devnum);
+	ut_assertok(part_get_info(desc, 1, &info));
+	ut_asserteq_str("test3", (char *)info.name);
+	desc->hwpart = 1;
+	ut_assertok(part_get_info(desc, 1, &info));
+	desc->hwpart = 0;
+	ut_asserteq_str("test2", (char *)info.name);
+
+	return 0;
+}
+DM_TEST(dm_test_part_cache, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
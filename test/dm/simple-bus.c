@@ -5,6 +5,7 @@
 
 #include <common.h>
 #include <dm.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
 #include <dm/simple_bus.h>
 #include <dm/uclass-internal.h>
@@ -31,3 +32,49 @@ static int dm_test_simple_bus(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_simple_bus, UT_TESTF_SCAN_FDT | UT_TESTF_FLAT_TREE);
+
+#if CONFIG_IS_ENABLED(SIMPLE_BUS_LAZY_BIND)
+/* Put a bus back in the state it has before its children are first used */
+static int make_pending(struct unit_test_state *uts, struct udevice *bus)
+{
+	struct udevice *dev;
+
+	ut_assertok(device_chld_unbind(bus, NULL));
+	dev_or_flags(bus, DM_FLAG_BIND_PENDING);
+	device_find_first_child(bus, &dev);
+	ut_assertnull(dev);
+
+	return 0;
+}
+
+static int dm_test_simple_bus_lazy_bind(struct unit_test_state *uts)
+{
+	struct udevice *bus, *dev;
+
+	ut_assertok(device_find_global_by_ofnode(ofnode_path("/probing"),
+						 &bus));
+	ut_assertok(make_pending(uts, bus));
+
+	/* Looking up a uclass with no driver for the subnodes binds nothing */
+	uclass_find_first_device(UCLASS_PHY, &dev);
+	ut_assert(dev_get_flags(bus) & DM_FLAG_BIND_PENDING);
+	device_find_first_child(bus, &dev);
+	ut_assertnull(dev);
+
+	/* Looking up the uclass of the subnodes binds them */
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_PROBE, "test1",
+					       &dev));
+	ut_asserteq_ptr(bus, dev_get_parent(dev));
+	ut_assert(!(dev_get_flags(bus) & DM_FLAG_BIND_PENDING));
+
+	/* So does looking up one of the subnodes */
+	ut_assertok(make_pending(uts, bus));
+	ut_assertok(device_find_global_by_ofnode(ofnode_path("/probing/test2"),
+						 &dev));
+	ut_asserteq_ptr(bus, dev_get_parent(dev));
+	ut_assert(!(dev_get_flags(bus) & DM_FLAG_BIND_PENDING));
+
+	return 0;
+}
+DM_TEST(dm_test_simple_bus_lazy_bind, UT_TESTF_SCAN_FDT);
+#endif
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test cooperative threads
+ */
+
+#include <common.h>
+#include <uthread.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define STEPS	5
+
+struct uthread_test {
+	int log[2 * STEPS];
+	int log_len;
+};
+
+struct uthread_test_arg {
+	struct uthread_test *test;
+	int id;
+};
+
+static void uthread_test_fn(void *arg)
+{
+	struct uthread_test_arg *targ = arg;
+	struct uthread_test *test = targ->test;
+	int i;
+
+	for (i = 0; i < STEPS; i++) {
+		test->log[test->log_len++] = targ->id;
+		uthread_schedule();
+	}
+}
+
+/* Test that two threads take turns and can be joined */
+static int lib_test_uthread(struct unit_test_state *uts)
+{
+	struct uthread_test test = {};
+	struct uthread_test_arg targ[2] = {
+		{ .test = &test, .id = 0 },
+		{ .test = &test, .id = 1 },
+	};
+	struct uthread thr[2];
+	unsigned int grp;
+	ulong start;
+	int i;
+
+	start = ut_check_free();
+
+	grp = uthread_grp_new_id();
+	ut_assert(grp);
+	ut_assertok(uthread_create(&thr[0], uthread_test_fn, &targ[0], 0,
+				   grp));
+	ut_assertok(uthread_create(&thr[1], uthread_test_fn, &targ[1], 0,
+				   grp));
+
+	/* Nothing runs until the main thread yields */
+	ut_asserteq(0, test.log_len);
+	ut_asserteq(false, uthread_grp_done(grp));
+
+	uthread_grp_join(grp);
+	ut_asserteq(true, uthread_grp_done(grp));
+	ut_asserteq(2 * STEPS, test.log_len);
+	for (i = 0; i < test.log_len; i++)
+		ut_asserteq(i % 2, test.log[i]);
+
+	/* The stacks are released once the threads are reaped */
+	ut_asserteq(false, uthread_schedule());
+	ut_assertok(ut_check_delta(start));
+
+	return 0;
+}
+LIB_TEST(lib_test_uthread, 0);
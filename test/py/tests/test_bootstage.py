@@ -0,0 +1,104 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+"""
+Test the 'bootstage export' command and check boot time against a baseline.
+
+The regression check relies on boardenv_* providing a baseline, created by
+saving the output of 'bootstage export csv' from a known-good build. Without
+this, only the export format is checked.
+
+For example:
+
+# Baseline bootstage data and the allowed slow-down. A record fails if it
+# takes more than 'threshold_pct' percent longer than in the baseline, and
+# also more than 'slack_us' microseconds longer (to ignore jitter on records
+# that only take a short time).
+env__bootstage_baseline = {
+    'file': '/path/to/bootstage-baseline.csv',
+    'threshold_pct': 10,
+    'slack_us': 2000,
+}
+"""
+
+import csv
+import io
+import json
+import os
+import pytest
+
+def parse_csv(text):
+    """Parse the CSV output of 'bootstage export csv'
+
+    Args:
+        text: CSV text
+
+    Returns:
+        dict: record name -> (start_us, accum_us)
+    """
+    records = {}
+    for row in csv.DictReader(io.StringIO(text)):
+        records[row['name']] = (int(row['start_us']), int(row['accum_us']))
+    return records
+
+def export_csv(cons):
+    """Get the current bootstage records as CSV"""
+    output = cons.run_command('bootstage export csv')
+    return output.replace('\r', '')
+
+@pytest.mark.buildconfigspec('cmd_bootstage')
+def test_bootstage_export(u_boot_console):
+    """Test that bootstage records can be exported as CSV and JSON"""
+    cons = u_boot_console
+    text = export_csv(cons)
+    lines = text.splitlines()
+    assert lines[0] == 'id,name,start_us,accum_us'
+    records = parse_csv(text)
+    assert 'reset' in records
+    assert 'board_init_r' in records
+    assert records['board_init_r'][0] > 0
+
+    output = cons.run_command('bootstage export json')
+    data = json.loads(output)
+    names = [rec['name'] for rec in data['records']]
+    assert set(names) == set(records)
+
+@pytest.mark.buildconfigspec('cmd_bootstage')
+def test_bootstage_export_mem(u_boot_console):
+    """Test exporting bootstage records to memory"""
+    cons = u_boot_console
+    addr = cons.config.buildconfig.get('config_sys_load_addr', None)
+    if not addr:
+        pytest.skip('No load address')
+    cons.run_command('bootstage export csv %s' % addr)
+    output = cons.run_command('printenv filesize')
+    size = int(output.split('=')[1], 16)
+    assert size > len('id,name,start_us,accum_us\n')
+
+@pytest.mark.buildconfigspec('cmd_bootstage')
+def test_bootstage_regression(u_boot_console):
+    """Compare boot timings against a stored baseline"""
+    cons = u_boot_console
+    baseline = cons.config.env.get('env__bootstage_baseline', None)
+    if not baseline:
+        pytest.skip('No bootstage baseline')
+    fname = baseline['file']
+    if not os.path.exists(fname):
+        pytest.skip('Bootstage baseline %s not found' % fname)
+    threshold_pct = baseline.get('threshold_pct', 10)
+    slack_us = baseline.get('slack_us', 2000)
+
+    with open(fname) as inf:
+        old = parse_csv(inf.read())
+    new = parse_csv(export_csv(cons))
+
+    slower = []
+    for name, (start_us, accum_us) in new.items():
+        if name not in old:
+            continue
+        # Use the accumulated time for 'accum' records, else the mark time
+        old_us = old[name][1] or old[name][0]
+        new_us = accum_us or start_us
+        if (new_us - old_us > slack_us and
+                new_us * 100 > old_us * (100 + threshold_pct)):
+            slower.append('%s: %d -> %d us' % (name, old_us, new_us))
+    assert not slower, 'Boot time regressed:\n' + '\n'.join(slower)
@@ -8,6 +8,7 @@ import pytest
 import re
 from subprocess import call, check_call, check_output, CalledProcessError
 from fstest_defs import *
+from fstest_helpers import mk_fs
 import u_boot_utils as util
 
 supported_fs_basic = ['fat16', 'fat32', 'ext4']
@@ -132,53 +133,6 @@ def check_ubconfig(config, fs_type):
         pytest.skip('.config feature "%s_WRITE" not enabled'
         % fs_type.upper())
 
-def mk_fs(config, fs_type, size, id):
-    """Create a file system volume.
-
-    Args:
-        fs_type: File system type.
-        size: Size of file system in MiB.
-        id: Prefix string of volume's file name.
-
-    Return:
-        Nothing.
-    """
-    fs_img = '%s.%s.img' % (id, fs_type)
-    fs_img = config.persistent_data_dir + '/' + fs_img
-
-    if fs_type == 'fat16':
-        mkfs_opt = '-F 16'
-    elif fs_type == 'fat32':
-        mkfs_opt = '-F 32'
-    else:
-        mkfs_opt = ''
-
-    if re.match('fat', fs_type):
-        fs_lnxtype = 'vfat'
-    else:
-        fs_lnxtype = fs_type
-
-    count = (size + 1048576 - 1) / 1048576
-
-    # Some distributions do not add /sbin to the default PATH, where mkfs lives
-    if '/sbin' not in os.environ["PATH"].split(os.pathsep):
-        os.environ["PATH"] += os.pathsep + '/sbin'
-
-    try:
-        check_call('rm -f %s' % fs_img, shell=True)
-        check_call('dd if=/dev/zero of=%s bs=1M count=%d'
-            % (fs_img, count), shell=True)
-        check_call('mkfs.%s %s %s'
-            % (fs_lnxtype, mkfs_opt, fs_img), shell=True)
-        if fs_type == 'ext4':
-            sb_content = check_output('tune2fs -l %s' % fs_img, shell=True).decode()
-            if 'metadata_csum' in sb_content:
-                check_call('tune2fs -O ^metadata_csum %s' % fs_img, shell=True)
-        return fs_img
-    except CalledProcessError:
-        call('rm -f %s' % fs_img, shell=True)
-        raise
-
 # from test/py/conftest.py
 def tool_is_in_path(tool):
     """Check whether a given command is available on host.
@@ -3,7 +3,9 @@
 # Author: JJ Hiblot <jjhiblot@ti.com>
 #
 
-from subprocess import check_call, CalledProcessError
+import os
+import re
+from subprocess import call, check_call, check_output, CalledProcessError
 
 def assert_fs_integrity(fs_type, fs_img):
     try:
@@ -11,3 +13,59 @@ def assert_fs_integrity(fs_type, fs_img):
             check_call('fsck.ext4 -n -f %s' % fs_img, shell=True)
     except CalledProcessError:
         raise
+
+def mk_fs(config, fs_type, size, id, src_dir=None, fs_opts=''):
+    """Create a file system volume.
+
+    Args:
+        fs_type: File system type.
+        size: Size of file system in bytes.
+        id: Prefix string of volume's file name.
+        src_dir: Directory whose contents are copied into the volume, or None
+            for an empty volume.
+        fs_opts: Further options to pass to mkfs.
+
+    Return:
+        The volume's file name.
+    """
+    fs_img = '%s.%s.img' % (id, fs_type)
+    fs_img = config.persistent_data_dir + '/' + fs_img
+
+    if fs_type == 'fat16':
+        mkfs_opt = '-F 16'
+    elif fs_type == 'fat32':
+        mkfs_opt = '-F 32'
+    else:
+        mkfs_opt = ''
+    mkfs_opt += ' ' + fs_opts
+
+    if re.match('fat', fs_type):
+        fs_lnxtype = 'vfat'
+    else:
+        fs_lnxtype = fs_type
+        if src_dir:
+            mkfs_opt += ' -d %s' % src_dir
+
+    count = (size + 1048576 - 1) / 1048576
+
+    # Some distributions do not add /sbin to the default PATH, where mkfs lives
+    if '/sbin' not in os.environ["PATH"].split(os.pathsep):
+        os.environ["PATH"] += os.pathsep + '/sbin'
+
+    try:
+        check_call('rm -f %s' % fs_img, shell=True)
+        check_call('dd if=/dev/zero of=%s bs=1M count=%d'
+            % (fs_img, count), shell=True)
+        check_call('mkfs.%s %s %s'
+            % (fs_lnxtype, mkfs_opt, fs_img), shell=True)
+        if fs_type == 'ext4':
+            sb_content = check_output('tune2fs -l %s' % fs_img, shell=True).decode()
+            if 'metadata_csum' in sb_content:
+                check_call('tune2fs -O ^metadata_csum %s' % fs_img, shell=True)
+        elif src_dir:
+            check_call('mcopy -i %s -s %s/* ::/' % (fs_img, src_dir),
+                shell=True)
+        return fs_img
+    except CalledProcessError:
+        call('rm -f %s' % fs_img, shell=True)
+        raise
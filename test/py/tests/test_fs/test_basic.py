@@ -290,3 +290,54 @@ class TestFsBasic(object):
                 'setenv filesize'])
             assert(md5val[0] in ''.join(output))
             assert_fs_integrity(fs_type, fs_img)
+
+    @pytest.mark.buildconfigspec('cmd_hash')
+    def test_fs14(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 14 - load a file and hash it at the same time
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 14 - load -h'):
+            # Test Case 14a - Hash the big file in chunks while loading it
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'load -h sha256 host 0:0 %x /%s %x 0x0'
+                    % (ADDR, BIG_FILE, LENGTH * 3),
+                'printenv filesize'])
+            assert('filesize=300000' in ''.join(output))
+
+            # Test Case 14b - The digest matches hashing it afterwards
+            filehash = u_boot_console.run_command('echo $filehash')
+            output = u_boot_console.run_command(
+                'hash sha256 %x $filesize' % ADDR)
+            assert(re.match('^[0-9a-f]{64}$', filehash))
+            assert(filehash in output)
+
+            # Test Case 14c - An unknown algorithm is rejected
+            output = u_boot_console.run_command(
+                'load -h bogus host 0:0 %x /%s' % (ADDR, SMALL_FILE))
+            assert('Unknown hash algorithm' in output)
+            u_boot_console.run_command('setenv filesize; setenv filehash')
+
+    def test_fs15(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 15 - load to a buffer which is not aligned for DMA
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 15 - load (misaligned)'):
+            # Test Case 15a - Read the whole small file to an odd address
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR + 1, SMALL_FILE),
+                'md5sum %x $filesize' % (ADDR + 1),
+                'setenv filesize'])
+            assert(md5val[0] in ''.join(output))
+
+            # Test Case 15b - Read 1MB from 2.5GB into the big file to an
+            # address which is not aligned either
+            output = u_boot_console.run_command_list([
+                '%sload host 0:0 %x /%s %x 0x9c300000'
+                    % (fs_type, ADDR + 3, BIG_FILE, LENGTH),
+                'md5sum %x $filesize' % (ADDR + 3),
+                'setenv filesize'])
+            assert(md5val[2] in ''.join(output))
@@ -0,0 +1,104 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+""" Tests reading a filesystem image in memory through a blkmap after a new
+image is loaded over it.
+
+Nothing read from a blkmap may be cached, since the memory it maps can be
+changed by commands which know nothing of it, such as tftp or load.
+"""
+
+import hashlib
+import os
+import shutil
+import subprocess
+import pytest
+from fstest_helpers import mk_fs
+
+# Address the images are loaded to, clear of $kernel_addr_r
+IMAGE_ADDR = 0x2000000
+
+# Size of each image in bytes and 512-byte blocks
+IMAGE_SIZE = 4 << 20
+IMAGE_BLKS = IMAGE_SIZE // 512
+
+# Size of the file which differs between the images
+DATA_SIZE = 64 << 10
+
+# Offset and length of a read from the middle of the file
+PART_POS = 0x5000
+PART_LEN = 0x3000
+
+# Option needed in U-Boot to read each filesystem, and further mkfs options
+FS_TYPES = {
+        'ext4' : ('config_fs_ext4', '-q'),
+        'fat16' : ('config_fs_fat', '-s 1'),
+}
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_blkmap')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.parametrize('fs_type', FS_TYPES.keys())
+def test_blkmap_reload(u_boot_console, fs_type):
+    """ Loads files from an image mapped by a blkmap, loads another image over
+    it and loads the files again.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+        fs_type: type of filesystem on the images.
+    """
+    cons = u_boot_console
+    config, fs_opts = FS_TYPES[fs_type]
+    if cons.config.buildconfig.get(config, 'n') != 'y':
+        pytest.skip('%s is not enabled' % config)
+
+    images = []
+    datas = []
+    for i in range(2):
+        src_dir = os.path.join(cons.config.persistent_data_dir,
+                               'blkmap%d' % i)
+        shutil.rmtree(src_dir, ignore_errors=True)
+        os.makedirs(src_dir)
+        data = os.urandom(DATA_SIZE)
+        with open(os.path.join(src_dir, 'data'), 'wb') as outf:
+            outf.write(data)
+        with open(os.path.join(src_dir, 'only%d' % i), 'wb') as outf:
+            outf.write(b'%d\n' % i)
+        try:
+            image = mk_fs(cons.config, fs_type, IMAGE_SIZE, 'blkmap%d' % i,
+                          src_dir, fs_opts)
+        except subprocess.CalledProcessError:
+            image = None
+        shutil.rmtree(src_dir)
+        if not image:
+            for image in images:
+                os.remove(image)
+            pytest.skip('cannot make a %s image' % fs_type)
+        images.append(image)
+        datas.append(data)
+
+    cons.run_command('blkmap create reload')
+    cons.run_command('blkmap map reload 0 %x mem %x' %
+                     (IMAGE_BLKS, IMAGE_ADDR))
+    cons.run_command('blkmap get reload dev devnum')
+    for i, image in enumerate(images):
+        out = cons.run_command('load hostfs - %x %s' % (IMAGE_ADDR, image))
+        assert '%d bytes read' % IMAGE_SIZE in out
+
+        out = cons.run_command('ls blkmap ${devnum}').lower()
+        assert 'only%d' % i in out
+        assert 'only%d' % (1 - i) not in out
+
+        out = cons.run_command('load blkmap ${devnum} $kernel_addr_r data')
+        assert '%d bytes read' % DATA_SIZE in out
+        out = cons.run_command('md5sum $kernel_addr_r %x' % DATA_SIZE)
+        assert out.split()[-1] == hashlib.md5(datas[i]).hexdigest()
+
+        out = cons.run_command('load blkmap ${devnum} $kernel_addr_r data '
+                               '%x %x' % (PART_LEN, PART_POS))
+        assert '%d bytes read' % PART_LEN in out
+        out = cons.run_command('md5sum $kernel_addr_r %x' % PART_LEN)
+        part = datas[i][PART_POS:PART_POS + PART_LEN]
+        assert out.split()[-1] == hashlib.md5(part).hexdigest()
+    cons.run_command('blkmap destroy reload')
+    for image in images:
+        os.remove(image)
@@ -0,0 +1,84 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+""" Tests looking up names in an ext4 directory with a hash tree index.
+
+The directory is large enough, with 1KiB blocks, that the index has a level
+below the root. Names are looked up through the index, while '..' and
+relative symlinks must still be found in the first block of the directory.
+"""
+
+import hashlib
+import os
+import shutil
+import subprocess
+import pytest
+from fstest_helpers import mk_fs
+
+# Number of files in the indexed directory
+FILE_COUNT = 12000
+
+# Files looked up, spread over the directory
+LOOKUPS = (0, 1, 777, 4096, 9999, FILE_COUNT - 1)
+
+def content(i):
+    """ Returns the content of file i, which is different for each file. """
+    return ('%d\n' % i).encode()
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('fs_ext4')
+@pytest.mark.requiredtool('debugfs')
+@pytest.mark.requiredtool('e2fsck')
+def test_ext4_htree(u_boot_console):
+    """ Loads files from an indexed directory, directly and through '..' and
+    a relative symlink.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+    """
+    cons = u_boot_console
+    src_dir = os.path.join(cons.config.persistent_data_dir, 'ext4_htree')
+    shutil.rmtree(src_dir, ignore_errors=True)
+    os.makedirs(os.path.join(src_dir, 'big'))
+    os.makedirs(os.path.join(src_dir, 'lib'))
+    for i in range(FILE_COUNT):
+        with open(os.path.join(src_dir, 'big', 'file%d' % i), 'wb') as outf:
+            outf.write(content(i))
+    with open(os.path.join(src_dir, 'lib', 'foo'), 'wb') as outf:
+        outf.write(b'foo\n')
+    os.symlink('../lib/foo', os.path.join(src_dir, 'big', 'link'))
+    try:
+        image = mk_fs(cons.config, 'ext4', 48 << 20, 'htree', src_dir,
+                      '-q -b 1024 -O dir_index,^metadata_csum')
+    except subprocess.CalledProcessError:
+        image = None
+    shutil.rmtree(src_dir)
+    if not image:
+        pytest.skip('mkfs.ext4 cannot populate an image')
+
+    # Build the index, which mkfs.ext4 may not have done
+    subprocess.run('e2fsck -fyD %s' % image, shell=True,
+                   stdout=subprocess.DEVNULL)
+    out = subprocess.run('debugfs -R "htree /big" %s' % image, shell=True,
+                         check=True, capture_output=True, text=True)
+    assert 'Indirect levels: 1' in out.stdout
+
+    cons.run_command('host bind 0 %s' % image)
+    for i in LOOKUPS:
+        cons.run_command('mw.b $kernel_addr_r 0 10')
+        out = cons.run_command('load host 0 $kernel_addr_r /big/file%d' % i)
+        assert '%d bytes read' % len(content(i)) in out
+        out = cons.run_command('md5sum $kernel_addr_r $filesize')
+        assert out.split()[-1] == hashlib.md5(content(i)).hexdigest()
+
+    for path in ('/big/../lib/foo', '/big/./../lib/foo', '/big/link'):
+        cons.run_command('mw.b $kernel_addr_r 0 10')
+        out = cons.run_command('load host 0 $kernel_addr_r %s' % path)
+        assert '4 bytes read' in out
+        out = cons.run_command('md5sum $kernel_addr_r $filesize')
+        assert out.split()[-1] == hashlib.md5(b'foo\n').hexdigest()
+
+    out = cons.run_command('load host 0 $kernel_addr_r /big/file%d' %
+                           FILE_COUNT)
+    assert 'Failed to load' in out
+    os.remove(image)
@@ -0,0 +1,99 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+""" Tests reading a FAT file at an offset after it is rewritten.
+
+The FAT driver keeps the cluster chain of the file last read. A second image
+holds a file with the same name, start cluster and size but a different chain,
+as when the file is rewritten on the host. Reading it at an offset after
+binding that image must follow the new chain, not the one kept from the first.
+"""
+
+import hashlib
+import os
+import shutil
+import struct
+import pytest
+from fstest_helpers import mk_fs
+
+# Number of clusters in each file; clusters are one sector
+CLUSTERS = 8
+
+def fat16_layout(img):
+    """ Returns the FAT offset, FAT size, FAT count, root directory offset and
+    data offset in bytes, and the cluster size, of a FAT16 image. """
+    bps, spc, reserved, nfats, root_ents = struct.unpack_from('<HBHBH', img, 11)
+    fat_sz = struct.unpack_from('<H', img, 22)[0]
+    fat_off = reserved * bps
+    root_off = fat_off + nfats * fat_sz * bps
+    data_off = root_off + root_ents * 32
+    return fat_off, fat_sz * bps, nfats, root_off, data_off, spc * bps
+
+def start_cluster(img, root_off, name):
+    """ Returns the start cluster of file 'name' in the root directory. """
+    for off in range(root_off, len(img), 32):
+        if img[off] == 0:
+            break
+        if img[off + 11] != 0x0f and img[off:off + 11] == name:
+            return struct.unpack_from('<H', img, off + 26)[0]
+    raise ValueError('%s not found' % name)
+
+def set_chain(img, fat_off, fat_bytes, nfats, chain):
+    """ Links the clusters in 'chain' in every copy of the FAT. """
+    for fat in range(nfats):
+        base = fat_off + fat * fat_bytes
+        for clust, nxt in zip(chain, chain[1:] + [0xffff]):
+            struct.pack_into('<H', img, base + 2 * clust, nxt)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('fs_fat')
+@pytest.mark.requiredtool('mkfs.vfat')
+@pytest.mark.requiredtool('mcopy')
+def test_fat_runs_rewrite(u_boot_console):
+    """ Reads a file at an offset, rewrites it and reads it again.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+    """
+    cons = u_boot_console
+    src_dir = os.path.join(cons.config.persistent_data_dir, 'fat_runs')
+    shutil.rmtree(src_dir, ignore_errors=True)
+    os.makedirs(src_dir)
+    data = os.urandom(CLUSTERS * 512)
+    spare = os.urandom(CLUSTERS * 512)
+    with open(os.path.join(src_dir, 'DATA'), 'wb') as outf:
+        outf.write(data)
+    with open(os.path.join(src_dir, 'SPARE'), 'wb') as outf:
+        outf.write(spare)
+    image1 = mk_fs(cons.config, 'fat16', 16 << 20, 'fat_runs1', src_dir,
+                   '-s 1 -S 512')
+    shutil.rmtree(src_dir)
+
+    # Swap all but the first cluster of the two files
+    with open(image1, 'rb') as inf:
+        img = bytearray(inf.read())
+    fat_off, fat_bytes, nfats, root_off, data_off, csize = fat16_layout(img)
+    assert csize == 512
+    first = start_cluster(img, root_off, b'DATA       ')
+    other = start_cluster(img, root_off, b'SPARE      ')
+    set_chain(img, fat_off, fat_bytes, nfats,
+              [first] + list(range(other + 1, other + CLUSTERS)))
+    set_chain(img, fat_off, fat_bytes, nfats,
+              [other] + list(range(first + 1, first + CLUSTERS)))
+    image2 = image1.replace('fat_runs1', 'fat_runs2')
+    with open(image2, 'wb') as outf:
+        outf.write(img)
+    rewritten = data[:csize] + spare[csize:]
+
+    pos = 3 * csize
+    for image, expect in ((image1, data), (image2, rewritten)):
+        cons.run_command('host bind 0 %s' % image)
+        cons.run_command('mw.b $kernel_addr_r 0 %x' % csize)
+        out = cons.run_command('load host 0 $kernel_addr_r DATA %x %x' %
+                               (csize, pos))
+        assert '%d bytes read' % csize in out
+        out = cons.run_command('md5sum $kernel_addr_r %x' % csize)
+        assert (out.split()[-1] ==
+                hashlib.md5(expect[pos:pos + csize]).hexdigest())
+    os.remove(image1)
+    os.remove(image2)
@@ -0,0 +1,83 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+""" Tests decompressing files while loading them with 'load -z'.
+
+Each file is compressed on the host and put on an ext4 image, then loaded
+with each way of giving the compression, and the result is checked against
+the original.
+"""
+
+import os
+import shutil
+import subprocess
+import pytest
+import u_boot_utils
+from fstest_helpers import mk_fs
+
+# Host command to compress a file to stdout, the extension and the option
+# needed in U-Boot to decompress it
+COMPRESSORS = {
+        'gzip' : ('gzip -c', 'gz', 'config_gzip'),
+        'lzma' : ('lzma -c', 'lzma', 'config_lzma'),
+        'lz4' : ('lz4 -c', 'lz4', 'config_lz4'),
+        'zstd' : ('zstd -c', 'zst', 'config_zstd'),
+}
+
+# Size of the test file in bytes; this is several chunks of compressed data
+FILE_SIZE = 3 << 20
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('fs_decomp')
+@pytest.mark.buildconfigspec('fs_ext4')
+@pytest.mark.parametrize('comp', COMPRESSORS.keys())
+def test_load_decomp(u_boot_console, comp):
+    """ Loads a file compressed with 'comp', decompressing it on the way.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+        comp: the compressor.
+    """
+    cons = u_boot_console
+    cmd, ext, config = COMPRESSORS[comp]
+    if cons.config.buildconfig.get(config, 'n') != 'y':
+        pytest.skip('%s is not enabled' % config)
+    if not shutil.which(cmd.split()[0]):
+        pytest.skip('%s is not installed' % cmd.split()[0])
+
+    src_dir = os.path.join(cons.config.persistent_data_dir, 'load_decomp')
+    shutil.rmtree(src_dir, ignore_errors=True)
+    os.makedirs(src_dir)
+    orig = src_dir + '.orig'
+    # Half random, half zeroes, so that it compresses a little
+    with open(orig, 'wb') as outf:
+        outf.write(os.urandom(FILE_SIZE // 2))
+        outf.write(bytes(FILE_SIZE // 2))
+    expect = u_boot_utils.md5sum_file(orig).hex()
+    fname = 'file.' + ext
+    subprocess.run('%s %s > %s' % (cmd, orig, os.path.join(src_dir, fname)),
+                   shell=True, check=True)
+    os.remove(orig)
+    try:
+        image = mk_fs(cons.config, 'ext4', 8 << 20, 'load_decomp', src_dir,
+                      '-q')
+    except subprocess.CalledProcessError:
+        image = None
+    shutil.rmtree(src_dir)
+    if not image:
+        pytest.skip('mkfs.ext4 cannot populate an image')
+
+    cons.run_command('host bind 0 %s' % image)
+    for name in (comp, 'auto'):
+        cons.run_command('mw.b $kernel_addr_r 0 %x' % FILE_SIZE)
+        out = cons.run_command('load -z %s host 0 $kernel_addr_r %s' %
+                               (name, fname))
+        assert '%d bytes read' % FILE_SIZE in out
+        out = cons.run_command('md5sum $kernel_addr_r $filesize')
+        assert out.split()[-1] == expect
+
+    # Compressed data which is cut short is rejected
+    out = cons.run_command('load -z %s host 0 $kernel_addr_r %s 1000' %
+                           (comp, fname))
+    assert 'Failed to load' in out
+    os.remove(image)
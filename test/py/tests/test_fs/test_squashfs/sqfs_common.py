@@ -22,7 +22,10 @@ STANDARD_TABLE = {
         'zstd_no_frag' : '',
         'gzip_comp_frag' : '',
         'gzip_frag' : '',
-        'gzip_no_frag' : ''
+        'gzip_no_frag' : '',
+        'lz4_comp_frag' : '',
+        'lz4_frag' : '',
+        'lz4_no_frag' : ''
 }
 
 """ EXTRA_TABLE: Set this table's keys and values if you want to make squashfs
@@ -44,7 +47,7 @@ def get_opts_list():
         fragmentation option joined by a whitespace.
     """
     # supported compression options only
-    comp_opts = ['-comp lzo', '-comp zstd', '-comp gzip']
+    comp_opts = ['-comp lzo', '-comp zstd', '-comp gzip', '-comp lz4']
     # file fragmentation options
     frag_opts = ['-always-use-fragments', '-always-use-fragments -noF', '-no-fragments']
 
@@ -0,0 +1,95 @@
+# SPDX-License-Identifier: GPL-2.0
+
+""" Measures how quickly sqfsload reads a large file with each compressor.
+
+The timings are only reported, not checked, since they depend on the host.
+"""
+
+import os
+import random
+import re
+import shutil
+import subprocess
+import pytest
+import u_boot_utils
+
+from sqfs_common import mksquashfs, check_mksquashfs_version
+
+# Compressors and the option needed in U-Boot to read them
+COMPRESSORS = {
+        'gzip' : 'config_zlib',
+        'lzo' : 'config_lzo',
+        'lz4' : 'config_lz4',
+        'zstd' : 'config_zstd',
+        'xz' : 'config_xz',
+}
+
+# Size of the test file in bytes
+FILE_SIZE = 8 << 20
+
+def generate_big_file(file_name, file_size):
+    """ Generates a file with text that compresses about as well as code.
+
+    Args:
+        file_name: the file's name.
+        file_size: the file size.
+    """
+    rand = random.Random(0)
+    words = [''.join(rand.choice('abcdefghijklmnopqrstuvwxyz')
+                     for _ in range(rand.randint(2, 10))) for _ in range(512)]
+    out = []
+    size = 0
+    while size < file_size:
+        word = rand.choice(words) + rand.choice(' \n')
+        out.append(word)
+        size += len(word)
+
+    with open(file_name, 'w') as file:
+        file.write(''.join(out)[:file_size])
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_squashfs')
+@pytest.mark.buildconfigspec('fs_squashfs')
+@pytest.mark.requiredtool('mksquashfs')
+@pytest.mark.slow
+@pytest.mark.parametrize('comp', COMPRESSORS.keys())
+def test_sqfs_throughput(u_boot_console, comp):
+    """ Loads a large file from an image made with compressor 'comp'.
+
+    Args:
+        u_boot_console: provides the means to interact with U-Boot's console.
+        comp: the mksquashfs compressor.
+    """
+    cons = u_boot_console
+    if cons.config.buildconfig.get(COMPRESSORS[comp], 'n') != 'y':
+        pytest.skip('%s is not enabled' % COMPRESSORS[comp])
+    check_mksquashfs_version()
+
+    build_dir = cons.config.build_dir
+    src_dir = os.path.join(build_dir, 'sqfs_speed_dir')
+    image = os.path.join(build_dir, 'sqfs_speed_' + comp)
+    os.makedirs(src_dir, exist_ok=True)
+    try:
+        file_path = os.path.join(src_dir, 'big')
+        generate_big_file(file_path, FILE_SIZE)
+        try:
+            mksquashfs(' '.join([src_dir, image, '-noappend -comp', comp]))
+        except subprocess.CalledProcessError:
+            pytest.skip('mksquashfs does not support %s' % comp)
+
+        cons.run_command('host bind 0 %s' % image)
+        out = cons.run_command('sqfsload host 0 $kernel_addr_r big')
+        match = re.search(r'(\d+) bytes read in (\d+) ms', out)
+        assert match
+        assert int(match.group(1)) == FILE_SIZE
+        msecs = max(int(match.group(2)), 1)
+        cons.log.info('%s: %d KiB/s' % (comp, FILE_SIZE * 1000 / 1024 / msecs))
+
+        out = cons.run_command('md5sum $kernel_addr_r %x' % FILE_SIZE)
+        expected = u_boot_utils.md5sum_file(file_path).hex()
+        assert out.split()[-1] == expected
+    finally:
+        shutil.rmtree(src_dir)
+        if os.path.exists(image):
+            os.remove(image)
@@ -128,3 +128,35 @@ class TestSymlink(object):
                 output = u_boot_console.run_command('printenv filesize')
             assert('"filesize" not defined' in ''.join(output))
             assert_fs_integrity(fs_type, fs_img)
+
+    def test_symlink5(self, u_boot_console, fs_obj_symlink):
+        """
+        Test Case 5 - create links whose target is kept in the inode and in
+        a data block
+        """
+        fs_type, fs_img, md5val = fs_obj_symlink
+        long_name = 'long' * 20 + '.file'
+        with u_boot_console.log.section('Test Case 5 - short and long targets'):
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'setenv filesize',
+                '%sload host 0:0 %x /%s' % (fs_type, ADDR, SMALL_FILE),
+                '%swrite host 0:0 %x /%s $filesize' % (fs_type, ADDR,
+                                                        long_name),
+                'ln host 0:0 %s /short.link' % SMALL_FILE,
+                'ln host 0:0 /%s /long.link' % long_name,
+            ])
+            assert('Unable' not in ''.join(output))
+
+            for link in ('short.link', 'long.link'):
+                output = u_boot_console.run_command_list([
+                    'mw %x 0 %x' % (ADDR, 0x100000),
+                    '%sload host 0:0 %x /%s' % (fs_type, ADDR, link),
+                    'printenv filesize'])
+                assert('filesize=100000' in ''.join(output))
+
+                output = u_boot_console.run_command_list([
+                    'md5sum %x $filesize' % ADDR,
+                    'setenv filesize'])
+                assert(md5val[0] in ''.join(output))
+            assert_fs_integrity(fs_type, fs_img)